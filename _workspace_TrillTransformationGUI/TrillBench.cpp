@@ -0,0 +1,533 @@
+// Trill Transformation Tool - Microbenchmarks
+// Builds as trill-bench: times the engine's hot functions with a small
+// self-contained harness and writes the results as JSON, so they can be
+// compared across releases.
+//
+// Each benchmark is warmed up, then timed over several repetitions of
+// enough iterations to last --min-time. The per-op time is the median over
+// the repetitions; the median absolute deviation (MAD) shows their spread.
+//
+// With --check the benchmarks listed in a baseline file are run and compared
+// against it (the CTest performance gate). Costs are kept relative to a fixed
+// calibration loop, so one baseline serves faster and slower machines, and
+// use the fastest repetition, which other load on the machine disturbs least.
+
+#include "TrillCorpus.h"
+#include "TrillTransformation.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+
+#ifndef TRILL_BUILD_TYPE
+#define TRILL_BUILD_TYPE ""
+#endif
+
+// Keeps benchmarked results alive so the compiler cannot drop the work
+static volatile size_t g_sink = 0;
+
+static double nowNs() {
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct BenchOptions {
+    std::string filter;
+    int repetitions = 10;
+    double minTimeMs = 20;     // Shortest repetition
+    double warmupMs = 50;
+    double maxTimeS = 10;      // Stop repeating a benchmark after this long (3 repetitions at least)
+    std::vector<size_t> lineCounts = {1000, 1000000, 10000000};
+    std::string jsonPath;      // Empty: stdout
+    bool quiet = false;
+    std::vector<std::string> names;  // Exact names to run (from a baseline); empty: all
+    std::string baselinePath;  // --check: compare against this baseline
+    std::string writeBaselinePath;
+    double tolerancePct = 25;  // Largest accepted slowdown against the baseline
+};
+
+// One benchmark: body runs a single op that handles items items
+struct Benchmark {
+    std::string name;
+    size_t items = 1;
+    std::function<void()> body;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t items = 0;
+    long long iterations = 0;  // Ops per repetition
+    int repetitions = 0;
+    double medianNs = 0;       // Per op
+    double madNs = 0;
+    double minNs = 0;
+};
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static BenchResult runBenchmark(const Benchmark& bench, const BenchOptions& options) {
+    BenchResult result;
+    result.name = bench.name;
+    result.items = bench.items;
+
+    // Warm up, timing single ops to size the repetitions
+    double start = nowNs();
+    long long warmups = 0;
+    double elapsed = 0;
+    do {
+        bench.body();
+        ++warmups;
+        elapsed = nowNs() - start;
+    } while (elapsed < options.warmupMs * 1e6);
+    double estimate = elapsed / warmups;
+    long long iterations = std::max<long long>(1, static_cast<long long>(options.minTimeMs * 1e6 / estimate));
+
+    std::vector<double> perOp;
+    double begun = nowNs();
+    for (int rep = 0; rep < options.repetitions; ++rep) {
+        double t0 = nowNs();
+        for (long long i = 0; i < iterations; ++i) {
+            bench.body();
+        }
+        perOp.push_back((nowNs() - t0) / iterations);
+        if (rep >= 2 && nowNs() - begun > options.maxTimeS * 1e9) break;
+    }
+
+    result.iterations = iterations;
+    result.repetitions = static_cast<int>(perOp.size());
+    result.medianNs = median(perOp);
+    std::vector<double> deviations;
+    for (double t : perOp) {
+        deviations.push_back(std::abs(t - result.medianNs));
+    }
+    result.madNs = median(deviations);
+    result.minNs = *std::min_element(perOp.begin(), perOp.end());
+    return result;
+}
+
+static std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped.push_back('\\');
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results, const BenchOptions& options) {
+    out << std::fixed << std::setprecision(2);
+    out << "{\n"
+        << "  \"tool\": \"trill-bench\",\n"
+        << "  \"build_type\": \"" << jsonEscape(TRILL_BUILD_TYPE) << "\",\n"
+        << "  \"repetitions\": " << options.repetitions << ",\n"
+        << "  \"min_time_ms\": " << options.minTimeMs << ",\n"
+        << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        double itemsPerSecond = r.medianNs > 0 ? r.items * 1e9 / r.medianNs : 0;
+        out << "    {\"name\": \"" << jsonEscape(r.name) << "\""
+            << ", \"items_per_op\": " << r.items
+            << ", \"iterations\": " << r.iterations
+            << ", \"repetitions\": " << r.repetitions
+            << ", \"ns_per_op\": " << r.medianNs
+            << ", \"mad_ns\": " << r.madNs
+            << ", \"min_ns\": " << r.minNs
+            << ", \"ns_per_item\": " << r.medianNs / r.items
+            << ", \"items_per_second\": " << itemsPerSecond << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+// Deterministic input table of lines notes from the corpus generator
+static void writeInputTable(const std::string& path, size_t lines) {
+    CorpusSettings settings;
+    settings.lines = lines;
+    settings.seed = 42;
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (out != nullptr) {
+        writeCorpus(settings, out);
+        std::fclose(out);
+    }
+}
+
+static std::string lineCountName(size_t lines) {
+    if (lines % 1000000 == 0) return std::to_string(lines / 1000000) + "M";
+    if (lines % 1000 == 0) return std::to_string(lines / 1000) + "K";
+    return std::to_string(lines);
+}
+
+static bool selected(const std::string& name, const BenchOptions& options) {
+    if (!options.names.empty() &&
+        std::find(options.names.begin(), options.names.end(), name) == options.names.end()) {
+        return false;
+    }
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+// A fixed mix of the work the engine does per line: integer mixing, number
+// formatting into short strings and sorting. Its time per op is the unit
+// baseline costs are measured in. The random state carries over between
+// calls so the branch predictor cannot learn one fixed input.
+static void calibrationLoop() {
+    static uint64_t x = 0x9E3779B97F4A7C15ull;
+    static std::vector<uint32_t> values(1024);
+    std::string text;
+    char digits[24];
+    for (uint32_t& value : values) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        value = static_cast<uint32_t>(x);
+        text.append(digits, std::to_chars(digits, digits + sizeof(digits), value % 100000).ptr);
+        text += ' ';
+    }
+    std::sort(values.begin(), values.end());
+    g_sink = text.size() + values[values.size() / 2];
+}
+
+// Checked-in expectations: the build type and input sizes they were measured
+// with and each benchmark's cost in calibration loops
+struct Baseline {
+    std::string buildType;
+    std::string lines;
+    std::vector<std::pair<std::string, double>> costs;
+};
+
+// Lines of "build_type TYPE", "lines LIST" or "NAME COST"; # starts a comment
+static bool readBaseline(const std::string& path, Baseline& baseline) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key) || key[0] == '#') continue;
+        if (key == "build_type") {
+            fields >> baseline.buildType;
+        } else if (key == "lines") {
+            fields >> baseline.lines;
+        } else {
+            double cost = 0;
+            if (!(fields >> cost) || cost <= 0) return false;
+            baseline.costs.push_back({key, cost});
+        }
+    }
+    return true;
+}
+
+static bool writeBaseline(const std::string& path, const std::vector<BenchResult>& results,
+                          double calibrationNs, const std::string& lines) {
+    std::ofstream out(path);
+    out << "# trill-bench performance baseline: cost of each benchmark in calibration loops\n"
+        << "# (" << std::fixed << std::setprecision(1) << calibrationNs << " ns each where it was measured).\n"
+        << "# Regenerate with: trill-bench --check FILE --write-baseline FILE\n"
+        << "build_type " << TRILL_BUILD_TYPE << "\n"
+        << "lines " << lines << "\n";
+    out << std::setprecision(4);
+    for (const BenchResult& r : results) {
+        out << r.name << " " << r.minNs / calibrationNs << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+// Slowdown of a result against its baseline cost, in percent
+static double slowdownPct(const BenchResult& result, double expected, double calibrationNs) {
+    return (result.minNs / calibrationNs / expected - 1) * 100;
+}
+
+// Compare results to the baseline; false if any benchmark slowed down by
+// more than the tolerance or did not run
+static bool checkBaseline(const Baseline& baseline, const std::vector<BenchResult>& results,
+                          double calibrationNs, double tolerancePct) {
+    bool passed = true;
+    std::cerr << "Calibration loop: " << std::fixed << std::setprecision(1) << calibrationNs << " ns\n";
+    for (const auto& [name, expected] : baseline.costs) {
+        auto found = std::find_if(results.begin(), results.end(),
+                                  [&name](const BenchResult& r) { return r.name == name; });
+        if (found == results.end()) {
+            std::cerr << std::left << std::setw(32) << name << "  not run\n";
+            passed = false;
+            continue;
+        }
+        double cost = found->minNs / calibrationNs;
+        double changePct = slowdownPct(*found, expected, calibrationNs);
+        bool slower = changePct > tolerancePct;
+        passed = passed && !slower;
+        std::cerr << std::left << std::setw(32) << name << std::right << std::setprecision(3)
+                  << std::setw(12) << expected << " ->" << std::setw(12) << cost
+                  << std::showpos << std::setw(10) << std::setprecision(1) << changePct << "%" << std::noshowpos
+                  << (slower ? "  SLOWER" : changePct < -tolerancePct ? "  faster, consider updating the baseline" : "")
+                  << "\n";
+    }
+    std::cerr << (passed ? "Performance check passed" : "Performance check FAILED")
+              << " (tolerance " << std::setprecision(0) << tolerancePct << "%)" << std::endl;
+    return passed;
+}
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n\n"
+              << "Times the engine's hot functions and writes the results as JSON.\n\n"
+              << "Options:\n"
+              << "  -f, --filter TEXT       run only benchmarks whose name contains TEXT\n"
+              << "  -r, --repetitions N     timed repetitions per benchmark (default: 10)\n"
+              << "      --min-time MS       shortest repetition in milliseconds (default: 20)\n"
+              << "      --warmup MS         warmup per benchmark in milliseconds (default: 50)\n"
+              << "      --max-time S        stop repeating a benchmark after S seconds (default: 10)\n"
+              << "      --lines LIST        comma-separated input sizes for the end-to-end\n"
+              << "                          benchmarks, e.g. 1K,1M (default: 1K,1M,10M)\n"
+              << "  -o, --output FILE       write the JSON to FILE instead of stdout\n"
+              << "  -q, --quiet             do not print each result on stderr\n"
+              << "      --check FILE        run the benchmarks listed in baseline FILE and exit 1\n"
+              << "                          if one is slower than the tolerance allows (77 if\n"
+              << "                          FILE was measured with another build type)\n"
+              << "      --tolerance PCT     slowdown accepted by --check (default: 25)\n"
+              << "      --write-baseline FILE  write the results as a baseline\n"
+              << "  -h, --help              show this help\n";
+}
+
+static std::vector<size_t> parseLineCounts(const std::string& list) {
+    std::vector<size_t> counts;
+    std::stringstream items(list);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        size_t scale = 1;
+        if (!item.empty() && (item.back() == 'K' || item.back() == 'k')) scale = 1000;
+        if (!item.empty() && (item.back() == 'M' || item.back() == 'm')) scale = 1000000;
+        if (scale > 1) item.pop_back();
+        counts.push_back(static_cast<size_t>(std::stoull(item)) * scale);
+    }
+    return counts;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    std::string lineList = "1K,1M,10M";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else if ((arg == "-f" || arg == "--filter") && hasValue) {
+                options.filter = argv[++i];
+            } else if ((arg == "-r" || arg == "--repetitions") && hasValue) {
+                options.repetitions = std::max(1, std::stoi(argv[++i]));
+            } else if (arg == "--min-time" && hasValue) {
+                options.minTimeMs = std::stod(argv[++i]);
+            } else if (arg == "--warmup" && hasValue) {
+                options.warmupMs = std::stod(argv[++i]);
+            } else if (arg == "--max-time" && hasValue) {
+                options.maxTimeS = std::stod(argv[++i]);
+            } else if (arg == "--lines" && hasValue) {
+                lineList = argv[++i];
+                options.lineCounts = parseLineCounts(lineList);
+            } else if ((arg == "-o" || arg == "--output") && hasValue) {
+                options.jsonPath = argv[++i];
+            } else if (arg == "-q" || arg == "--quiet") {
+                options.quiet = true;
+            } else if (arg == "--check" && hasValue) {
+                options.baselinePath = argv[++i];
+            } else if (arg == "--tolerance" && hasValue) {
+                options.tolerancePct = std::stod(argv[++i]);
+            } else if (arg == "--write-baseline" && hasValue) {
+                options.writeBaselinePath = argv[++i];
+            } else {
+                std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+                return 2;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    Baseline baseline;
+    if (!options.baselinePath.empty()) {
+        if (!readBaseline(options.baselinePath, baseline)) {
+            std::cerr << "Error reading baseline: " << options.baselinePath << std::endl;
+            return 2;
+        }
+        if (baseline.buildType != TRILL_BUILD_TYPE) {
+            std::cerr << "Skipped: the baseline was measured with a '" << baseline.buildType
+                      << "' build, this is a '" << TRILL_BUILD_TYPE << "' build" << std::endl;
+            return 77;
+        }
+        for (const auto& entry : baseline.costs) {
+            options.names.push_back(entry.first);
+        }
+        if (!baseline.lines.empty()) {
+            lineList = baseline.lines;
+            options.lineCounts = parseLineCounts(lineList);
+        }
+    }
+
+    std::vector<Benchmark> benchmarks;
+
+    // applyTrill for every variant and meter over a fixed set of notes
+    std::vector<std::pair<int, int>> notes;
+    for (int pitch = 48; pitch < 84; pitch += 5) {
+        for (int duration : {60, 120, 240, 480, 960, 1440}) {
+            notes.push_back({pitch, duration});
+        }
+    }
+    TrillSegments segments;
+    for (const TrillVariant& variant : allTrillVariants()) {
+        for (TimeMeter meter : {DUPLE, TRIPLE}) {
+            std::string name = "applyTrill/" + variant.code + (meter == DUPLE ? "/duple" : "/triple");
+            const std::string* code = &variant.code;
+            benchmarks.push_back({name, notes.size(), [&notes, &segments, code, meter] {
+                size_t total = 0;
+                for (const auto& [pitch, duration] : notes) {
+                    applyTrill(pitch, duration, meter, *code, segments);
+                    total += segments.size();
+                }
+                g_sink = total;
+            }});
+        }
+    }
+
+    // Note name conversions in both directions over the whole MIDI range,
+    // parsing the names getNoteNumber accepts (octave 0 upwards)
+    std::vector<std::string> noteNames;
+    for (int note = 0; note < 128; ++note) {
+        try {
+            getNoteNumber(getNoteName(note));
+            noteNames.push_back(getNoteName(note));
+        } catch (const std::exception&) {
+        }
+    }
+    benchmarks.push_back({"getNoteNumber", noteNames.size(), [&noteNames] {
+        size_t total = 0;
+        for (const std::string& name : noteNames) {
+            total += getNoteNumber(name);
+        }
+        g_sink = total;
+    }});
+    benchmarks.push_back({"getNoteName", 128, [] {
+        size_t total = 0;
+        for (int note = 0; note < 128; ++note) {
+            total += getNoteName(note).size();
+        }
+        g_sink = total;
+    }});
+
+    // Label eligibility: every eligible label and a few that are not
+    std::vector<std::string> labels(eligibleLabels().begin(), eligibleLabels().end());
+    for (const char* other : {"PED", "X", "Note", "RLNX", "", "ORIGINAL"}) {
+        labels.push_back(other);
+    }
+    benchmarks.push_back({"isEligibleLabel", labels.size(), [&labels] {
+        size_t total = 0;
+        for (const std::string& label : labels) {
+            total += isEligibleLabel(label);
+        }
+        g_sink = total;
+    }});
+
+    // processFile and convertToMidi end to end on generated inputs
+    std::filesystem::path directory = std::filesystem::temp_directory_path() /
+        ("trill-bench-" + std::to_string(static_cast<long long>(nowNs())));
+    std::filesystem::create_directories(directory);
+    for (size_t lines : options.lineCounts) {
+        std::string suffix = lineCountName(lines);
+        std::string input = (directory / ("input_" + suffix + ".txt")).string();
+        std::string table = (directory / ("table_" + suffix + ".txt")).string();
+        std::string midi = (directory / ("table_" + suffix + ".mid")).string();
+        bool wantProcess = selected("processFile/" + suffix, options);
+        bool wantMidi = selected("convertToMidi/" + suffix, options);
+        if (!wantProcess && !wantMidi) continue;
+
+        writeInputTable(input, lines);
+        AppState prepared;
+        processFile(input, table, prepared);
+
+        benchmarks.push_back({"processFile/" + suffix, lines, [input, table] {
+            AppState state;
+            processFile(input, table, state);
+            g_sink = static_cast<size_t>(state.transformedNotes);
+        }});
+        benchmarks.push_back({"convertToMidi/" + suffix, lines, [table, midi] {
+            AppState state;
+            convertToMidi(table, midi, state);
+            g_sink = state.statusMessage.size();
+        }});
+    }
+
+    // The calibration loop runs before and after the benchmarks, and the
+    // faster of the two counts: it is the one least disturbed by other load
+    bool calibrate = !options.baselinePath.empty() || !options.writeBaselinePath.empty();
+    Benchmark calibration{"calibration", 1, calibrationLoop};
+    double calibrationNs = calibrate ? runBenchmark(calibration, options).minNs : 0;
+
+    std::vector<BenchResult> results;
+    for (const Benchmark& bench : benchmarks) {
+        if (!selected(bench.name, options)) continue;
+        results.push_back(runBenchmark(bench, options));
+        const BenchResult& r = results.back();
+        if (!options.quiet) {
+            std::cerr << std::left << std::setw(32) << r.name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(14) << r.medianNs << " ns/op  +-" << std::setw(10) << r.madNs
+                      << std::setw(14) << std::setprecision(0) << r.items * 1e9 / r.medianNs << " items/s\n";
+        }
+    }
+
+    if (calibrate) {
+        calibrationNs = std::min(calibrationNs, runBenchmark(calibration, options).minNs);
+    }
+
+    // A benchmark that looks too slow runs once more before it counts as a
+    // regression, so one busy moment on the machine does not fail the check
+    for (BenchResult& result : results) {
+        auto entry = std::find_if(baseline.costs.begin(), baseline.costs.end(),
+                                  [&result](const auto& cost) { return cost.first == result.name; });
+        if (entry == baseline.costs.end() ||
+            slowdownPct(result, entry->second, calibrationNs) <= options.tolerancePct) {
+            continue;
+        }
+        for (const Benchmark& bench : benchmarks) {
+            if (bench.name == result.name) {
+                result.minNs = std::min(result.minNs, runBenchmark(bench, options).minNs);
+            }
+        }
+    }
+
+    std::error_code ignored;
+    std::filesystem::remove_all(directory, ignored);
+    if (!options.writeBaselinePath.empty() &&
+        !writeBaseline(options.writeBaselinePath, results, calibrationNs, lineList)) {
+        std::cerr << "Error writing " << options.writeBaselinePath << std::endl;
+        return 1;
+    }
+
+    if (options.jsonPath.empty()) {
+        if (options.baselinePath.empty()) writeJson(std::cout, results, options);
+    } else {
+        std::ofstream out(options.jsonPath);
+        writeJson(out, results, options);
+        if (!out) {
+            std::cerr << "Error writing " << options.jsonPath << std::endl;
+            return 1;
+        }
+    }
+    if (!options.baselinePath.empty()) {
+        return checkBaseline(baseline, results, calibrationNs, options.tolerancePct) ? 0 : 1;
+    }
+    return 0;
+}
@@ -0,0 +1,1385 @@
+// Trill Transformation Tool - Headless Command-Line Entry Point
+// Builds as trill-cli, which links only the trillcore engine (no X11 or
+// Win32 GUI), so it starts fast and runs in minimal containers.
+
+#include "TrillTransformation.h"
+#include "TrillSimulation.h"
+#include "TrillTrace.h"
+#include "WorkPool.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+// Ctrl-C cancels every job in progress
+static CancellationToken g_interrupt;
+
+static void onInterrupt(int) {
+    g_interrupt.cancel();
+}
+
+// Output formats selected with --format
+enum OutputFormat {
+    FORMAT_TEXT = 1,
+    FORMAT_BINARY = 2,
+    FORMAT_MIDI = 4
+};
+
+// Command-line settings
+struct CliOptions {
+    std::vector<std::string> inputs;
+    std::string manifest;      // File of "input [output]" lines
+    std::string output;        // Output path for a single input
+    std::string outputDir;     // Output directory for batches
+    std::string report;        // Batch report file; stdout if empty
+    std::string statsJson;     // File for per-file timings and counts as JSON
+    std::string trace;         // Chrome trace-event file of the run
+    std::string metrics;       // Prometheus textfile of the run's counters
+    std::string sweep;         // File of configurations to sweep each input with
+    size_t monteCarloSeeds = 0;   // Seeds to simulate per input; 0 = transform normally
+    bool dryRun = false;
+    int formats = FORMAT_TEXT;
+    double percentage = 50.0;
+    std::vector<std::string> variants;
+    TimeMeter meter = DUPLE;
+    uint64_t seed = 1;
+    unsigned threads = 1;
+    size_t splitBytes = 8 << 20;  // Inputs larger than this are split into chunks
+    bool progress = false;
+    bool quiet = false;
+};
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] <input>...\n"
+              << "\n"
+              << "Inputs may be files, directories (every file in them) or wildcard patterns\n"
+              << "such as 'scores/*.txt'. Directories and patterns skip earlier *_trill outputs.\n"
+              << "\n"
+              << "Options:\n"
+              << "  -o, --output PATH       output path for a single input; the extension is\n"
+              << "                          replaced per format\n"
+              << "  -d, --output-dir DIR    directory for outputs (default: next to each input)\n"
+              << "  -M, --manifest FILE     read inputs from FILE, one 'input [output]' per line,\n"
+              << "                          tab-separated if paths contain spaces\n"
+              << "  -f, --format LIST       comma-separated formats: text, binary, midi (default: text)\n"
+              << "  -p, --percentage N      percentage of eligible notes to transform (default: 50)\n"
+              << "  -v, --variant CODE      trill variant to use; repeat for several (default: RANDOM)\n"
+              << "  -m, --meter METER       duple or triple (default: duple)\n"
+              << "  -s, --seed N            random seed; each input is processed with it (default: 1)\n"
+              << "  -j, --threads N         worker threads (default: 1, 0 = all cores)\n"
+              << "      --split-size MB     split larger inputs into chunks processed in parallel\n"
+              << "                          (default: 8, 0 = never split)\n"
+              << "      --report FILE       write the batch report to FILE instead of stdout\n"
+              << "      --stats-json FILE   write each file's stage timings, throughput and\n"
+              << "                          allocation counts to FILE as JSON (batch runs only)\n"
+              << "      --trace FILE        write a Chrome trace-event file of the run's stages,\n"
+              << "                          chunks and threads (chrome://tracing, Perfetto)\n"
+              << "      --metrics FILE      after the run, replace FILE with its counters and gauges\n"
+              << "                          in Prometheus text format (batch runs only)\n"
+              << "      --sweep FILE        transform each input under every configuration in FILE,\n"
+              << "                          one '<percentage> [duple|triple] [CODE...]' per line;\n"
+              << "                          the input is parsed once for all of them\n"
+              << "  -n, --dry-run           write nothing; report the exact output sizes, per-track\n"
+              << "                          MIDI events and projected peak memory of the run\n"
+              << "      --monte-carlo K     write nothing; simulate seeds S..S+K-1 (S from --seed)\n"
+              << "                          and report the distribution of each statistic\n"
+              << "  -l, --list-variants     list the available trill variants and exit\n"
+              << "      --progress          report progress on stderr\n"
+              << "  -q, --quiet             print errors only\n"
+              << "  -h, --help              show this help and exit\n"
+              << "\n"
+              << "Outputs are named <stem>_trill.txt, <stem>_trill.trlb and <stem>_trill.mid.\n"
+              << "A split input is reproducible for a given seed and split size; its first chunk\n"
+              << "uses the seed itself, so inputs below the split size match unsplit runs.\n"
+              << "A sweep numbers its outputs (<stem>_01_trill.txt, ...), uses the same seed for\n"
+              << "every configuration and reports their statistics side by side.\n"
+              << "Example: " << program << " -f text,midi -p 60 -s 42 -j 4 scores/*.txt\n";
+}
+
+// Parse a number option; false (with a message) if value is not a valid number
+template <typename T>
+static bool parseNumber(const std::string& option, const std::string& value, T& result) {
+    std::istringstream stream(value);
+    stream >> result;
+    if (!stream || !stream.eof()) {
+        std::cerr << "Invalid value for " << option << ": " << value << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool parseFormats(const std::string& value, int& formats) {
+    formats = 0;
+    std::istringstream stream(value);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        if (name == "text") {
+            formats |= FORMAT_TEXT;
+        } else if (name == "binary") {
+            formats |= FORMAT_BINARY;
+        } else if (name == "midi") {
+            formats |= FORMAT_MIDI;
+        } else {
+            std::cerr << "Unknown format: " << name << std::endl;
+            return false;
+        }
+    }
+    if (formats == 0) {
+        std::cerr << "No output format selected" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Options followed by a value
+static bool takesValue(const std::string& arg) {
+    static const char* const names[] = {
+        "-o", "--output", "-d", "--output-dir", "-M", "--manifest", "-f", "--format",
+        "-p", "--percentage", "-v", "--variant", "-m", "--meter", "-s", "--seed",
+        "-j", "--threads", "--split-size", "--report", "--sweep",
+        "--monte-carlo", "--stats-json", "--trace", "--metrics"
+    };
+    for (const char* name : names) {
+        if (arg == name) return true;
+    }
+    return false;
+}
+
+// Check a list of variant codes; false (with a message) if one is unknown
+static bool checkVariants(const std::vector<std::string>& variants) {
+    for (const std::string& code : variants) {
+        if (code == "RANDOM" && variants.size() > 1) {
+            std::cerr << "RANDOM cannot be combined with other variants" << std::endl;
+            return false;
+        }
+        bool known = code == "RANDOM";
+        for (const TrillVariant& variant : allTrillVariants()) {
+            known = known || variant.code == code;
+        }
+        if (!known) {
+            std::cerr << "Unknown trill variant: " << code << " (see --list-variants)" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Parse argv into options. Returns -1 to continue, otherwise the exit code.
+static int parseArguments(int argc, char* argv[], CliOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() < 2 || arg[0] != '-') {
+            options.inputs.push_back(arg);
+            continue;
+        }
+        if (arg == "--") {
+            for (++i; i < argc; ++i) {
+                options.inputs.push_back(argv[i]);
+            }
+            break;
+        }
+
+        // Accept both "--name value" and "--name=value"
+        std::string value;
+        bool hasInlineValue = false;
+        size_t equals = arg.find('=');
+        if (arg.compare(0, 2, "--") == 0 && equals != std::string::npos) {
+            value = arg.substr(equals + 1);
+            arg = arg.substr(0, equals);
+            hasInlineValue = true;
+        }
+        auto takeValue = [&]() {
+            if (hasInlineValue) {
+                return true;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            value = argv[++i];
+            return true;
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-l" || arg == "--list-variants") {
+            for (const TrillVariant& variant : allTrillVariants()) {
+                std::cout << variant.code << "\t" << variant.description << "\n";
+            }
+            return 0;
+        } else if (arg == "--progress") {
+            options.progress = true;
+        } else if (arg == "-n" || arg == "--dry-run") {
+            options.dryRun = true;
+        } else if (arg == "-q" || arg == "--quiet") {
+            options.quiet = true;
+        } else if (!takesValue(arg)) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 2;
+        } else if (!takeValue()) {
+            return 2;
+        } else if (arg == "-o" || arg == "--output") {
+            options.output = value;
+        } else if (arg == "-d" || arg == "--output-dir") {
+            options.outputDir = value;
+        } else if (arg == "-M" || arg == "--manifest") {
+            options.manifest = value;
+        } else if (arg == "--report") {
+            options.report = value;
+        } else if (arg == "--stats-json") {
+            options.statsJson = value;
+        } else if (arg == "--trace") {
+            options.trace = value;
+        } else if (arg == "--metrics") {
+            options.metrics = value;
+        } else if (arg == "--sweep") {
+            options.sweep = value;
+        } else if (arg == "--monte-carlo") {
+            if (!parseNumber(arg, value, options.monteCarloSeeds)) return 2;
+            if (options.monteCarloSeeds == 0) {
+                std::cerr << "--monte-carlo needs at least one seed" << std::endl;
+                return 2;
+            }
+        } else if (arg == "-f" || arg == "--format") {
+            if (!parseFormats(value, options.formats)) return 2;
+        } else if (arg == "-p" || arg == "--percentage") {
+            if (!parseNumber(arg, value, options.percentage)) return 2;
+            if (options.percentage < 0.0 || options.percentage > 100.0) {
+                std::cerr << "Percentage must be between 0 and 100" << std::endl;
+                return 2;
+            }
+        } else if (arg == "-v" || arg == "--variant") {
+            options.variants.push_back(value);
+        } else if (arg == "-m" || arg == "--meter") {
+            if (value == "duple") {
+                options.meter = DUPLE;
+            } else if (value == "triple") {
+                options.meter = TRIPLE;
+            } else {
+                std::cerr << "Meter must be duple or triple" << std::endl;
+                return 2;
+            }
+        } else if (arg == "-s" || arg == "--seed") {
+            if (!parseNumber(arg, value, options.seed)) return 2;
+        } else if (arg == "-j" || arg == "--threads") {
+            if (!parseNumber(arg, value, options.threads)) return 2;
+        } else if (arg == "--split-size") {
+            size_t megabytes;
+            if (!parseNumber(arg, value, megabytes)) return 2;
+            options.splitBytes = megabytes << 20;
+        }
+    }
+
+    if (options.inputs.empty() && options.manifest.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (!checkVariants(options.variants)) {
+        return 2;
+    }
+    // The sweep, Monte Carlo and dry-run modes exclude one another
+    std::vector<const char*> modes;
+    if (!options.sweep.empty()) modes.push_back("--sweep");
+    if (options.monteCarloSeeds > 0) modes.push_back("--monte-carlo");
+    if (options.dryRun) modes.push_back("--dry-run");
+    if (modes.size() > 1) {
+        std::cerr << modes[0] << " cannot be used with " << modes[1] << std::endl;
+        return 2;
+    }
+    // Only a normal batch run produces per-file statistics and metrics
+    const char* mode = !options.sweep.empty() ? "--sweep" : options.monteCarloSeeds > 0 ? "--monte-carlo"
+                     : options.dryRun ? "--dry-run" : nullptr;
+    if (mode != nullptr && (!options.statsJson.empty() || !options.metrics.empty())) {
+        std::cerr << (options.metrics.empty() ? "--stats-json" : "--metrics") << " cannot be used with " << mode
+                  << std::endl;
+        return 2;
+    }
+    if (options.threads == 0) {
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return -1;
+}
+
+// Output path without extension for input
+static std::filesystem::path outputBase(const CliOptions& options, const std::string& input) {
+    if (!options.output.empty()) {
+        return std::filesystem::path(options.output).replace_extension();
+    }
+    std::filesystem::path inputPath(input);
+    std::filesystem::path dir = options.outputDir.empty() ? inputPath.parent_path()
+                                                         : std::filesystem::path(options.outputDir);
+    return dir / (inputPath.stem().string() + "_trill");
+}
+
+// One input file and its outputs, results and timing
+struct CliJob {
+    std::string input;
+    std::filesystem::path outputBase;
+    std::string summary;
+    bool ok = false;
+    size_t bytes = 0;
+    size_t chunks = 0;
+    long long lines = 0;
+    uint64_t eligibleNotes = 0;
+    uint64_t transformedNotes = 0;
+    double seconds = 0.0;
+    std::string stats;  // runStatsJson of the merged run
+    RunMetrics metrics;
+};
+
+// Match name against a pattern of literal characters, '*' and '?'
+static bool matchesPattern(const char* pattern, const char* name) {
+    if (*pattern == '\0') return *name == '\0';
+    if (*pattern == '*') {
+        return matchesPattern(pattern + 1, name) || (*name != '\0' && matchesPattern(pattern, name + 1));
+    }
+    return *name != '\0' && (*pattern == '?' || *pattern == *name) && matchesPattern(pattern + 1, name + 1);
+}
+
+// Files in dir whose name matches pattern, sorted, skipping our own outputs
+static void addDirectoryFiles(const std::filesystem::path& dir, const std::string& pattern,
+                              std::vector<std::string>& files) {
+    std::vector<std::string> found;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+        std::string name = entry.path().filename().string();
+        std::string stem = entry.path().stem().string();
+        bool isOutput = stem.size() >= 6 && stem.compare(stem.size() - 6, 6, "_trill") == 0;
+        if (entry.is_regular_file() && !isOutput && matchesPattern(pattern.c_str(), name.c_str())) {
+            found.push_back(entry.path().string());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+// Expand inputs, directories, patterns and the manifest into jobs
+static bool collectJobs(const CliOptions& options, std::vector<CliJob>& jobs) {
+    std::vector<std::string> files;
+    for (const std::string& input : options.inputs) {
+        std::filesystem::path path(input);
+        std::string name = path.filename().string();
+        if (std::filesystem::is_directory(path)) {
+            addDirectoryFiles(path, "*", files);
+        } else if (name.find_first_of("*?") != std::string::npos) {
+            std::filesystem::path dir = path.parent_path().empty() ? std::filesystem::path(".") : path.parent_path();
+            size_t before = files.size();
+            addDirectoryFiles(dir, name, files);
+            if (files.size() == before) {
+                std::cerr << "No files match " << input << std::endl;
+            }
+        } else {
+            files.push_back(input);
+        }
+    }
+    for (const std::string& file : files) {
+        CliJob job;
+        job.input = file;
+        job.outputBase = outputBase(options, file);
+        jobs.push_back(job);
+    }
+
+    if (!options.manifest.empty()) {
+        std::ifstream manifest(options.manifest);
+        if (!manifest.is_open()) {
+            std::cerr << "Error opening manifest: " << options.manifest << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(manifest, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+
+            // Tab-separated if there is a tab, otherwise whitespace-separated
+            std::string input, output;
+            size_t tab = line.find('\t');
+            if (tab != std::string::npos) {
+                input = line.substr(0, tab);
+                output = line.substr(tab + 1);
+            } else {
+                std::istringstream fields(line);
+                fields >> input >> output;
+            }
+            if (input.empty()) continue;
+
+            CliJob job;
+            job.input = input;
+            job.outputBase = output.empty() ? outputBase(options, input)
+                                            : std::filesystem::path(output).replace_extension();
+            jobs.push_back(job);
+        }
+    }
+
+    if (jobs.empty()) {
+        std::cerr << "No input files" << std::endl;
+        return false;
+    }
+    if (!options.output.empty() && jobs.size() > 1) {
+        std::cerr << "--output needs a single input; use --output-dir or a manifest for batches" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << input.rdbuf();
+    contents = buffer.str();
+    return !input.bad();
+}
+
+// Seed of chunk index of a split input: the seed itself for the first chunk,
+// a splitmix64 mix of seed and index for the others
+static uint64_t chunkSeed(uint64_t seed, size_t index) {
+    if (index == 0) return seed;
+    uint64_t z = seed + index * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Split input at line boundaries into chunks of about splitBytes (0 = never)
+static std::vector<std::string_view> splitInput(std::string_view input, size_t splitBytes) {
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    while (start < input.size()) {
+        size_t end = input.size();
+        if (splitBytes > 0 && input.size() - start > splitBytes) {
+            size_t newline = input.find('\n', start + splitBytes);
+            end = newline == std::string::npos ? input.size() : newline + 1;
+        }
+        chunks.push_back(input.substr(start, end - start));
+        start = end;
+    }
+    if (chunks.empty()) {
+        chunks.push_back(std::string_view());
+    }
+    return chunks;
+}
+
+// Counters shared by all jobs for the progress line
+struct BatchProgress {
+    std::atomic<long long> lines{0};
+    std::atomic<long long> notes{0};
+    std::atomic<size_t> finishedJobs{0};
+
+    // Statistics of finished jobs, one cache-line-aligned copy per worker so
+    // workers never share a line; merged once the batch is done
+    std::vector<RunStatistics> workerStatistics;
+};
+
+// One input being processed, possibly as several chunks on different workers
+class BatchJob {
+public:
+    BatchJob(const CliOptions& options, CliJob& job, BatchProgress& batch)
+        : options(options), job(job), batch(batch) {}
+
+    // Read the input and queue its chunks; runs on a worker
+    void start(WorkPool& pool) {
+        this->pool = &pool;
+        started = std::chrono::steady_clock::now();
+        if (g_interrupt.isCancelled()) {
+            finishJob();
+            return;
+        }
+        uint64_t reading = steadyNanoseconds();
+        bool read;
+        {
+            TraceSpan span("read");
+            read = readFile(job.input, input);
+        }
+        if (!read) {
+            job.summary = "Error opening input file: " + job.input + "\n";
+            finishJob();
+            return;
+        }
+        readNanoseconds = steadyNanoseconds() - reading;
+        job.bytes = input.size();
+
+        for (std::string_view piece : splitInput(input, options.splitBytes)) {
+            chunks.emplace_back(new Chunk(piece));
+        }
+        job.chunks = chunks.size();
+        remaining = chunks.size();
+
+        // Queue all but the first chunk for idle workers to steal; do the first here
+        for (size_t i = 1; i < chunks.size(); ++i) {
+            pool.submit([this, i] { runChunk(i); });
+        }
+        runChunk(0);
+    }
+
+private:
+    struct Chunk {
+        explicit Chunk(std::string_view input) : input(input) {}
+        std::string_view input;
+        AppState state;
+        std::string text;
+        std::string binary;
+        std::string midi;
+    };
+
+    void runChunk(size_t index) {
+        TraceSpan span("chunk", static_cast<int64_t>(index));
+        Chunk& chunk = *chunks[index];
+        AppState& state = chunk.state;
+        state.transformationPercentage = options.percentage;
+        state.selectedVariants = options.variants;
+        state.meter = options.meter;
+        state.seed = chunkSeed(options.seed, index);
+
+        // Feed the batch progress line with the counters' increments
+        ProgressSink progress;
+        long long lastLines = 0;
+        long long lastNotes = 0;
+        if (options.progress) {
+            progress.intervalMs = 0;
+            progress.onProgress = [&](const ProgressSink& p) {
+                long long lines = p.lines.load(std::memory_order_relaxed);
+                long long notes = p.notes.load(std::memory_order_relaxed);
+                batch.lines += lines - lastLines;
+                batch.notes += notes - lastNotes;
+                lastLines = lines;
+                lastNotes = notes;
+            };
+        }
+
+        // A split input builds one MIDI file from the binary records of every chunk
+        bool split = chunks.size() > 1;
+        TransformBuffers buffers;
+        buffers.text = (options.formats & FORMAT_TEXT) ? &chunk.text : nullptr;
+        buffers.binary = (options.formats & FORMAT_BINARY) || (split && (options.formats & FORMAT_MIDI)) ? &chunk.binary : nullptr;
+        buffers.midi = !split && (options.formats & FORMAT_MIDI) ? &chunk.midi : nullptr;
+        buffers.midiDiagnostics = split && (options.formats & FORMAT_MIDI);
+        transformBuffer(chunk.input, buffers, state, options.progress ? &progress : nullptr, &g_interrupt);
+
+        if (--remaining == 0) {
+            finish();
+        }
+    }
+
+    // Merge the chunks and write the outputs; runs on the last chunk's worker.
+    // Outputs are written piece by piece rather than copied together.
+    void finish() {
+        TraceSpan span("finish");
+        AppState merged = chunks[0]->state;
+        std::vector<std::string_view> text;
+        std::vector<std::string_view> binary;
+        std::vector<std::string_view> records;
+        std::string binaryHeader;
+        uint32_t recordCount = 0;
+        long long lines = 0;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            const Chunk& chunk = *chunks[i];
+            merged.cancelled = merged.cancelled || chunk.state.cancelled;
+            if (i > 0) {
+                merged.diagnostics.merge(chunk.state.diagnostics, static_cast<size_t>(lines));
+            }
+            lines += std::count(chunk.input.begin(), chunk.input.end(), '\n');
+            if (chunk.binary.size() >= 12) {
+                recordCount += readU32(chunk.binary, 8);
+                binary.push_back(std::string_view(chunk.binary).substr(12));
+                records.push_back(chunk.binary);
+            }
+            if (i == 0) {
+                text.push_back(chunk.text);
+                continue;
+            }
+
+            merged.statistics.merge(chunk.state.statistics);
+            merged.timings.merge(chunk.state.timings);
+            merged.memory.merge(chunk.state.memory);
+            merged.arenaRequests += chunk.state.arenaRequests;
+            merged.arenaBlocks += chunk.state.arenaBlocks;
+            merged.arenaBytes += chunk.state.arenaBytes;
+
+            // Later chunks repeat the two header lines
+            size_t headerEnd = chunk.text.find('\n', chunk.text.find('\n') + 1);
+            if (headerEnd != std::string::npos) {
+                text.push_back(std::string_view(chunk.text).substr(headerEnd + 1));
+            }
+        }
+        publishStatistics(merged);
+        merged.memory.allocate(MemoryUsage::INPUT, input.size());  // The whole input, held by the job
+        job.lines = lines;
+        job.eligibleNotes = merged.totalEligibleNotes;
+        job.transformedNotes = merged.transformedNotes;
+
+        if (merged.cancelled) {
+            cancelled(merged);
+            return;
+        }
+
+        // One binary header with the total record count
+        if (!binary.empty()) {
+            binaryHeader = chunks[0]->binary.substr(0, 8);
+            for (int i = 0; i < 4; ++i) {
+                binaryHeader.push_back(static_cast<char>((recordCount >> (8 * i)) & 0xFF));
+            }
+            binary.insert(binary.begin(), binaryHeader);
+        }
+        std::string midi = std::move(chunks[0]->midi);
+        if (chunks.size() > 1 && (options.formats & FORMAT_MIDI)) {
+            encodeMidiRecords(records, midi, merged, nullptr, &g_interrupt);
+            if (merged.cancelled) {
+                cancelled(merged);
+                return;
+            }
+        }
+
+        int worker = pool->currentWorker();
+        batch.workerStatistics[worker >= 0 ? worker : 0].merge(merged.statistics);
+
+        std::string destination = job.outputBase.string();
+        job.ok = true;
+        std::string written;
+        uint64_t bytesWritten = 0;
+        std::error_code ignored;
+        if (job.outputBase.has_parent_path()) {
+            std::filesystem::create_directories(job.outputBase.parent_path(), ignored);
+        }
+        auto write = [&](int format, const std::vector<std::string_view>& data, const char* extension) {
+            if (!(options.formats & format)) return;
+            std::string path = destination + extension;
+            uint64_t writing = steadyNanoseconds();
+            TraceSpan writeSpan("write");
+            bool ok = writeOutputFile(path, data);
+            merged.timings.nanoseconds[StageTimings::WRITE] += steadyNanoseconds() - writing;
+            if (ok) {
+                written += "Wrote " + path + "\n";
+                for (std::string_view part : data) {
+                    bytesWritten += part.size();
+                }
+            } else {
+                written += "Error writing output file: " + path + "\n";
+                job.ok = false;
+            }
+        };
+        write(FORMAT_TEXT, text, ".txt");
+        write(FORMAT_BINARY, binary, ".trlb");
+        write(FORMAT_MIDI, {midi}, ".mid");
+
+        // Stage times are summed over the chunks; the wall time is the job's
+        merged.timings.nanoseconds[StageTimings::READ] += readNanoseconds;
+        merged.timings.wallNanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count());
+        job.summary = job.input + ":\n" + transformationSummary(merged, destination + ".*") + written;
+        job.stats = runStatsJson(merged);
+        job.metrics.add(merged, bytesWritten, job.ok);
+        finishJob();
+    }
+
+    static uint32_t readU32(const std::string& data, size_t pos) {
+        uint32_t value = 0;
+        for (int i = 3; i >= 0; --i) {
+            value = (value << 8) | static_cast<unsigned char>(data[pos + i]);
+        }
+        return value;
+    }
+
+    // End a job interrupted before its outputs were written
+    void cancelled(const AppState& merged) {
+        job.summary = job.input + ": Processing cancelled.\n";
+        job.metrics.add(merged, 0, false);
+        finishJob();
+    }
+
+    // Record the timing and release the input and chunk buffers
+    void finishJob() {
+        job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        chunks.clear();
+        std::string().swap(input);
+        batch.finishedJobs++;
+    }
+
+    const CliOptions& options;
+    CliJob& job;
+    BatchProgress& batch;
+    WorkPool* pool = nullptr;
+    std::chrono::steady_clock::time_point started;
+    uint64_t readNanoseconds = 0;
+    std::string input;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::atomic<size_t> remaining{0};
+};
+
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted.push_back('\\');
+        quoted.push_back(c);
+    }
+    return quoted + "\"";
+}
+
+// The batch and every file's runStatsJson, for --stats-json
+static std::string statsJson(const std::vector<CliJob>& jobs, double seconds, unsigned threads) {
+    std::stringstream json;
+    json << std::fixed << std::setprecision(6)
+         << "{\"seconds\": " << seconds << ", \"threads\": " << threads << ", \"files\": [\n";
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const CliJob& job = jobs[i];
+        json << "  {\"input\": " << jsonString(job.input) << ", \"ok\": " << (job.ok ? "true" : "false")
+             << ", \"chunks\": " << job.chunks << ", \"stats\": " << (job.stats.empty() ? "null" : job.stats) << "}"
+             << (i + 1 < jobs.size() ? ",\n" : "\n");
+    }
+    json << "]}\n";
+    return json.str();
+}
+
+// Throughput of the batch, timing of every file and the combined breakdown
+static void writeReport(std::ostream& out, const std::vector<CliJob>& jobs, double seconds, unsigned threads,
+                        const RunStatistics& statistics) {
+    size_t failed = 0;
+    size_t bytes = 0;
+    long long lines = 0;
+    for (const CliJob& job : jobs) {
+        failed += job.ok ? 0 : 1;
+        bytes += job.bytes;
+        lines += job.lines;
+    }
+    double megabytes = bytes / (1024.0 * 1024.0);
+
+    out << std::fixed << std::setprecision(1)
+        << "Batch summary: " << jobs.size() << " files (" << jobs.size() - failed << " ok, "
+        << failed << " failed), " << megabytes << " MB, " << lines << " lines in "
+        << std::setprecision(3) << seconds << " s on " << threads << " threads\n"
+        << std::setprecision(1) << "Throughput: " << (seconds > 0 ? jobs.size() / seconds : 0.0) << " files/s, "
+        << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/s, "
+        << std::setprecision(0) << (seconds > 0 ? lines / seconds : 0.0) << " lines/s\n\n";
+
+    out << std::left << std::setw(8) << "Status" << std::right << std::setw(12) << "Bytes"
+        << std::setw(8) << "Chunks" << std::setw(10) << "Eligible" << std::setw(12) << "Transformed"
+        << std::setw(12) << "Time (ms)" << std::setw(10) << "MB/s" << "  File\n";
+    for (const CliJob& job : jobs) {
+        double jobMegabytes = job.bytes / (1024.0 * 1024.0);
+        out << std::left << std::setw(8) << (job.ok ? "ok" : "FAILED") << std::right
+            << std::setw(12) << job.bytes << std::setw(8) << job.chunks
+            << std::setw(10) << job.eligibleNotes << std::setw(12) << job.transformedNotes
+            << std::setw(12) << std::setprecision(1) << job.seconds * 1000.0
+            << std::setw(10) << (job.seconds > 0 ? jobMegabytes / job.seconds : 0.0)
+            << "  " << job.input << "\n";
+    }
+    out << "\n" << statisticsBreakdown(statistics);
+}
+
+// One configuration of a sweep and its results
+struct SweepEntry {
+    double percentage = 50.0;
+    TimeMeter meter = DUPLE;
+    std::vector<std::string> variants;
+    std::filesystem::path outputBase;
+    AppState state;
+    bool ok = false;
+    std::string errors;
+};
+
+// Read the sweep file: one "<percentage> [duple|triple] [CODE...]" per line
+static bool readSweepFile(const std::string& path, std::vector<SweepEntry>& entries) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error opening sweep file: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::istringstream fields(line);
+        std::string field;
+        if (!(fields >> field) || field[0] == '#') continue;
+
+        SweepEntry entry;
+        std::string where = path + ":" + std::to_string(lineNumber);
+        if (!parseNumber(where, field, entry.percentage)) return false;
+        if (entry.percentage < 0.0 || entry.percentage > 100.0) {
+            std::cerr << where << ": percentage must be between 0 and 100" << std::endl;
+            return false;
+        }
+        while (fields >> field) {
+            if (field == "duple" || field == "triple") {
+                entry.meter = field == "duple" ? DUPLE : TRIPLE;
+            } else {
+                entry.variants.push_back(field);
+            }
+        }
+        if (!checkVariants(entry.variants)) return false;
+        entries.push_back(entry);
+    }
+    if (entries.empty()) {
+        std::cerr << "No configurations in sweep file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Output base of configuration index (from 1) of a sweep: the number goes
+// before the _trill suffix, so directory inputs still skip the outputs
+static std::filesystem::path sweepOutputBase(const std::filesystem::path& base, size_t index, size_t count) {
+    std::string number = std::to_string(index);
+    size_t width = std::max<size_t>(2, std::to_string(count).size());
+    number.insert(0, width - number.size(), '0');
+    std::string name = base.filename().string();
+    if (name.size() >= 6 && name.compare(name.size() - 6, 6, "_trill") == 0) {
+        name.insert(name.size() - 6, "_" + number);
+    } else {
+        name += "_" + number;
+    }
+    return base.parent_path() / name;
+}
+
+// Statistics of every configuration of one input, side by side
+static void writeSweepReport(std::ostream& out, const CliJob& job, const std::vector<SweepEntry>& entries,
+                             double parseSeconds, double seconds, unsigned threads) {
+    out << std::fixed << std::setprecision(1)
+        << "Sweep of " << job.input << ": " << entries.size() << " configurations, " << job.lines
+        << " lines parsed once in " << parseSeconds * 1000.0 << " ms, transformed in "
+        << std::setprecision(3) << seconds << " s on " << threads << " threads\n\n";
+
+    out << std::right << std::setw(6) << "Config" << std::setw(12) << "Percentage" << std::setw(8) << "Meter"
+        << std::setw(10) << "Eligible" << std::setw(12) << "Transformed" << std::setw(10) << "Actual %"
+        << std::setw(8) << "Used" << "  " << std::left << std::setw(16) << "Top variant"
+        << std::setw(24) << "Variants" << "Output\n";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const SweepEntry& entry = entries[i];
+        const AppState& state = entry.state;
+        double actual = state.totalEligibleNotes > 0 ?
+            100.0 * state.transformedNotes / state.totalEligibleNotes : 0.0;
+
+        // Most used variant; the first in code order on a tie
+        std::string top = "-";
+        int topCount = 0;
+        for (const auto& [variant, count] : state.variantUsageCount) {
+            if (count > topCount) {
+                top = variant + " (" + std::to_string(count) + ")";
+                topCount = count;
+            }
+        }
+        std::string variants;
+        for (const std::string& code : entry.variants) {
+            variants += (variants.empty() ? "" : ",") + code;
+        }
+
+        out << std::right << std::setw(6) << i + 1 << std::setw(12) << std::setprecision(1) << entry.percentage
+            << std::setw(8) << (entry.meter == DUPLE ? "duple" : "triple");
+        if (!entry.ok) {
+            out << "  FAILED: " << (entry.errors.empty() ? "cancelled" : entry.errors) << "\n";
+            continue;
+        }
+        out << std::setw(10) << state.totalEligibleNotes << std::setw(12) << state.transformedNotes
+            << std::setw(10) << actual << std::setw(8) << state.variantUsageCount.size() << "  "
+            << std::left << std::setw(16) << top << std::setw(24) << (variants.empty() ? "RANDOM" : variants)
+            << entry.outputBase.string() << ".*\n";
+    }
+}
+
+// Transform every input under every sweep configuration. Each input is read
+// and parsed once; groups of configurations then share the parsed rows on
+// the pool, and each group writes its outputs as soon as it is done.
+static int runSweep(const CliOptions& options, std::vector<CliJob>& jobs) {
+    std::vector<SweepEntry> configurations;
+    if (!readSweepFile(options.sweep, configurations)) {
+        return 2;
+    }
+
+    // Configurations a task transforms together; bounds the outputs held in memory
+    const size_t kGroupSize = 8;
+    int exitCode = 0;
+    std::ofstream reportFile;
+    if (!options.report.empty()) {
+        reportFile.open(options.report);
+    }
+    for (CliJob& job : jobs) {
+        auto started = std::chrono::steady_clock::now();
+        std::string input;
+        if (!readFile(job.input, input)) {
+            std::cerr << "Error opening input file: " << job.input << std::endl;
+            exitCode = 1;
+            continue;
+        }
+        ParsedTable table;
+        parseTable(input, table);
+        job.bytes = input.size();
+        job.lines = static_cast<long long>(table.rows.size());
+        double parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        std::vector<SweepEntry> entries = configurations;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            entries[i].outputBase = sweepOutputBase(job.outputBase, i + 1, entries.size());
+        }
+        std::error_code ignored;
+        if (job.outputBase.has_parent_path()) {
+            std::filesystem::create_directories(job.outputBase.parent_path(), ignored);
+        }
+
+        auto runGroup = [&](size_t first, size_t last) {
+            struct Outputs {
+                std::string text, binary, midi;
+            };
+            std::vector<Outputs> outputs(last - first);
+            std::vector<SweepConfig> configs(last - first);
+            for (size_t i = first; i < last; ++i) {
+                AppState& state = entries[i].state;
+                state.transformationPercentage = entries[i].percentage;
+                state.selectedVariants = entries[i].variants;
+                state.meter = entries[i].meter;
+                state.seed = options.seed;
+                SweepConfig& config = configs[i - first];
+                config.state = &state;
+                config.buffers.text = (options.formats & FORMAT_TEXT) ? &outputs[i - first].text : nullptr;
+                config.buffers.binary = (options.formats & FORMAT_BINARY) ? &outputs[i - first].binary : nullptr;
+                config.buffers.midi = (options.formats & FORMAT_MIDI) ? &outputs[i - first].midi : nullptr;
+            }
+            transformSweep(table, configs.data(), configs.size(), nullptr, &g_interrupt);
+
+            for (size_t i = first; i < last; ++i) {
+                SweepEntry& entry = entries[i];
+                if (entry.state.cancelled) continue;
+                entry.ok = true;
+                std::string destination = entry.outputBase.string();
+                auto write = [&](int format, const std::string& data, const char* extension) {
+                    if (!(options.formats & format)) return;
+                    if (!writeOutputFile(destination + extension, data)) {
+                        entry.errors += "Error writing output file: " + destination + extension + "; ";
+                        entry.ok = false;
+                    }
+                };
+                write(FORMAT_TEXT, outputs[i - first].text, ".txt");
+                write(FORMAT_BINARY, outputs[i - first].binary, ".trlb");
+                write(FORMAT_MIDI, outputs[i - first].midi, ".mid");
+            }
+        };
+
+        auto sweepStart = std::chrono::steady_clock::now();
+        {
+            WorkPool pool(options.threads);
+            for (size_t first = 0; first < entries.size(); first += kGroupSize) {
+                size_t last = std::min(entries.size(), first + kGroupSize);
+                pool.submit([&runGroup, first, last] { runGroup(first, last); });
+            }
+            pool.wait();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sweepStart).count();
+
+        // Errors always go to stderr, the table to the report or stdout
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!entries[i].ok) {
+                std::cerr << job.input << ": configuration " << i + 1 << " failed: "
+                          << (entries[i].errors.empty() ? "cancelled" : entries[i].errors) << std::endl;
+                exitCode = 1;
+            }
+        }
+        if (reportFile.is_open()) {
+            writeSweepReport(reportFile, job, entries, parseSeconds, seconds, options.threads);
+            reportFile << "\n";
+        } else if (!options.quiet) {
+            writeSweepReport(std::cout, job, entries, parseSeconds, seconds, options.threads);
+            std::cout << "\n";
+        }
+        if (g_interrupt.isCancelled()) {
+            break;
+        }
+    }
+    if (!options.report.empty() && !reportFile) {
+        std::cerr << "Error writing report: " << options.report << std::endl;
+        exitCode = 1;
+    }
+    return g_interrupt.isCancelled() ? 130 : exitCode;
+}
+
+// Distribution of one statistic over the simulated seeds
+struct Distribution {
+    double mean = 0.0;
+    double stddev = 0.0;
+    std::vector<double> sorted;
+
+    explicit Distribution(std::vector<double> values) : sorted(std::move(values)) {
+        std::sort(sorted.begin(), sorted.end());
+        for (double value : sorted) {
+            mean += value;
+        }
+        mean /= sorted.size();
+        for (double value : sorted) {
+            stddev += (value - mean) * (value - mean);
+        }
+        stddev = sorted.size() > 1 ? std::sqrt(stddev / (sorted.size() - 1)) : 0.0;
+    }
+
+    // Nearest-rank percentile, fraction in [0, 1]
+    double percentile(double fraction) const {
+        size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+        return sorted[rank > 0 ? rank - 1 : 0];
+    }
+};
+
+static void writeDistribution(std::ostream& out, const std::string& name, std::vector<double> values) {
+    static const double fractions[] = {0.0, 0.05, 0.25, 0.50, 0.75, 0.95, 1.0};
+    Distribution distribution(std::move(values));
+    out << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(12) << distribution.mean << std::setw(10) << distribution.stddev;
+    for (double fraction : fractions) {
+        out << std::setw(12) << distribution.percentile(fraction);
+    }
+    out << "\n";
+}
+
+// Simulate options.monteCarloSeeds seeds per input and report the
+// distribution of every statistic. Nothing is formatted or written: each
+// input is parsed once and the seeds share one simulator on the pool.
+static int runMonteCarlo(const CliOptions& options, std::vector<CliJob>& jobs) {
+    // Seeds a task simulates in a row
+    const size_t kSeedBatch = 64;
+    int exitCode = 0;
+    std::ofstream reportFile;
+    if (!options.report.empty()) {
+        reportFile.open(options.report);
+    }
+    std::ostream& out = reportFile.is_open() ? static_cast<std::ostream&>(reportFile) : std::cout;
+
+    for (CliJob& job : jobs) {
+        auto started = std::chrono::steady_clock::now();
+        std::string input;
+        if (!readFile(job.input, input)) {
+            std::cerr << "Error opening input file: " << job.input << std::endl;
+            exitCode = 1;
+            continue;
+        }
+        ParsedTable table;
+        parseTable(input, table);
+
+        AppState settings;
+        settings.transformationPercentage = options.percentage;
+        settings.selectedVariants = options.variants;
+        settings.meter = options.meter;
+        RunSimulator simulator(table, settings);
+
+        std::vector<SeedOutcome> outcomes(options.monteCarloSeeds);
+        {
+            WorkPool pool(options.threads);
+            for (size_t first = 0; first < outcomes.size(); first += kSeedBatch) {
+                size_t last = std::min(outcomes.size(), first + kSeedBatch);
+                pool.submit([&, first, last] {
+                    for (size_t i = first; i < last && !g_interrupt.isCancelled(); ++i) {
+                        simulator.simulate(options.seed + i, outcomes[i]);
+                    }
+                });
+            }
+            pool.wait();
+        }
+        if (g_interrupt.isCancelled()) {
+            break;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        if (options.quiet && !reportFile.is_open()) {
+            continue;
+        }
+
+        auto column = [&](auto statistic) {
+            std::vector<double> values;
+            values.reserve(outcomes.size());
+            for (const SeedOutcome& outcome : outcomes) {
+                values.push_back(static_cast<double>(statistic(outcome)));
+            }
+            return values;
+        };
+        out << std::fixed << std::setprecision(3)
+            << "Monte Carlo of " << job.input << ": " << outcomes.size() << " seeds (" << options.seed << " to "
+            << options.seed + outcomes.size() - 1 << "), " << simulator.eligibleNotes() << " eligible notes, "
+            << seconds << " s on " << options.threads << " threads\n\n";
+        out << std::left << std::setw(20) << "Statistic" << std::right << std::setw(12) << "Mean"
+            << std::setw(10) << "Stddev" << std::setw(12) << "Min" << std::setw(12) << "P5"
+            << std::setw(12) << "P25" << std::setw(12) << "P50" << std::setw(12) << "P75"
+            << std::setw(12) << "P95" << std::setw(12) << "Max" << "\n";
+        writeDistribution(out, "Transformed notes", column([](const SeedOutcome& o) { return o.transformedNotes; }));
+        writeDistribution(out, "Output rows", column([](const SeedOutcome& o) { return o.outputRows; }));
+        writeDistribution(out, "Output bytes", column([](const SeedOutcome& o) { return o.textBytes; }));
+        out << "\nVariant usage per run:\n";
+        for (size_t v = 0; v < simulator.variants().size(); ++v) {
+            writeDistribution(out, "  " + simulator.variants()[v],
+                              column([v](const SeedOutcome& o) { return o.variantUsage[v]; }));
+        }
+        out << "\n";
+    }
+    if (!options.report.empty() && !reportFile) {
+        std::cerr << "Error writing report: " << options.report << std::endl;
+        exitCode = 1;
+    }
+    return g_interrupt.isCancelled() ? 130 : exitCode;
+}
+
+// Dry run of one input: its estimate and projected memory
+struct DryRun {
+    RunEstimate estimate;
+    size_t peakMemory = 0;
+    double seconds = 0.0;
+};
+
+// Estimate job the way BatchJob would run it: same chunks, same chunk seeds.
+// The projected peak is the input plus the buffers a run fills (at the
+// capacity a doubling buffer reaches) and the MIDI writer's events.
+static bool estimateJob(const CliOptions& options, CliJob& job, DryRun& result) {
+    auto started = std::chrono::steady_clock::now();
+    std::string input;
+    if (!readFile(job.input, input)) {
+        job.summary = "Error opening input file: " + job.input + "\n";
+        return false;
+    }
+    std::vector<std::string_view> pieces = splitInput(input, options.splitBytes);
+    std::vector<ParsedTable> tables(pieces.size());
+    std::vector<AppState> settings(pieces.size());
+    std::vector<EstimatePiece> estimatePieces(pieces.size());
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        parseTable(pieces[i], tables[i]);
+        settings[i].transformationPercentage = options.percentage;
+        settings[i].selectedVariants = options.variants;
+        settings[i].meter = options.meter;
+        settings[i].seed = chunkSeed(options.seed, i);
+        estimatePieces[i].table = &tables[i];
+        estimatePieces[i].settings = &settings[i];
+        job.lines += static_cast<long long>(tables[i].rows.size());
+    }
+    estimateRun(estimatePieces.data(), estimatePieces.size(), result.estimate);
+
+    const RunEstimate& estimate = result.estimate;
+    bool split = pieces.size() > 1;
+    auto capacity = [](size_t size) {
+        size_t grown = 1;
+        while (grown < size) grown <<= 1;
+        return grown;
+    };
+    result.peakMemory = input.size();
+    if (options.formats & FORMAT_TEXT) {
+        result.peakMemory += capacity(estimate.textBytes);
+    }
+    if ((options.formats & FORMAT_BINARY) || (split && (options.formats & FORMAT_MIDI))) {
+        result.peakMemory += capacity(estimate.binaryBytes);
+    }
+    if (options.formats & FORMAT_MIDI) {
+        result.peakMemory += capacity(estimate.midiBytes) + estimate.midiEventBytes;
+    }
+
+    job.bytes = input.size();
+    job.chunks = pieces.size();
+    job.eligibleNotes = estimate.statistics.eligibleNotes;
+    job.transformedNotes = estimate.statistics.transformedNotes;
+    job.ok = true;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return true;
+}
+
+static void writeDryRun(std::ostream& out, const CliOptions& options, const CliJob& job, const DryRun& result) {
+    const RunEstimate& estimate = result.estimate;
+    const RunStatistics& statistics = estimate.statistics;
+    int variantsUsed = 0;
+    for (uint64_t count : statistics.variantUsage) {
+        variantsUsed += count > 0 ? 1 : 0;
+    }
+    double actual = statistics.eligibleNotes > 0 ? 100.0 * statistics.transformedNotes / statistics.eligibleNotes : 0.0;
+    std::string destination = job.outputBase.string();
+    out << std::fixed << std::setprecision(1)
+        << "Dry run of " << job.input << ": " << job.lines << " lines in " << job.chunks
+        << (job.chunks == 1 ? " chunk" : " chunks") << ", estimated in " << result.seconds * 1000.0 << " ms\n"
+        << "Eligible notes: " << statistics.eligibleNotes << ", transformed: " << statistics.transformedNotes
+        << " (" << actual << "%), " << variantsUsed << " variants used\n"
+        << "Errors: " << estimate.noteErrors << " notes, " << estimate.midiErrors << " rows without a MIDI note\n";
+
+    auto size = [&](int format, const char* name, size_t bytes, const char* extension) {
+        out << "  " << std::left << std::setw(8) << name << std::right << std::setw(14) << bytes << " bytes  "
+            << ((options.formats & format) ? destination + extension : "(not selected)") << "\n";
+    };
+    out << "Output sizes:\n";
+    size(FORMAT_TEXT, "text", estimate.textBytes, ".txt");
+    size(FORMAT_BINARY, "binary", estimate.binaryBytes, ".trlb");
+    size(FORMAT_MIDI, "midi", estimate.midiBytes, ".mid");
+    out << "Projected peak memory: " << result.peakMemory / (1024.0 * 1024.0) << " MB\n";
+
+    out << std::right << std::setw(8) << "Track" << std::setw(12) << "Notes" << std::setw(12) << "Events"
+        << std::setw(14) << "MIDI bytes" << "\n";
+    for (const TrackEstimate& track : estimate.tracks) {
+        out << std::setw(8) << track.track << std::setw(12) << track.notes << std::setw(12) << 2 * track.notes
+            << std::setw(14) << track.midiBytes << "\n";
+    }
+}
+
+// Estimate every input without writing anything. Inputs run in parallel;
+// the batch's projected peak is that of the largest inputs that can run at
+// the same time.
+static int runDryRun(const CliOptions& options, std::vector<CliJob>& jobs) {
+    std::vector<DryRun> results(jobs.size());
+    {
+        WorkPool pool(options.threads);
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            pool.submit([&, i] {
+                if (!g_interrupt.isCancelled()) estimateJob(options, jobs[i], results[i]);
+            });
+        }
+        pool.wait();
+    }
+
+    int exitCode = 0;
+    std::ofstream reportFile;
+    if (!options.report.empty()) {
+        reportFile.open(options.report);
+    }
+    std::ostream& out = reportFile.is_open() ? static_cast<std::ostream&>(reportFile) : std::cout;
+    std::vector<size_t> peaks;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!jobs[i].ok) {
+            std::cerr << (jobs[i].summary.empty() ? jobs[i].input + ": skipped\n" : jobs[i].summary);
+            exitCode = 1;
+            continue;
+        }
+        peaks.push_back(results[i].peakMemory);
+        if (!options.quiet || reportFile.is_open()) {
+            writeDryRun(out, options, jobs[i], results[i]);
+            out << "\n";
+        }
+    }
+    if (peaks.size() > 1 && (!options.quiet || reportFile.is_open())) {
+        std::sort(peaks.rbegin(), peaks.rend());
+        size_t concurrent = std::min<size_t>(peaks.size(), options.threads);
+        size_t peak = 0;
+        for (size_t i = 0; i < concurrent; ++i) {
+            peak += peaks[i];
+        }
+        out << std::fixed << std::setprecision(1) << "Projected peak memory of the batch on " << options.threads
+            << " threads: " << peak / (1024.0 * 1024.0) << " MB\n";
+    }
+    if (!options.report.empty() && !reportFile) {
+        std::cerr << "Error writing report: " << options.report << std::endl;
+        exitCode = 1;
+    }
+    return g_interrupt.isCancelled() ? 130 : exitCode;
+}
+
+// Transform every job on the work pool, then print or save the report
+static int runBatch(const CliOptions& options, std::vector<CliJob>& jobs) {
+    // Each file is one task on the pool; large files queue their chunks
+    // on the same worker for idle workers to steal
+    auto batchStart = std::chrono::steady_clock::now();
+    BatchProgress batch;
+    batch.workerStatistics.resize(options.threads);
+    {
+        std::vector<std::unique_ptr<BatchJob>> batchJobs;
+        for (CliJob& job : jobs) {
+            batchJobs.emplace_back(new BatchJob(options, job, batch));
+        }
+        WorkPool pool(options.threads);
+        for (std::unique_ptr<BatchJob>& job : batchJobs) {
+            BatchJob* batchJob = job.get();
+            pool.submit([batchJob, &pool] { batchJob->start(pool); });
+        }
+
+        // Report combined progress of all jobs on stderr while they run
+        while (options.progress && batch.finishedJobs.load() < jobs.size()) {
+            std::cerr << "\r" << batch.finishedJobs.load() << "/" << jobs.size() << " files, "
+                      << batch.lines.load() << " lines, " << batch.notes.load() << " notes transformed" << std::flush;
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        pool.wait();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    if (options.progress) {
+        std::cerr << "\r" << batch.finishedJobs.load() << "/" << jobs.size() << " files done"
+                  << std::string(40, ' ') << std::endl;
+    }
+
+    RunStatistics statistics;
+    for (const RunStatistics& workerStatistics : batch.workerStatistics) {
+        statistics.merge(workerStatistics);
+    }
+
+    // Errors always go to stderr; one input prints its summary, a batch its report
+    int exitCode = 0;
+    for (const CliJob& job : jobs) {
+        if (!job.ok) {
+            std::cerr << (job.summary.empty() ? job.input + ": skipped\n" : job.summary);
+            exitCode = 1;
+        } else if (!options.quiet && jobs.size() == 1) {
+            std::cout << job.summary << "\n" << statisticsBreakdown(statistics) << std::endl;
+        }
+    }
+    if (!options.report.empty()) {
+        std::ofstream report(options.report);
+        writeReport(report, jobs, seconds, options.threads, statistics);
+        if (!report) {
+            std::cerr << "Error writing report: " << options.report << std::endl;
+            exitCode = 1;
+        }
+    } else if (!options.quiet && jobs.size() > 1) {
+        writeReport(std::cout, jobs, seconds, options.threads, statistics);
+    }
+    if (!options.statsJson.empty() && !writeOutputFile(options.statsJson, statsJson(jobs, seconds, options.threads))) {
+        std::cerr << "Error writing statistics: " << options.statsJson << std::endl;
+        exitCode = 1;
+    }
+    if (!options.metrics.empty()) {
+        RunMetrics metrics;
+        for (const CliJob& job : jobs) {
+            if (job.metrics.runs > 0) {
+                metrics.merge(job.metrics);
+            } else {
+                metrics.addFailure();  // Unreadable or skipped input
+            }
+        }
+        if (!writeOutputFile(options.metrics, metrics.prometheusText())) {
+            std::cerr << "Error writing metrics: " << options.metrics << std::endl;
+            exitCode = 1;
+        }
+    }
+    return g_interrupt.isCancelled() ? 130 : exitCode;
+}
+
+int main(int argc, char* argv[]) {
+    CliOptions options;
+    int exitCode = parseArguments(argc, argv, options);
+    if (exitCode >= 0) {
+        return exitCode;
+    }
+    std::vector<CliJob> jobs;
+    if (!collectJobs(options, jobs)) {
+        return 2;
+    }
+    std::signal(SIGINT, onInterrupt);
+    if (!options.trace.empty()) {
+        enableTracing();
+        setTraceThreadName("main");
+    }
+    if (!options.sweep.empty()) {
+        exitCode = runSweep(options, jobs);
+    } else if (options.monteCarloSeeds > 0) {
+        exitCode = runMonteCarlo(options, jobs);
+    } else if (options.dryRun) {
+        exitCode = runDryRun(options, jobs);
+    } else {
+        exitCode = runBatch(options, jobs);
+    }
+    if (!options.trace.empty()) {
+        if (!writeChromeTrace(options.trace)) {
+            std::cerr << "Error writing trace: " << options.trace << std::endl;
+            exitCode = exitCode == 0 ? 1 : exitCode;
+        } else if (size_t dropped = droppedTraceSpans()) {
+            std::cerr << "Trace: " << dropped << " oldest spans were overwritten" << std::endl;
+        }
+    }
+    return exitCode;
+}
@@ -0,0 +1,143 @@
+// Trill Transformation (C) 2025
+// Synthetic input tables for scale testing and benchmarks.
+
+#include "TrillCorpus.h"
+#include "TrillTransformation.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+std::vector<Weighted<std::string>> parseWeightedList(const std::string& list) {
+    std::vector<Weighted<std::string>> entries;
+    std::stringstream items(list);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        size_t colon = item.find(':');
+        Weighted<std::string> entry{item.substr(0, colon), 1.0};
+        if (colon != std::string::npos) {
+            entry.weight = std::stod(item.substr(colon + 1));
+        }
+        if (entry.value.empty() || !(entry.weight >= 0)) {
+            throw std::invalid_argument("Invalid list entry: " + item);
+        }
+        entries.push_back(entry);
+    }
+    if (entries.empty()) {
+        throw std::invalid_argument("Empty list");
+    }
+    return entries;
+}
+
+CorpusGenerator::CorpusGenerator(const CorpusSettings& settings)
+    : settings(settings), rng(settings.seed) {
+    this->settings.tracks = std::max(1, settings.tracks);
+    for (int note = settings.lowestNote; note <= settings.highestNote; ++note) {
+        noteNames.push_back(getNoteName(note));
+    }
+    if (noteNames.empty()) {
+        noteNames.push_back("C4");
+    }
+
+    std::vector<double> weights;
+    if (settings.labels.empty()) {
+        static const char* const ineligible[] = {"PED", "ORN", "ACC", "X"};
+        double eligible = std::clamp(settings.eligibleFraction, 0.0, 1.0);
+        for (std::string_view label : eligibleLabels()) {
+            labelValues.emplace_back(label);
+            weights.push_back(eligible / eligibleLabels().size());
+        }
+        for (const char* label : ineligible) {
+            labelValues.emplace_back(label);
+            weights.push_back((1 - eligible) / 4);
+        }
+    } else {
+        for (const auto& entry : settings.labels) {
+            labelValues.push_back(entry.value);
+            weights.push_back(entry.weight);
+        }
+    }
+    labelChoice = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+
+    weights.clear();
+    for (const auto& entry : settings.durations) {
+        durationValues.push_back(entry.value);
+        weights.push_back(entry.weight);
+    }
+    if (!weights.empty()) {
+        durationChoice = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+}
+
+void CorpusGenerator::appendLine(std::string& buffer) {
+    uint64_t r = rng();
+    buffer += std::to_string(r % static_cast<uint64_t>(settings.tracks));
+    buffer += ' ';
+    buffer += noteNames[(r >> 16) % noteNames.size()];
+    buffer += ' ';
+    int duration;
+    if (durationValues.empty()) {
+        uint64_t span = static_cast<uint64_t>(std::max(0, settings.maxDuration - settings.minDuration)) + 1;
+        duration = settings.minDuration + static_cast<int>((r >> 32) % span);
+    } else {
+        duration = durationValues[durationChoice(rng)];
+    }
+    buffer += std::to_string(duration);
+    buffer += ' ';
+    buffer += labelValues[labelChoice(rng)];
+    buffer += '\n';
+}
+
+// The kinds of damage real inputs show: unknown note names, missing fields,
+// non-numeric fields, stray text and blank lines
+void CorpusGenerator::appendMalformed(std::string& buffer) {
+    uint64_t r = rng();
+    const std::string& label = labelValues[(r >> 8) % labelValues.size()];
+    switch (r % 5) {
+    case 0:
+        buffer += "1 H" + std::to_string((r >> 16) % 8) + " 120 " + label + "\n";
+        break;
+    case 1:
+        buffer += std::to_string((r >> 16) % settings.tracks) + " " + noteNames[(r >> 24) % noteNames.size()] + "\n";
+        break;
+    case 2:
+        buffer += "x " + noteNames[(r >> 24) % noteNames.size()] + " long " + label + "\n";
+        break;
+    case 3:
+        buffer += "# generated line " + std::to_string(written) + "\n";
+        break;
+    default:
+        buffer += "\n";
+        break;
+    }
+}
+
+bool CorpusGenerator::fill(std::string& buffer, size_t maxBytes) {
+    std::bernoulli_distribution isMalformed(std::clamp(settings.malformedRate, 0.0, 1.0));
+    size_t limit = buffer.size() + maxBytes;
+    while (written < settings.lines && buffer.size() < limit) {
+        if (settings.malformedRate > 0 && isMalformed(rng)) {
+            appendMalformed(buffer);
+            ++malformed;
+        } else {
+            appendLine(buffer);
+        }
+        ++written;
+    }
+    return written < settings.lines;
+}
+
+bool writeCorpus(const CorpusSettings& settings, std::FILE* out) {
+    CorpusGenerator generator(settings);
+    std::string buffer;
+    buffer.reserve(1 << 20);
+    bool more = true;
+    while (more) {
+        buffer.clear();
+        more = generator.fill(buffer, (1 << 20) - 128);
+        if (std::fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size()) {
+            return false;
+        }
+    }
+    return std::fflush(out) == 0;
+}
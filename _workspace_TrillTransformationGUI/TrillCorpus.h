@@ -0,0 +1,73 @@
+// Trill Transformation (C) 2025
+// Synthetic input tables for scale testing and benchmarks.
+//
+// The generator is deterministic from its seed and produces lines one
+// buffer at a time, so a corpus of any size streams through a fixed amount
+// of memory.
+#ifndef TRILL_CORPUS_H
+#define TRILL_CORPUS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// A value and its relative weight in a weighted choice
+template <typename T>
+struct Weighted {
+    T value;
+    double weight;
+};
+
+struct CorpusSettings {
+    uint64_t lines = 1000;
+    uint64_t seed = 1;
+    int tracks = 4;                      // Tracks 0..tracks-1
+    int lowestNote = 36;                 // MIDI range of the note names
+    int highestNote = 95;
+    // Labels to draw from. Empty: the eligible labels with probability
+    // eligibleFraction, otherwise a few ineligible ones.
+    std::vector<Weighted<std::string>> labels;
+    double eligibleFraction = 0.7;
+    // Durations to draw from. Empty: uniform in [minDuration, maxDuration].
+    std::vector<Weighted<int>> durations = {{60, 1}, {120, 4}, {240, 4}, {480, 2}, {960, 1}};
+    int minDuration = 1;
+    int maxDuration = 960;
+    double malformedRate = 0;            // Fraction of lines that are not valid notes
+};
+
+// Parse "VALUE:WEIGHT,VALUE:WEIGHT,..." (a missing weight is 1); throws
+// std::invalid_argument on a malformed list
+std::vector<Weighted<std::string>> parseWeightedList(const std::string& list);
+
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(const CorpusSettings& settings);
+
+    // Append up to maxBytes (roughly) of whole lines to buffer; false once
+    // every line has been produced
+    bool fill(std::string& buffer, size_t maxBytes);
+
+    uint64_t linesWritten() const { return written; }
+    uint64_t malformedLines() const { return malformed; }
+
+private:
+    void appendLine(std::string& buffer);
+    void appendMalformed(std::string& buffer);
+
+    CorpusSettings settings;
+    std::mt19937_64 rng;
+    std::vector<std::string> noteNames;
+    std::vector<std::string> labelValues;
+    std::discrete_distribution<size_t> labelChoice;
+    std::vector<int> durationValues;
+    std::discrete_distribution<size_t> durationChoice;
+    uint64_t written = 0;
+    uint64_t malformed = 0;
+};
+
+// Stream a whole corpus to out; false on a write error
+bool writeCorpus(const CorpusSettings& settings, std::FILE* out);
+
+#endif // TRILL_CORPUS_H
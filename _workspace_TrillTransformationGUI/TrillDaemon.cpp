@@ -0,0 +1,580 @@
+// Trill Transformation Tool - Job Server
+// Builds as trill-daemon: a long-running process that accepts transformation
+// jobs over a local Unix domain socket, so interactive tools pay for process
+// startup and variant setup once instead of per call.
+//
+// Protocol: one job per connection. The client sends "key value" lines:
+//   input PATH          input table on disk, or
+//   data BYTES          the input table inline: the next BYTES bytes after
+//                       this line (must be the last line of the request)
+//   output PATH         output path; the extension is replaced per format
+//                       (default: <spool>/job-<id>)
+//   format LIST         text, binary, midi, comma-separated (default: text)
+//   percentage N, variant CODE (repeatable), meter duple|triple, seed N
+//   end                 ends a request without inline data
+// A request of just "stats" returns the server counters instead.
+//
+// The reply is "status ok|error|busy", then "message TEXT" for errors,
+// one "output PATH" line per file written and "summary BYTES" followed by
+// the run summary.
+
+#include "TrillTransformation.h"
+#include "WorkPool.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// SIGINT/SIGTERM stop the server and cancel running jobs
+static std::atomic<bool> g_stopping{false};
+
+static void onStop(int) {
+    g_stopping.store(true);
+}
+
+// Server settings
+struct DaemonOptions {
+    std::string socketPath;
+    std::string spoolDir = (std::filesystem::temp_directory_path() / "trill-daemon").string();
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());  // Jobs run at once
+    unsigned queue = 64;                     // Jobs waiting beyond those running
+    size_t jobMemory = size_t(512) << 20;    // Per-job limit on input, output and working memory
+    int readTimeoutSeconds = 10;
+    std::string metricsPath;                 // Prometheus textfile, rewritten periodically
+    unsigned metricsInterval = 15;           // Seconds between rewrites
+};
+
+// Server counters, reported by the "stats" request
+struct DaemonStats {
+    std::atomic<unsigned> admitted{0};   // Admitted and not yet finished
+    std::atomic<long long> completed{0};
+    std::atomic<long long> failed{0};
+    std::atomic<long long> rejected{0};
+    std::atomic<long long> nextJobId{1};
+
+    // Counters of finished jobs for --metrics
+    std::mutex metricsMutex;
+    RunMetrics metrics;
+
+    // Add a finished job; state is null for jobs that failed before running
+    void record(const AppState* state, uint64_t bytesWritten, bool ok) {
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        if (state) {
+            metrics.add(*state, bytesWritten, ok);
+        } else {
+            metrics.addFailure();
+        }
+    }
+};
+
+// Parsed job request
+struct JobRequest {
+    std::string input;
+    std::string data;
+    bool inlineData = false;
+    std::string output;
+    bool text = true;
+    bool binary = false;
+    bool midi = false;
+    AppState state;
+    bool stats = false;
+};
+
+static bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void sendError(int fd, const std::string& status, const std::string& message) {
+    sendAll(fd, "status " + status + "\nmessage " + message + "\n");
+}
+
+// Close a connection whose request was not read. Discarding what the client
+// already sent avoids a reset that could lose the reply before it is read.
+static void refuseConnection(int fd, const std::string& message) {
+    sendError(fd, "busy", message);
+    shutdown(fd, SHUT_WR);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    char discard[4096];
+    while (recv(fd, discard, sizeof(discard), 0) > 0) {
+    }
+    close(fd);
+}
+
+// Buffered reader for the request lines and inline data of one connection
+class RequestReader {
+public:
+    explicit RequestReader(int fd) : fd(fd) {}
+
+    bool readLine(std::string& line) {
+        for (;;) {
+            size_t newline = buffer.find('\n', pos);
+            if (newline != std::string::npos) {
+                line.assign(buffer, pos, newline - pos);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                pos = newline + 1;
+                return true;
+            }
+            if (buffer.size() - pos > kMaxLine || !fill()) return false;
+        }
+    }
+
+    bool readBytes(size_t count, std::string& data) {
+        while (buffer.size() - pos < count) {
+            if (!fill()) return false;
+        }
+        data.assign(buffer, pos, count);
+        pos += count;
+        return true;
+    }
+
+private:
+    static const size_t kMaxLine = 4096;
+
+    bool fill() {
+        if (pos > 0) {
+            buffer.erase(0, pos);
+            pos = 0;
+        }
+        char chunk[65536];
+        for (;;) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buffer.append(chunk, static_cast<size_t>(n));
+            return true;
+        }
+    }
+
+    int fd;
+    std::string buffer;
+    size_t pos = 0;
+};
+
+// Read and validate a request. Returns false with message set on error.
+static bool readRequest(int fd, const DaemonOptions& options, JobRequest& request, std::string& message) {
+    RequestReader reader(fd);
+    std::string line;
+    for (;;) {
+        if (!reader.readLine(line)) {
+            message = "incomplete request";
+            return false;
+        }
+        if (line.empty()) continue;
+
+        size_t space = line.find(' ');
+        std::string key = line.substr(0, space);
+        std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+        try {
+            if (key == "end") {
+                break;
+            } else if (key == "stats") {
+                request.stats = true;
+                return true;
+            } else if (key == "input") {
+                request.input = value;
+            } else if (key == "output") {
+                request.output = value;
+            } else if (key == "data") {
+                size_t bytes = std::stoull(value);
+                if (bytes > options.jobMemory) {
+                    message = "inline data exceeds the per-job memory limit";
+                    return false;
+                }
+                if (!reader.readBytes(bytes, request.data)) {
+                    message = "incomplete inline data";
+                    return false;
+                }
+                request.inlineData = true;
+                break;
+            } else if (key == "format") {
+                request.text = request.binary = request.midi = false;
+                std::istringstream formats(value);
+                std::string name;
+                while (std::getline(formats, name, ',')) {
+                    if (name == "text") {
+                        request.text = true;
+                    } else if (name == "binary") {
+                        request.binary = true;
+                    } else if (name == "midi") {
+                        request.midi = true;
+                    } else {
+                        message = "unknown format: " + name;
+                        return false;
+                    }
+                }
+            } else if (key == "percentage") {
+                size_t used = 0;
+                double percentage = std::stod(value, &used);
+                if (used != value.size() || !(percentage >= 0.0 && percentage <= 100.0)) {
+                    message = "percentage must be between 0 and 100: " + value;
+                    return false;
+                }
+                request.state.transformationPercentage = percentage;
+            } else if (key == "variant") {
+                request.state.selectedVariants.push_back(value);
+            } else if (key == "meter") {
+                if (value == "duple") {
+                    request.state.meter = DUPLE;
+                } else if (value == "triple") {
+                    request.state.meter = TRIPLE;
+                } else {
+                    message = "meter must be duple or triple: " + value;
+                    return false;
+                }
+            } else if (key == "seed") {
+                request.state.seed = std::stoull(value);
+            } else {
+                message = "unknown request field: " + key;
+                return false;
+            }
+        } catch (const std::exception&) {
+            message = "invalid value for " + key + ": " + value;
+            return false;
+        }
+    }
+
+    if (request.inlineData == !request.input.empty()) {
+        message = "a request needs exactly one of input or data";
+        return false;
+    }
+    if (!request.text && !request.binary && !request.midi) {
+        message = "no output format selected";
+        return false;
+    }
+    for (const std::string& code : request.state.selectedVariants) {
+        bool known = code == "RANDOM" && request.state.selectedVariants.size() == 1;
+        for (const TrillVariant& variant : allTrillVariants()) {
+            known = known || variant.code == code;
+        }
+        if (!known) {
+            message = "unknown trill variant: " + code;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << input.rdbuf();
+    contents = buffer.str();
+    return !input.bad();
+}
+
+// Serve one connection: read the request, run the job and reply
+static void serveConnection(int fd, const DaemonOptions& options, DaemonStats& stats, long long jobId) {
+    JobRequest request;
+    std::string message;
+    if (!readRequest(fd, options, request, message)) {
+        sendError(fd, "error", message);
+        stats.failed++;
+        stats.record(nullptr, 0, false);
+        return;
+    }
+    if (request.stats) {
+        std::ostringstream reply;
+        reply << "status ok\n"
+              << "admitted " << stats.admitted.load() << "\n"
+              << "completed " << stats.completed.load() << "\n"
+              << "failed " << stats.failed.load() << "\n"
+              << "rejected " << stats.rejected.load() << "\n";
+        sendAll(fd, reply.str());
+        return;
+    }
+
+    if (!request.inlineData) {
+        std::error_code error;
+        auto size = std::filesystem::file_size(request.input, error);
+        if (error) {
+            sendError(fd, "error", "cannot open input file: " + request.input);
+            stats.failed++;
+            stats.record(nullptr, 0, false);
+            return;
+        }
+        if (size > options.jobMemory) {
+            sendError(fd, "error", "input exceeds the per-job memory limit");
+            stats.failed++;
+            stats.record(nullptr, 0, false);
+            return;
+        }
+        if (!readFile(request.input, request.data)) {
+            sendError(fd, "error", "cannot read input file: " + request.input);
+            stats.failed++;
+            stats.record(nullptr, 0, false);
+            return;
+        }
+    }
+
+    // Enforce the memory limit while the job runs: the progress callback
+    // runs on this thread, so it can watch the buffers being filled and the
+    // run arena's pools (segments, tables, MIDI events) as they grow
+    std::string text, binary, midi;
+    CancellationToken cancel;
+    bool overLimit = false;
+    ProgressSink progress;
+    progress.intervalMs = 0;
+    progress.onProgress = [&](const ProgressSink&) {
+        const MemoryUsage& memory = request.state.memory;
+        size_t used = request.data.capacity() + text.capacity() + binary.capacity() + midi.capacity() +
+                      memory.current[MemoryUsage::INPUT] + memory.current[MemoryUsage::NOTES] +
+                      memory.current[MemoryUsage::MIDI_EVENTS];
+        if (used > options.jobMemory || g_stopping.load()) {
+            overLimit = used > options.jobMemory;
+            cancel.cancel();
+        }
+    };
+
+    TransformBuffers buffers;
+    buffers.text = request.text ? &text : nullptr;
+    buffers.binary = request.binary ? &binary : nullptr;
+    buffers.midi = request.midi ? &midi : nullptr;
+    AppState& state = request.state;
+    transformBuffer(request.data, buffers, state, &progress, &cancel);
+    if (state.cancelled) {
+        sendError(fd, "error", overLimit ? "job exceeded the per-job memory limit" : "server shutting down");
+        stats.failed++;
+        stats.record(&state, 0, false);
+        return;
+    }
+
+    std::string base = request.output.empty()
+        ? (std::filesystem::path(options.spoolDir) / ("job-" + std::to_string(jobId))).string()
+        : std::filesystem::path(request.output).replace_extension().string();
+    std::string outputs;
+    uint64_t bytesWritten = 0;
+    auto write = [&](const std::string* data, const char* extension) {
+        if (data == nullptr) return true;
+        std::string path = base + extension;
+        if (!writeOutputFile(path, *data)) return false;
+        outputs += "output " + path + "\n";
+        bytesWritten += data->size();
+        return true;
+    };
+    if (!write(buffers.text, ".txt") || !write(buffers.binary, ".trlb") || !write(buffers.midi, ".mid")) {
+        sendError(fd, "error", "cannot write output files at " + base);
+        stats.failed++;
+        stats.record(&state, bytesWritten, false);
+        return;
+    }
+
+    std::string summary = transformationSummary(state, base + ".*");
+    sendAll(fd, "status ok\n" + outputs + "summary " + std::to_string(summary.size()) + "\n" + summary);
+    stats.completed++;
+    stats.record(&state, bytesWritten, true);
+}
+
+// Replace the metrics file with the job counters and the server's own
+static bool writeMetrics(const std::string& path, DaemonStats& stats) {
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(stats.metricsMutex);
+        text = stats.metrics.prometheusText();
+    }
+    text += "# HELP trill_daemon_jobs_refused_total Connections refused with status busy.\n"
+            "# TYPE trill_daemon_jobs_refused_total counter\n"
+            "trill_daemon_jobs_refused_total " + std::to_string(stats.rejected.load()) + "\n"
+            "# HELP trill_daemon_jobs_admitted Jobs admitted and not yet finished.\n"
+            "# TYPE trill_daemon_jobs_admitted gauge\n"
+            "trill_daemon_jobs_admitted " + std::to_string(stats.admitted.load()) + "\n";
+    return writeOutputFile(path, text);
+}
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] <socket-path>\n"
+              << "\n"
+              << "Options:\n"
+              << "  -j, --jobs N            jobs run concurrently (default: number of cores)\n"
+              << "      --queue N           admitted jobs allowed to wait; more are refused\n"
+              << "                          with status busy (default: 64)\n"
+              << "      --job-memory MB     per-job limit on input, output and working memory\n"
+              << "                          (default: 512)\n"
+              << "      --spool DIR         outputs of requests without an output path\n"
+              << "                          (default: <temp>/trill-daemon)\n"
+              << "      --metrics FILE      keep FILE replaced with the server's counters and gauges\n"
+              << "                          in Prometheus text format (for a textfile collector)\n"
+              << "      --metrics-interval S  seconds between rewrites of the metrics file (default: 15)\n"
+              << "  -h, --help              show this help and exit\n"
+              << "\n"
+              << "Example: printf 'input score.txt\\nformat text,midi\\nseed 7\\nend\\n' | nc -U " << "/tmp/trill.sock\n";
+}
+
+static int parseArguments(int argc, char* argv[], DaemonOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto number = [&](unsigned long long& value) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            try {
+                value = std::stoull(argv[++i]);
+                return true;
+            } catch (const std::exception&) {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << std::endl;
+                return false;
+            }
+        };
+        unsigned long long value = 0;
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-j" || arg == "--jobs") {
+            if (!number(value) || value == 0) return 2;
+            options.jobs = static_cast<unsigned>(value);
+        } else if (arg == "--queue") {
+            if (!number(value)) return 2;
+            options.queue = static_cast<unsigned>(value);
+        } else if (arg == "--job-memory") {
+            if (!number(value) || value == 0) return 2;
+            options.jobMemory = static_cast<size_t>(value) << 20;
+        } else if (arg == "--spool") {
+            if (i + 1 >= argc) return 2;
+            options.spoolDir = argv[++i];
+        } else if (arg == "--metrics") {
+            if (i + 1 >= argc) return 2;
+            options.metricsPath = argv[++i];
+        } else if (arg == "--metrics-interval") {
+            if (!number(value) || value == 0) return 2;
+            options.metricsInterval = static_cast<unsigned>(value);
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 2;
+        } else {
+            options.socketPath = arg;
+        }
+    }
+    if (options.socketPath.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    return -1;
+}
+
+// Bind and listen on a socket only this user can reach
+static int openSocket(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // Replace a stale socket left by a previous server
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::perror("socket");
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    mode_t oldMask = umask(0077);
+    int bound = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(oldMask);
+    if (bound < 0 || listen(fd, 128) < 0) {
+        std::perror(path.c_str());
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char* argv[]) {
+    DaemonOptions options;
+    int exitCode = parseArguments(argc, argv, options);
+    if (exitCode >= 0) {
+        return exitCode;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(options.spoolDir, error);
+
+    int listenFd = openSocket(options.socketPath);
+    if (listenFd < 0) {
+        return 1;
+    }
+    std::signal(SIGINT, onStop);
+    std::signal(SIGTERM, onStop);
+    std::signal(SIGPIPE, SIG_IGN);  // A client that hangs up fails its send instead
+    std::cerr << "trill-daemon listening on " << options.socketPath << " (" << options.jobs
+              << " jobs, queue " << options.queue << ", " << (options.jobMemory >> 20) << " MB per job)" << std::endl;
+
+    DaemonStats stats;
+    {
+        WorkPool pool(options.jobs);
+        const unsigned capacity = options.jobs + options.queue;
+        auto metricsDue = std::chrono::steady_clock::now();
+        while (!g_stopping.load()) {
+            if (!options.metricsPath.empty() && std::chrono::steady_clock::now() >= metricsDue) {
+                if (!writeMetrics(options.metricsPath, stats)) {
+                    std::cerr << "Error writing metrics: " << options.metricsPath << std::endl;
+                }
+                metricsDue = std::chrono::steady_clock::now() + std::chrono::seconds(options.metricsInterval);
+            }
+            pollfd pending{listenFd, POLLIN, 0};
+            if (poll(&pending, 1, 200) <= 0) continue;
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+            // Admission control: refuse at once rather than queue without bound
+            if (stats.admitted.load() >= capacity) {
+                refuseConnection(fd, "server at capacity (" + std::to_string(capacity) + " jobs)");
+                stats.rejected++;
+                continue;
+            }
+
+            // A client that stalls mid-request must not hold a worker forever
+            timeval timeout{options.readTimeoutSeconds, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            stats.admitted++;
+            long long jobId = stats.nextJobId++;
+            pool.submit([fd, jobId, &options, &stats] {
+                serveConnection(fd, options, stats, jobId);
+                close(fd);
+                stats.admitted--;
+            });
+        }
+        close(listenFd);
+        unlink(options.socketPath.c_str());
+        std::cerr << "trill-daemon stopping; cancelling admitted jobs" << std::endl;
+    }
+    if (!options.metricsPath.empty() && !writeMetrics(options.metricsPath, stats)) {
+        std::cerr << "Error writing metrics: " << options.metricsPath << std::endl;
+    }
+    std::cerr << "trill-daemon stopped: " << stats.completed.load() << " completed, "
+              << stats.failed.load() << " failed, " << stats.rejected.load() << " refused" << std::endl;
+    return 0;
+}
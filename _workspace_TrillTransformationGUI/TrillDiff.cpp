@@ -0,0 +1,415 @@
+// Trill Transformation Tool - Differential Test
+// Builds as trill-diff: feeds randomized inputs to every engine path and to
+// the reference implementation (TrillReference.h), and compares the notes,
+// the text tables and the MIDI files byte for byte. Stops at the first
+// difference and shows it. The inputs follow from --seed, so a failure can
+// be reproduced exactly; CTest runs it with the default seed.
+
+#include "TrillCorpus.h"
+#include "TrillReference.h"
+#include "TrillSimulation.h"
+#include "TrillTransformation.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+
+struct DiffOptions {
+    uint64_t seed = 1;
+    int cases = 200;
+    uint64_t maxLines = 400;
+    int only = -1;         // Run just this case
+    bool verbose = false;
+};
+
+// Describes one case so a failure can be reproduced
+static std::string describeCase(int index, const CorpusSettings& corpus, const AppState& state) {
+    std::ostringstream text;
+    text << "case " << index << ": " << corpus.lines << " lines, corpus seed " << corpus.seed
+         << ", notes " << corpus.lowestNote << "-" << corpus.highestNote
+         << ", malformed " << corpus.malformedRate << ", " << state.transformationPercentage << "%, "
+         << (state.meter == DUPLE ? "duple" : "triple") << ", seed " << state.seed << ", variants";
+    if (state.selectedVariants.empty()) text << " RANDOM";
+    for (const std::string& code : state.selectedVariants) text << " " << code;
+    return text.str();
+}
+
+// Line number (from 1) of offset in text
+static size_t lineAt(const std::string& text, size_t offset) {
+    return static_cast<size_t>(std::count(text.begin(), text.begin() + offset, '\n')) + 1;
+}
+
+static std::string lineOf(const std::string& text, size_t offset) {
+    size_t start = text.rfind('\n', offset == 0 ? 0 : offset - 1);
+    start = start == std::string::npos || offset == 0 ? 0 : start + 1;
+    size_t end = text.find('\n', offset);
+    return text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+static std::string hexAround(const std::string& data, size_t offset) {
+    std::ostringstream hex;
+    size_t from = offset >= 8 ? offset - 8 : 0;
+    for (size_t i = from; i < std::min(data.size(), offset + 8); ++i) {
+        hex << (i == offset ? "[" : " ") << std::hex << std::setw(2) << std::setfill('0')
+            << static_cast<int>(static_cast<unsigned char>(data[i])) << (i == offset ? "]" : "");
+    }
+    return hex.str();
+}
+
+// Compare two outputs of the same kind; on a difference, print where it is
+// and return false
+static bool compareBytes(const std::string& what, const std::string& engine, const std::string& reference,
+                         bool isText) {
+    if (engine == reference) return true;
+    size_t offset = std::mismatch(engine.begin(), engine.begin() + std::min(engine.size(), reference.size()),
+                                  reference.begin()).first - engine.begin();
+    std::cerr << what << " differs at byte " << offset << " (engine " << engine.size() << " bytes, reference "
+              << reference.size() << " bytes)\n";
+    if (isText) {
+        std::cerr << "  line " << lineAt(reference, offset) << "\n"
+                  << "  engine:    '" << lineOf(engine, offset) << "'\n"
+                  << "  reference: '" << lineOf(reference, offset) << "'\n";
+    } else {
+        std::cerr << "  engine:   " << hexAround(engine, offset) << "\n"
+                  << "  reference:" << hexAround(reference, offset) << "\n";
+    }
+    return false;
+}
+
+static std::string describeNote(const ReferenceNote& note) {
+    std::ostringstream text;
+    text << "track " << note.track << ", note " << note.noteNumber << ", duration " << note.duration
+         << ", kind " << note.kind << ", variant " << note.variant;
+    return text.str();
+}
+
+// Notes of a binary record stream; false if the header is invalid
+static bool decodeRecords(const std::string& binary, std::vector<ReferenceNote>& notes) {
+    auto u32 = [&binary](size_t pos) {
+        uint32_t value = 0;
+        for (int i = 3; i >= 0; --i) value = (value << 8) | static_cast<unsigned char>(binary[pos + i]);
+        return value;
+    };
+    if (binary.size() < 12 || binary.compare(0, 4, "TRLB") != 0 || u32(4) != 1 ||
+        binary.size() != 12 + 12 * static_cast<size_t>(u32(8))) {
+        return false;
+    }
+    for (size_t pos = 12; pos < binary.size(); pos += 12) {
+        ReferenceNote note;
+        note.track = static_cast<int32_t>(u32(pos));
+        note.duration = static_cast<int32_t>(u32(pos + 4));
+        note.noteNumber = static_cast<unsigned char>(binary[pos + 8]);
+        note.kind = static_cast<unsigned char>(binary[pos + 9]);
+        note.variant = static_cast<unsigned char>(binary[pos + 10]) | static_cast<unsigned char>(binary[pos + 11]) << 8;
+        notes.push_back(note);
+    }
+    return true;
+}
+
+static bool compareNotes(const std::string& what, const std::string& binary,
+                         const std::vector<ReferenceNote>& reference) {
+    std::vector<ReferenceNote> engine;
+    if (!decodeRecords(binary, engine)) {
+        std::cerr << what << ": invalid binary record stream\n";
+        return false;
+    }
+    for (size_t i = 0; i < std::max(engine.size(), reference.size()); ++i) {
+        if (i < engine.size() && i < reference.size() && engine[i] == reference[i]) continue;
+        std::cerr << what << " differ at note " << i << " (engine " << engine.size() << " notes, reference "
+                  << reference.size() << " notes)\n"
+                  << "  engine:    " << (i < engine.size() ? describeNote(engine[i]) : "none") << "\n"
+                  << "  reference: " << (i < reference.size() ? describeNote(reference[i]) : "none") << "\n";
+        return false;
+    }
+    return true;
+}
+
+// applyTrill against the reference for every variant and meter over a grid
+// of pitches and durations, including the rejected ones
+static bool checkApplyTrill() {
+    std::vector<int> durations = {-1, 0};
+    for (int duration = 1; duration <= 48; ++duration) durations.push_back(duration);
+    for (int duration : {60, 95, 96, 120, 127, 240, 480, 959, 960, 1021, 100000}) durations.push_back(duration);
+    // Near misses of the code grammar must produce nothing, as unknown codes do
+    std::vector<std::string> codes = {"", "XTrQq9", "BTr", "BTrDes1", "CTrRn3", "BTrRn1x", "BTRRn1", "ATrAs1"};
+    for (const TrillVariant& variant : allTrillVariants()) codes.push_back(variant.code);
+
+    for (const std::string& code : codes) {
+        for (TimeMeter meter : {DUPLE, TRIPLE}) {
+            for (int pitch = 0; pitch <= 127; ++pitch) {
+                for (int duration : durations) {
+                    std::vector<std::pair<int, int>> engine, reference;
+                    bool engineThrew = false, referenceThrew = false;
+                    try {
+                        engine = applyTrill(pitch, duration, meter, code);
+                    } catch (const std::exception&) {
+                        engineThrew = true;
+                    }
+                    try {
+                        reference = referenceApplyTrill(pitch, duration, meter, code);
+                    } catch (const std::exception&) {
+                        referenceThrew = true;
+                    }
+                    if (engine == reference && engineThrew == referenceThrew) continue;
+
+                    std::cerr << "applyTrill(" << pitch << ", " << duration << ", "
+                              << (meter == DUPLE ? "DUPLE" : "TRIPLE") << ", \"" << code << "\") differs\n";
+                    for (const auto* side : {&engine, &reference}) {
+                        std::cerr << (side == &engine ? "  engine:   " : "  reference:");
+                        if (side == &engine ? engineThrew : referenceThrew) std::cerr << " throws";
+                        for (const auto& [note, length] : *side) std::cerr << " " << note << "/" << length;
+                        std::cerr << "\n";
+                    }
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Random corpus and settings of one case
+static void makeCase(std::mt19937_64& rng, const DiffOptions& options, CorpusSettings& corpus, AppState& state) {
+    auto uniform = [&rng](int low, int high) { return std::uniform_int_distribution<int>(low, high)(rng); };
+    auto unit = [&rng]() { return std::uniform_real_distribution<double>(0, 1)(rng); };
+
+    corpus.lines = std::uniform_int_distribution<uint64_t>(0, options.maxLines)(rng);
+    corpus.seed = rng();
+    corpus.tracks = uniform(1, 6);
+    corpus.lowestNote = uniform(12, 72);
+    corpus.highestNote = uniform(corpus.lowestNote, 127);
+    corpus.eligibleFraction = unit();
+    corpus.malformedRate = uniform(0, 2) == 0 ? 0 : unit() * 0.2;
+    if (uniform(0, 1) == 0) {
+        // Tiny, zero and negative durations as well as normal ones
+        corpus.durations.clear();
+        corpus.minDuration = uniform(-4, 8);
+        corpus.maxDuration = uniform(corpus.minDuration, 2000);
+    }
+    if (uniform(0, 4) == 0) {
+        // Labels the text table and MIDI reader treat specially
+        corpus.labels = {{"RLN", 4}, {"CS", 2}, {"DLP3", 1}, {"PED", 2}, {"RLN x", 1},
+                         {"MIDI File Analyzed", 1}, {"Note", 1}, {"rln", 1}};
+    }
+
+    int percentage = uniform(0, 3);
+    state.transformationPercentage = percentage == 0 ? 0 : percentage == 1 ? 100 : unit() * 100;
+    state.meter = uniform(0, 1) ? DUPLE : TRIPLE;
+    state.seed = rng();
+    state.selectedVariants.clear();
+    int selection = uniform(0, 3);
+    if (selection == 1) {
+        state.selectedVariants = {"RANDOM"};
+    } else if (selection >= 2) {
+        const std::vector<TrillVariant>& all = allTrillVariants();
+        for (int i = uniform(1, 5); i > 0; --i) {
+            state.selectedVariants.push_back(all[uniform(0, static_cast<int>(all.size()) - 1)].code);
+        }
+        if (selection == 3 && uniform(0, 3) == 0) {
+            state.selectedVariants.push_back("XTrQq9");  // Unknown codes transform to nothing
+        }
+    }
+}
+
+// Run one case through every engine path; false at the first difference
+static bool checkCase(const std::string& input, const AppState& settings, const std::filesystem::path& directory) {
+    ReferenceOutput reference = referenceTransform(input, settings);
+    std::string referenceMidi = referenceEncodeMidi(reference.text);
+
+    // In memory, every format at once
+    {
+        AppState state = settings;
+        std::string text, binary, midi;
+        transformBuffer(input, {&text, &binary, &midi}, state);
+        if (!compareBytes("transformBuffer text", text, reference.text, true) ||
+            !compareNotes("transformBuffer notes", binary, reference.notes) ||
+            !compareBytes("transformBuffer MIDI", midi, referenceMidi, false)) {
+            return false;
+        }
+
+        AppState encodeState;
+        std::string fromText, fromRecords;
+        encodeMidi(text, fromText, encodeState);
+        encodeMidiRecords({binary}, fromRecords, encodeState);
+        if (!compareBytes("encodeMidi", fromText, referenceMidi, false) ||
+            !compareBytes("encodeMidiRecords", fromRecords, referenceMidi, false)) {
+            return false;
+        }
+
+        // A dry run must predict the sizes of what was just written
+        ParsedTable table;
+        parseTable(input, table);
+        EstimatePiece piece{&table, &settings};
+        RunEstimate estimate;
+        estimateRun(&piece, 1, estimate);
+        const std::pair<const char*, std::pair<size_t, size_t>> sizes[] = {
+            {"text", {estimate.textBytes, text.size()}},
+            {"binary", {estimate.binaryBytes, binary.size()}},
+            {"MIDI", {estimate.midiBytes, midi.size()}},
+        };
+        for (const auto& [format, size] : sizes) {
+            if (size.first != size.second) {
+                std::cerr << "estimateRun " << format << " size differs: estimated " << size.first
+                          << ", written " << size.second << "\n";
+                return false;
+            }
+        }
+    }
+
+    // A sweep over the parsed table, next to a second configuration
+    {
+        ParsedTable table;
+        parseTable(input, table);
+        AppState state = settings, other = settings;
+        other.seed = settings.seed + 1;
+        std::string text, binary, midi, otherText;
+        SweepConfig configs[2] = {{&state, {&text, &binary, &midi}}, {&other, {&otherText, nullptr, nullptr}}};
+        transformSweep(table, configs, 2);
+        if (!compareBytes("transformSweep text", text, reference.text, true) ||
+            !compareNotes("transformSweep notes", binary, reference.notes) ||
+            !compareBytes("transformSweep MIDI", midi, referenceMidi, false) ||
+            !compareBytes("transformSweep text (second configuration)", otherText,
+                          referenceTransform(input, other).text, true)) {
+            return false;
+        }
+    }
+
+    // Pre-parsed notes: the reference sees the input without its malformed lines
+    {
+        std::vector<std::string> names, labels;
+        std::vector<NoteEntry> entries;
+        std::string noteLines;
+        std::istringstream lines(input);
+        std::string line;
+        while (std::getline(lines, line)) {
+            int track, duration;
+            std::string noteName, label;
+            if (referenceParseNoteLine(line, track, noteName, duration, label)) {
+                names.push_back(noteName);
+                labels.push_back(label);
+                entries.push_back({track, {}, duration, {}});
+                noteLines += line + "\n";
+            }
+        }
+        for (size_t i = 0; i < entries.size(); ++i) {
+            entries[i].noteName = names[i];
+            entries[i].label = labels[i];
+        }
+        AppState state = settings;
+        std::string text;
+        transformNotes(entries.data(), entries.size(), {&text, nullptr, nullptr}, state);
+        if (!compareBytes("transformNotes text", text, referenceTransform(noteLines, settings).text, true)) {
+            return false;
+        }
+    }
+
+    // Files, streamed in blocks
+    {
+        std::string inputPath = (directory / "input.txt").string();
+        std::string tablePath = (directory / "table.txt").string();
+        std::string midiPath = (directory / "table.mid").string();
+        std::ofstream(inputPath, std::ios::binary) << input;
+        AppState state = settings;
+        processFile(inputPath, tablePath, state);
+        convertToMidi(tablePath, midiPath, state);
+        std::ifstream tableFile(tablePath, std::ios::binary), midiFile(midiPath, std::ios::binary);
+        std::stringstream table, midi;
+        table << tableFile.rdbuf();
+        midi << midiFile.rdbuf();
+        if (!compareBytes("processFile", table.str(), reference.text, true) ||
+            !compareBytes("convertToMidi", midi.str(), referenceMidi, false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n\n"
+              << "Compares the engine with the reference implementation on randomized inputs.\n\n"
+              << "Options:\n"
+              << "  -s, --seed N            seed of the inputs and settings (default: 1)\n"
+              << "  -c, --cases N           number of random cases (default: 200)\n"
+              << "  -n, --lines N           most input lines per case (default: 400)\n"
+              << "      --only N            run only case N of the seed\n"
+              << "  -v, --verbose           describe every case\n"
+              << "  -h, --help              show this help\n";
+}
+
+int main(int argc, char* argv[]) {
+    DiffOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else if ((arg == "-s" || arg == "--seed") && hasValue) {
+                options.seed = std::stoull(argv[++i]);
+            } else if ((arg == "-c" || arg == "--cases") && hasValue) {
+                options.cases = std::stoi(argv[++i]);
+            } else if ((arg == "-n" || arg == "--lines") && hasValue) {
+                options.maxLines = std::stoull(argv[++i]);
+            } else if (arg == "--only" && hasValue) {
+                options.only = std::stoi(argv[++i]);
+            } else if (arg == "-v" || arg == "--verbose") {
+                options.verbose = true;
+            } else {
+                std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+                return 2;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    if (!checkApplyTrill()) {
+        return 1;
+    }
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path() /
+        ("trill-diff-" + std::to_string(options.seed) + "-" + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(directory);
+
+    std::mt19937_64 rng(options.seed);
+    bool passed = true;
+    int run = 0;
+    for (int index = 0; index < options.cases && passed; ++index) {
+        CorpusSettings corpus;
+        AppState settings;
+        makeCase(rng, options, corpus, settings);
+        if (options.only >= 0 && index != options.only) continue;
+
+        CorpusGenerator generator(corpus);
+        std::string input;
+        generator.fill(input, SIZE_MAX);
+        if (options.verbose) {
+            std::cerr << describeCase(index, corpus, settings) << "\n";
+        }
+        passed = checkCase(input, settings, directory);
+        if (!passed) {
+            std::cerr << "In " << describeCase(index, corpus, settings) << "\n"
+                      << "Reproduce with: " << argv[0] << " --seed " << options.seed << " --only " << index
+                      << " -n " << options.maxLines << std::endl;
+        }
+        ++run;
+    }
+
+    std::error_code ignored;
+    std::filesystem::remove_all(directory, ignored);
+    if (passed) {
+        std::cout << "trill-diff: applyTrill and " << run << " random cases match the reference (seed "
+                  << options.seed << ")" << std::endl;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// Trill Transformation Tool - Synthetic Corpus Generator
+// Builds as trill-gen: writes input tables ("Track NoteName Duration Label")
+// of any size for scale testing. The output is deterministic from the seed
+// and streamed in fixed-size buffers, so files larger than RAM are fine.
+
+#include "TrillCorpus.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <tuple>
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n\n"
+              << "Writes a synthetic input table for trill-cli and the GUI.\n\n"
+              << "Options:\n"
+              << "  -n, --lines N           number of lines; K, M and G suffixes accepted (default: 1000)\n"
+              << "  -t, --tracks N          tracks 0..N-1 (default: 4)\n"
+              << "      --notes LOW-HIGH    MIDI range of the notes (default: 36-95)\n"
+              << "  -e, --eligible F        fraction of eligible labels, 0-1 (default: 0.7)\n"
+              << "  -l, --labels LIST       labels and weights instead, e.g. RLN:3,CS:1,PED:2\n"
+              << "  -D, --durations LIST    durations and weights, e.g. 120:4,240:2,480:1\n"
+              << "                          or MIN-MAX for uniform durations\n"
+              << "                          (default: 60:1,120:4,240:4,480:2,960:1)\n"
+              << "      --malformed F       fraction of malformed lines, 0-1 (default: 0)\n"
+              << "  -s, --seed N            random seed (default: 1)\n"
+              << "  -o, --output FILE       write to FILE instead of stdout\n"
+              << "  -h, --help              show this help\n";
+}
+
+// "1000", "10K", "1M", "2G"
+static uint64_t parseCount(const std::string& text) {
+    uint64_t scale = 1;
+    std::string digits = text;
+    switch (digits.empty() ? 0 : digits.back()) {
+    case 'k': case 'K': scale = 1000ull; break;
+    case 'm': case 'M': scale = 1000000ull; break;
+    case 'g': case 'G': scale = 1000000000ull; break;
+    }
+    if (scale > 1) digits.pop_back();
+    return std::stoull(digits) * scale;
+}
+
+// "LOW-HIGH"; throws std::invalid_argument without a dash
+static std::pair<int, int> parseRange(const std::string& text) {
+    size_t dash = text.find('-', 1);
+    if (dash == std::string::npos) {
+        throw std::invalid_argument("Invalid range: " + text);
+    }
+    return {std::stoi(text.substr(0, dash)), std::stoi(text.substr(dash + 1))};
+}
+
+int main(int argc, char* argv[]) {
+    CorpusSettings settings;
+    std::string outputPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else if ((arg == "-n" || arg == "--lines") && hasValue) {
+                settings.lines = parseCount(argv[++i]);
+            } else if ((arg == "-t" || arg == "--tracks") && hasValue) {
+                settings.tracks = std::stoi(argv[++i]);
+            } else if (arg == "--notes" && hasValue) {
+                std::tie(settings.lowestNote, settings.highestNote) = parseRange(argv[++i]);
+            } else if ((arg == "-e" || arg == "--eligible") && hasValue) {
+                settings.eligibleFraction = std::stod(argv[++i]);
+            } else if ((arg == "-l" || arg == "--labels") && hasValue) {
+                settings.labels = parseWeightedList(argv[++i]);
+            } else if ((arg == "-D" || arg == "--durations") && hasValue) {
+                std::string list = argv[++i];
+                settings.durations.clear();
+                if (list.find(':') == std::string::npos && list.find('-', 1) != std::string::npos) {
+                    std::tie(settings.minDuration, settings.maxDuration) = parseRange(list);
+                } else {
+                    for (const auto& entry : parseWeightedList(list)) {
+                        settings.durations.push_back({std::stoi(entry.value), entry.weight});
+                    }
+                }
+            } else if (arg == "--malformed" && hasValue) {
+                settings.malformedRate = std::stod(argv[++i]);
+            } else if ((arg == "-s" || arg == "--seed") && hasValue) {
+                settings.seed = std::stoull(argv[++i]);
+            } else if ((arg == "-o" || arg == "--output") && hasValue) {
+                outputPath = argv[++i];
+            } else {
+                std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+                return 2;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return 2;
+        }
+    }
+    if (settings.tracks < 1 || settings.lowestNote < 12 || settings.highestNote > 127 ||
+        settings.lowestNote > settings.highestNote || settings.minDuration > settings.maxDuration) {
+        std::cerr << "Invalid settings: tracks must be positive, notes within 12-127 and ranges ascending" << std::endl;
+        return 2;
+    }
+
+    std::FILE* out = outputPath.empty() ? stdout : std::fopen(outputPath.c_str(), "wb");
+    if (out == nullptr) {
+        std::cerr << "Error opening output file: " << outputPath << std::endl;
+        return 1;
+    }
+    bool ok = writeCorpus(settings, out);
+    if (out != stdout) {
+        ok = std::fclose(out) == 0 && ok;
+    }
+    if (!ok) {
+        std::cerr << "Error writing output" << (outputPath.empty() ? "" : ": " + outputPath) << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,385 @@
+// Trill Transformation Tool - Live Streaming Entry Point
+// Builds as trill-live: reads timestamped notes from stdin or a FIFO (a
+// local stand-in for a MIDI input port), applies trills as the notes arrive
+// and writes the scheduled note-on/off events to stdout at their due time.
+//
+// Input lines:  <time ms> <track> <note name> <duration ms> [label]
+// Output lines: <time ms> on|off <track> <MIDI note> <velocity>
+//
+// Three threads share two lock-free rings: the reader parses lines into
+// notes, the transformer expands them into events, and the emitter orders
+// events in a fixed-size heap and writes each when it falls due. Nothing on
+// this path allocates; the tool counts heap allocations to prove it.
+
+#include "TrillStream.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <new>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+
+// Heap allocations are counted while g_countAllocations is set
+static std::atomic<bool> g_countAllocations{false};
+static std::atomic<long long> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    if (g_countAllocations.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+static std::atomic<bool> g_stop{false};
+
+static void onInterrupt(int) {
+    g_stop.store(true);
+}
+
+static uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Back off from a ring that is empty: yield a few times, then sleep briefly
+class Backoff {
+public:
+    void idle() {
+        if (++spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+    void reset() { spins = 0; }
+
+private:
+    int spins = 0;
+};
+
+// Shared state of the three stages
+struct LivePipeline {
+    SpscRing<LiveNote, 4096> notes;
+    SpscRing<LiveEvent, 65536> events;
+    std::atomic<bool> inputDone{false};
+    std::atomic<bool> expandDone{false};
+
+    // Counters; each is written by one stage only
+    long long notesIn = 0;
+    long long parseErrors = 0;
+    long long noteOverruns = 0;
+    long long trills = 0;
+    long long eventsQueued = 0;
+    long long eventOverruns = 0;
+    long long eventsOut = 0;
+    long long overBudget = 0;
+    uint64_t budgetNs = 1000000;
+    bool lossless = false;  // Replay: wait for ring space and budget processing time only
+    LatencyHistogram latency;     // Note read -> its events queued
+    LatencyHistogram processing;  // Note taken from the ring -> its events queued
+    LatencyHistogram lateness;    // Event due -> event written
+};
+
+// Parse "<time> <track> <note> <duration> [label]" without allocating
+static bool parseLiveNote(const char* begin, const char* end, LiveNote& note) {
+    const char* p = begin;
+    auto skipSpace = [&]() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p;
+    };
+    auto token = [&](const char*& start) {
+        skipSpace();
+        start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') ++p;
+        return static_cast<size_t>(p - start);
+    };
+    auto number = [&](auto& value) {
+        skipSpace();
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) return false;
+        p = result.ptr;
+        return true;
+    };
+
+    const char* name;
+    size_t nameLength;
+    if (!number(note.timeMs) || !number(note.track)) return false;
+    nameLength = token(name);
+    if (nameLength == 0 || !number(note.duration)) return false;
+
+    // Validate the name without the exception path of getNoteNumber
+    static const char* const names[] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    char octave = name[nameLength - 1];
+    if (nameLength < 2 || octave < '0' || octave > '9') return false;
+    int index = -1;
+    for (int i = 0; i < 12; ++i) {
+        if (std::strlen(names[i]) == nameLength - 1 && std::strncmp(names[i], name, nameLength - 1) == 0) {
+            index = i;
+        }
+    }
+    if (index < 0) return false;
+    note.noteNumber = (octave - '0' + 1) * 12 + index;
+
+    const char* label;
+    size_t labelLength = token(label);
+    if (labelLength >= sizeof(note.label)) labelLength = 0;  // Longer than any eligible label
+    std::memcpy(note.label, label, labelLength);
+    note.label[labelLength] = '\0';
+    return true;
+}
+
+// Read notes into the ring. Live input (paced) never blocks on a full ring
+// and drops instead; unpaced replay waits for room so no note is lost.
+static void readerStage(std::FILE* input, LivePipeline& pipeline, bool paced) {
+    char line[512];
+    Backoff backoff;
+    bool started = false;
+    int64_t originMs = 0;
+    uint64_t originNs = 0;
+    while (!g_stop.load(std::memory_order_relaxed) && std::fgets(line, sizeof(line), input)) {
+        LiveNote note;
+        size_t length = std::strlen(line);
+        if (length == 0 || line[0] == '#' || line[0] == '\n') continue;
+        if (!parseLiveNote(line, line + length, note)) {
+            ++pipeline.parseErrors;
+            continue;
+        }
+
+        // Release each note at its time, as a performer would play it
+        if (paced) {
+            if (!started) {
+                started = true;
+                originMs = note.timeMs;
+                originNs = nowNs();
+            }
+            uint64_t dueNs = originNs + static_cast<uint64_t>(std::max<int64_t>(0, note.timeMs - originMs)) * 1000000;
+            while (nowNs() < dueNs && !g_stop.load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<uint64_t>(dueNs - nowNs(), 1000000)));
+            }
+        }
+        note.arrivalNs = nowNs();
+        ++pipeline.notesIn;
+        while (!pipeline.notes.push(note)) {
+            if (paced) {
+                ++pipeline.noteOverruns;
+                break;
+            }
+            backoff.idle();
+        }
+        backoff.reset();
+    }
+    pipeline.inputDone.store(true, std::memory_order_release);
+}
+
+static void transformStage(TrillStreamer& streamer, LivePipeline& pipeline) {
+    LiveEvent expanded[TrillStreamer::kMaxEvents];
+    Backoff backoff;
+    for (;;) {
+        LiveNote note;
+        if (!pipeline.notes.pop(note)) {
+            if (pipeline.inputDone.load(std::memory_order_acquire) && pipeline.notes.empty()) break;
+            backoff.idle();
+            continue;
+        }
+        backoff.reset();
+        uint64_t startNs = nowNs();
+
+        bool trilled = false;
+        size_t count = streamer.expand(note, expanded, trilled);
+        pipeline.trills += trilled ? 1 : 0;
+        for (size_t i = 0; i < count; ++i) {
+            bool queued;
+            while (!(queued = pipeline.events.push(expanded[i])) && pipeline.lossless) {
+                backoff.idle();
+            }
+            backoff.reset();
+            ++(queued ? pipeline.eventsQueued : pipeline.eventOverruns);
+        }
+        uint64_t endNs = nowNs();
+        uint64_t latency = endNs - note.arrivalNs;
+        pipeline.latency.record(latency);
+        pipeline.processing.record(endNs - startNs);
+        pipeline.overBudget += (pipeline.lossless ? endNs - startNs : latency) > pipeline.budgetNs ? 1 : 0;
+    }
+    pipeline.expandDone.store(true, std::memory_order_release);
+}
+
+// Orders events by due time in a fixed-capacity heap and writes them out
+static void emitterStage(LivePipeline& pipeline, bool immediate) {
+    static LiveEvent heap[65536];
+    size_t heapSize = 0;
+    auto later = [](const LiveEvent& a, const LiveEvent& b) {
+        return a.timeMs > b.timeMs || (a.timeMs == b.timeMs && a.noteOn && !b.noteOn);
+    };
+
+    // Stream time zero is the first event's time, played from now
+    bool started = false;
+    int64_t originMs = 0;
+    uint64_t originNs = 0;
+    char text[64];
+    Backoff backoff;
+
+    for (;;) {
+        LiveEvent event;
+        while (heapSize < sizeof(heap) / sizeof(heap[0]) && pipeline.events.pop(event)) {
+            if (!started) {
+                started = true;
+                originMs = event.timeMs;
+                originNs = nowNs();
+            }
+            heap[heapSize++] = event;
+            std::push_heap(heap, heap + heapSize, later);
+        }
+
+        bool wrote = false;
+        while (heapSize > 0) {
+            uint64_t dueNs = originNs + static_cast<uint64_t>(std::max<int64_t>(0, heap[0].timeMs - originMs)) * 1000000;
+            uint64_t now = nowNs();
+            if (!immediate && now < dueNs && !g_stop.load(std::memory_order_relaxed)) break;
+            std::pop_heap(heap, heap + heapSize, later);
+            const LiveEvent& due = heap[--heapSize];
+            int length = std::snprintf(text, sizeof(text), "%lld %s %d %d %d\n",
+                                       static_cast<long long>(due.timeMs), due.noteOn ? "on" : "off",
+                                       due.track, due.noteNumber, due.velocity);
+            std::fwrite(text, 1, static_cast<size_t>(length), stdout);
+            if (!immediate) pipeline.lateness.record(now > dueNs ? now - dueNs : 0);
+            ++pipeline.eventsOut;
+            wrote = true;
+        }
+        if (wrote) {
+            std::fflush(stdout);
+            backoff.reset();
+            continue;
+        }
+        if (heapSize == 0 && pipeline.expandDone.load(std::memory_order_acquire) && pipeline.events.empty()) break;
+        backoff.idle();
+    }
+}
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [input]\n"
+              << "\n"
+              << "Reads '<time ms> <track> <note> <duration ms> [label]' lines from input (a file\n"
+              << "or FIFO; default stdin) and writes '<time ms> on|off <track> <note> <velocity>'.\n"
+              << "\n"
+              << "Options:\n"
+              << "  -p, --percentage N      percentage of eligible notes to transform (default: 50)\n"
+              << "  -v, --variant CODE      trill variant to use; repeat for several (default: RANDOM)\n"
+              << "  -m, --meter METER       duple or triple (default: duple)\n"
+              << "  -s, --seed N            random seed (default: 1)\n"
+              << "      --budget-us N       per-note latency budget in microseconds (default: 1000)\n"
+              << "      --immediate         read and write as fast as possible instead of at the\n"
+              << "                          notes' times, losing nothing (throughput test: the\n"
+              << "                          budget then applies to processing time)\n"
+              << "  -h, --help              show this help and exit\n";
+}
+
+int main(int argc, char* argv[]) {
+    AppState settings;
+    std::string inputPath;
+    bool immediate = false;
+    uint64_t budgetUs = 1000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else if (arg == "--immediate") {
+                immediate = true;
+            } else if ((arg == "-p" || arg == "--percentage") && hasValue) {
+                settings.transformationPercentage = std::stod(argv[++i]);
+            } else if ((arg == "-v" || arg == "--variant") && hasValue) {
+                settings.selectedVariants.push_back(argv[++i]);
+            } else if ((arg == "-m" || arg == "--meter") && hasValue) {
+                settings.meter = std::string(argv[++i]) == "triple" ? TRIPLE : DUPLE;
+            } else if ((arg == "-s" || arg == "--seed") && hasValue) {
+                settings.seed = std::stoull(argv[++i]);
+            } else if (arg == "--budget-us" && hasValue) {
+                budgetUs = std::stoull(argv[++i]);
+            } else if (arg.size() > 1 && arg[0] == '-') {
+                std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+                return 2;
+            } else {
+                inputPath = arg;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return 2;
+        }
+    }
+    for (const std::string& code : settings.selectedVariants) {
+        bool known = code == "RANDOM" && settings.selectedVariants.size() == 1;
+        for (const TrillVariant& variant : allTrillVariants()) {
+            known = known || variant.code == code;
+        }
+        if (!known) {
+            std::cerr << "Unknown trill variant: " << code << std::endl;
+            return 2;
+        }
+    }
+
+    std::FILE* input = inputPath.empty() ? stdin : std::fopen(inputPath.c_str(), "r");
+    if (input == nullptr) {
+        std::cerr << "Error opening input: " << inputPath << std::endl;
+        return 1;
+    }
+
+    // Fixed stdio buffers, so the streams never allocate one lazily
+    static char inputBuffer[1 << 16];
+    static char outputBuffer[1 << 16];
+    std::setvbuf(input, inputBuffer, _IOFBF, sizeof(inputBuffer));
+    std::setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    std::signal(SIGINT, onInterrupt);
+
+    // Everything is allocated before the stream starts
+    std::unique_ptr<LivePipeline> pipeline(new LivePipeline);
+    pipeline->budgetNs = budgetUs * 1000;
+    pipeline->lossless = immediate;
+    TrillStreamer streamer(settings);
+
+    std::thread transformer(transformStage, std::ref(streamer), std::ref(*pipeline));
+    std::thread emitter(emitterStage, std::ref(*pipeline), immediate);
+    g_countAllocations.store(true);
+    readerStage(input, *pipeline, !immediate);
+    transformer.join();
+    emitter.join();
+    g_countAllocations.store(false);
+    if (input != stdin) {
+        std::fclose(input);
+    }
+
+    const LivePipeline& p = *pipeline;
+    const char* budgeted = immediate ? "Processing time" : "Latency";
+    std::cerr << "Notes: " << p.notesIn << " in, " << p.trills << " trilled, " << p.parseErrors
+              << " unreadable, " << p.noteOverruns << " dropped\n"
+              << "Events: " << p.eventsOut << " written, " << p.eventOverruns << " dropped\n"
+              << "Latency (note read to events queued): " << p.latency.describe() << "\n"
+              << "Processing time per note: " << p.processing.describe() << "\n"
+              << budgeted << ": " << p.overBudget << " notes over the " << budgetUs << " us budget\n";
+    if (!immediate) {
+        std::cerr << "Emission lateness (due to written): " << p.lateness.describe() << "\n";
+    }
+    std::cerr << "Heap allocations while streaming: " << g_allocations.load() << std::endl;
+    return p.overBudget > 0 ? 3 : 0;
+}
@@ -0,0 +1,563 @@
+// Trill Transformation (C) 2025
+// Reference implementation of the engine, kept as the oracle for trill-diff.
+// See TrillReference.h; nothing here is tuned for speed.
+#include "TrillReference.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+using Segments = std::vector<std::pair<int, int>>;
+
+// Segment handlers of applyTrill, one per kind of trill
+static void handleMeterShortReg(Segments& EmbRet, int p1, int p2, int p3, int pi, int durPi, TimeMeter meter) {
+    if (meter == DUPLE) {
+        int segment = durPi / 4;
+        EmbRet.push_back({p1, segment});
+        EmbRet.push_back({p2, segment});
+        EmbRet.push_back({p1, segment});
+        EmbRet.push_back({p2, durPi - 3 * segment}); // Use remaining duration
+    } else if (meter == TRIPLE) {
+        int segment = durPi / 6;
+        for (int i = 0; i < 5; ++i) { // Alternate p1 and p2
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p2, durPi - 5 * segment}); // Remaining duration
+    }
+}
+
+static void handleMeterNormalReg(Segments& EmbRet, int p1, int p2, int p3, int p4, int p5, int pi, int durPi, TimeMeter meter) {
+    int segment = durPi / 8;
+    if (meter == DUPLE) {
+        for (int i = 0; i < 6; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p2, durPi - 6 * segment}); // Remaining duration
+    } else if (meter == TRIPLE) {
+        for (int i = 0; i < 6; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p2, durPi - 6 * segment}); // Remaining duration
+    }
+}
+
+static void handleMeterLongReg(Segments& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int pi, int durPi, TimeMeter meter) {
+    if (meter == DUPLE || meter == TRIPLE) {
+        int segment = durPi / 8;
+        for (int i = 0; i < 7; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p2, durPi - 7 * segment}); // Remaining duration
+    }
+}
+
+static void handleMeterDelayedNormal(Segments& EmbRet, int p1, int p2, int p3, int p4, int p5, int pi, int durPi, TimeMeter meter) {
+    if (meter == DUPLE) {
+        int segmentA = durPi / 4;
+        int segmentB = durPi / 8;
+        EmbRet.push_back({p1, segmentA});
+        EmbRet.push_back({p1, segmentB});
+        EmbRet.push_back({p2, segmentB});
+        EmbRet.push_back({p1, segmentB});
+        EmbRet.push_back({p2, segmentB});
+        EmbRet.push_back({p2, durPi - (segmentA + 4 * segmentB)}); // Remaining duration
+    } else if (meter == TRIPLE) {
+        int segmentA = durPi / 8;
+        EmbRet.push_back({p1, segmentA * 2}); // p1 at 1/4
+        for (int i = 0; i < 4; i++) {
+            EmbRet.push_back({i % 2 == 0 ? p2 : p1, segmentA});
+        }
+        EmbRet.push_back({p2, durPi - (segmentA * 6)}); // Remaining duration
+    }
+}
+
+static void handleMeterDelayedLong(Segments& EmbRet, int p1, int p2, int p3, int p4, int p5, int pi, int durPi, TimeMeter meter) {
+    if (meter == DUPLE || meter == TRIPLE) {
+        int segment = durPi / 8;
+        EmbRet.push_back({p1, segment * 2}); // 1/4 duration
+        for (int i = 0; i < 5; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p2 : p1, segment});
+        }
+        EmbRet.push_back({p2, durPi - 7 * segment}); // Remaining duration
+    }
+}
+
+static void handleMeterAscendingShort(Segments& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int durPi, TimeMeter meter) {
+    int segment = durPi / 8;
+    if (meter == DUPLE) {
+        for (int i = 0; i < 4; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p1, durPi / 4});
+        EmbRet.push_back({p2, durPi - (4 * segment + durPi / 4)}); // Remaining duration
+    } else if (meter == TRIPLE) {
+        for (int i = 0; i < 4; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p1, durPi / 6});
+        EmbRet.push_back({p2, durPi - (4 * segment + durPi / 6)}); // Remaining duration
+    }
+}
+
+static void handleMeterAscendingNormal(Segments& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int p8, int durPi, TimeMeter meter) {
+    if (meter == DUPLE) {
+        int segment = durPi / 8;
+        for (int i = 0; i < 7; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate p1 and p2
+        }
+        EmbRet.push_back({p2, durPi - 7 * segment}); // Remaining duration
+    } else if (meter == TRIPLE) {
+        int segment = durPi / 8;
+        for (int i = 0; i < 7; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate p1 and p2
+        }
+        EmbRet.push_back({p2, durPi - 7 * segment}); // Remaining duration
+    }
+}
+
+static void handleMeterTerminalShort(Segments& EmbRet, int p1, int p2, int p3, int pi, int durPi, TimeMeter meter) {
+    if (meter == DUPLE) {
+        int segment = durPi / 4;
+        EmbRet.push_back({p1, segment});
+        EmbRet.push_back({p2, segment});
+        EmbRet.push_back({p1, segment});
+        EmbRet.push_back({p2, durPi - 3 * segment}); // Remaining duration
+    } else if (meter == TRIPLE) {
+        int segment = durPi / 6;
+        for (int i = 0; i < 5; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p2, durPi - 5 * segment}); // Remaining duration
+    }
+}
+
+static void handleMeterAscendingLong(Segments& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int p8, int p9, int p10, int p11, int p12, int durPi, TimeMeter meter) {
+    if (meter == DUPLE) {
+        int segment = durPi / 16;
+        for (int i = 0; i < 15; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate between p1 and p2 for 15 segments
+        }
+        EmbRet.push_back({p2, durPi - 15 * segment}); // Remaining time for the last segment
+    } else if (meter == TRIPLE) {
+        int segment = durPi / 12;
+        for (int i = 0; i < 11; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate between p1 and p2 for 11 segments
+        }
+        EmbRet.push_back({p2, durPi - 11 * segment}); // Remaining time for the last segment
+    }
+}
+
+static void handleMeterTerminalNormal(Segments& EmbRet, int p1, int p2, int p3, int pi, int p4, int p5, int p6, int p7, int durPi, TimeMeter meter) {
+    if (meter == DUPLE) {
+        int segment = durPi / 8;
+        for (int i = 0; i < 7; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p2, durPi - 7 * segment});
+    } else if (meter == TRIPLE) {
+        int segment = durPi / 12;
+        for (int i = 0; i < 11; ++i) { // Alternate p1 and p2
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+        }
+        EmbRet.push_back({p2, durPi - 11 * segment}); // Remaining duration
+    }
+}
+
+static void handleMeterTerminalLong(Segments& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int p8, int p9, int p10, int p11, int p12, int p13, int p14, int p15, int p16, int durPi, TimeMeter meter) {
+    if (meter == DUPLE) {
+        int segment = durPi / 16;
+        for (int i = 0; i < 15; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate p1 and p2
+        }
+        EmbRet.push_back({p2, durPi - 15 * segment}); // Remaining duration
+    } else if (meter == TRIPLE) {
+        int segment = durPi / 12;
+        for (int i = 0; i < 11; ++i) {
+            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate p1 and p2
+        }
+        EmbRet.push_back({p2, durPi - 11 * segment}); // Remaining duration
+    }
+}
+
+
+std::vector<std::pair<int, int>> referenceApplyTrill(int pi, int durPi, TimeMeter meter, const std::string& variant) {
+    Segments EmbRet;
+    if (durPi <= 0) {
+        throw std::invalid_argument("Duration (durPi) must be greater than 0");
+    }
+    if (meter != DUPLE && meter != TRIPLE) {
+        throw std::invalid_argument("Invalid TimeMeter");
+    }
+
+    EmbRet.clear();
+    
+    // Short Reg Trills - Baroque and Classical
+    if (variant == "BTrRs1") {
+        handleMeterShortReg(EmbRet, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrRs5") {
+        handleMeterShortReg(EmbRet, pi + 1, pi, pi + 1, pi, durPi, meter);
+    } else if (variant == "CTrRs1") {
+        handleMeterShortReg(EmbRet, pi, pi + 2, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrRs5") {
+        handleMeterShortReg(EmbRet, pi, pi + 1, pi, pi + 1, durPi, meter);
+    }
+    
+    // Normal Reg Trills - Baroque and Classical
+    else if (variant == "BTrRn1") {
+        handleMeterNormalReg(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrRn5") {
+        handleMeterNormalReg(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, durPi, meter);
+    } else if (variant == "CTrRn1") {
+        handleMeterNormalReg(EmbRet, pi, pi + 5, pi, pi + 5, pi, pi + 5, durPi, meter);
+    } else if (variant == "CTrRn5") {
+        handleMeterNormalReg(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, durPi, meter);
+    }
+    
+    // Long Reg Trills - Baroque and Classical
+    else if (variant == "BTrRl1") {
+        handleMeterLongReg(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrRl5") {
+        handleMeterLongReg(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, durPi, meter);
+    } else if (variant == "CTrRl1") {
+        handleMeterLongReg(EmbRet, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrRl5") {
+        handleMeterLongReg(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, durPi, meter);
+    }
+    
+    // Delayed Normal Trills - Baroque and Classical
+    else if (variant == "BTrDen1") {
+        handleMeterDelayedNormal(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrDen5") {
+        handleMeterDelayedNormal(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, durPi, meter);
+    } else if (variant == "CTrDen1") {
+        handleMeterDelayedNormal(EmbRet, pi, pi + 5, pi, pi + 5, pi, pi + 5, durPi, meter);
+    } else if (variant == "CTrDen5") {
+        handleMeterDelayedNormal(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, durPi, meter);
+    }
+    
+    // Delayed Long Trills - Baroque and Classical
+    else if (variant == "BTrDel1") {
+        handleMeterDelayedLong(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrDel5") {
+        handleMeterDelayedLong(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, durPi, meter);
+    } else if (variant == "CTrDel1") {
+        handleMeterDelayedLong(EmbRet, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrDel5") {
+        handleMeterDelayedLong(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, durPi, meter);
+    }
+    
+    // Ascending Short Trills - Baroque and Classical
+    else if (variant == "BTrAs1") {
+        handleMeterAscendingShort(EmbRet, pi - 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrAs5") {
+        handleMeterAscendingShort(EmbRet, pi - 1, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "CTrAs1") {
+        handleMeterAscendingShort(EmbRet, pi - 2, pi, pi + 2, pi, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrAs5") {
+        handleMeterAscendingShort(EmbRet, pi - 1, pi, pi + 2, pi, pi, pi + 2, durPi, meter);
+    }
+    
+    // Ascending Normal Trills - Baroque and Classical
+    else if (variant == "BTrAn1") {
+        handleMeterAscendingNormal(EmbRet, pi - 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrAn5") {
+        handleMeterAscendingNormal(EmbRet, pi - 1, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "CTrAn1") {
+        handleMeterAscendingNormal(EmbRet, pi - 2, pi, pi + 2, pi, pi, pi + 2, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrAn5") {
+        handleMeterAscendingNormal(EmbRet, pi - 1, pi, pi + 2, pi, pi, pi + 2, pi, pi + 2, durPi, meter);
+    }
+    
+    // Ascending Long Trills - Baroque and Classical
+    else if (variant == "BTrAl1") {
+        handleMeterAscendingLong(EmbRet, pi - 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrAl5") {
+        handleMeterAscendingLong(EmbRet, pi - 1, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "CTrAl1") {
+        handleMeterAscendingLong(EmbRet, pi - 2, pi, pi + 2, pi, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrAl5") {
+        handleMeterAscendingLong(EmbRet, pi - 1, pi, pi + 2, pi, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
+    }
+    
+    // Descending Short Trills - Baroque and Classical
+    else if (variant == "BTrDs1") {
+        handleMeterAscendingShort(EmbRet, pi + 2, pi, pi - 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrDs5") {
+        handleMeterAscendingShort(EmbRet, pi + 1, pi, pi - 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "CTrDs1") {
+        handleMeterAscendingShort(EmbRet, pi + 2, pi, pi - 2, pi, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrDs5") {
+        handleMeterAscendingShort(EmbRet, pi + 1, pi, pi - 2, pi, pi, pi + 2, durPi, meter);
+    }
+    
+    // Descending Normal Trills - Baroque and Classical
+    else if (variant == "BTrDn1") {
+        handleMeterAscendingNormal(EmbRet, pi + 2, pi, pi - 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrDn5") {
+        handleMeterAscendingNormal(EmbRet, pi + 1, pi, pi - 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "CTrDn1") {
+        handleMeterAscendingNormal(EmbRet, pi + 2, pi, pi - 2, pi, pi, pi + 2, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrDn5") {
+        handleMeterAscendingNormal(EmbRet, pi + 1, pi, pi - 2, pi, pi, pi + 2, pi, pi + 2, durPi, meter);
+    }
+    
+    // Descending Long Trills - Baroque and Classical
+    else if (variant == "BTrDl1") {
+        handleMeterAscendingLong(EmbRet, pi + 2, pi, pi - 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "BTrDl5") {
+        handleMeterAscendingLong(EmbRet, pi + 1, pi, pi - 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
+    } else if (variant == "CTrDl1") {
+        handleMeterAscendingLong(EmbRet, pi + 2, pi, pi - 2, pi, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
+    } else if (variant == "CTrDl5") {
+        handleMeterAscendingLong(EmbRet, pi + 1, pi, pi - 2, pi, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
+    }
+    
+    // Terminal Short Trills - Baroque and Classical
+    else if (variant == "BTrTs1") {
+        handleMeterTerminalShort(EmbRet, pi + 2, pi, pi - 2, pi, durPi, meter);
+    } else if (variant == "BTrTs5") {
+        handleMeterTerminalShort(EmbRet, pi + 1, pi, pi - 2, pi, durPi, meter);
+    } else if (variant == "CTrTs1") {
+        handleMeterTerminalShort(EmbRet, pi + 2, pi, pi - 2, pi, durPi, meter);
+    } else if (variant == "CTrTs5") {
+        handleMeterTerminalShort(EmbRet, pi + 1, pi, pi - 2, pi, durPi, meter);
+    }
+    
+    // Terminal Normal Trills - Baroque and Classical
+    else if (variant == "BTrTn1") {
+        handleMeterTerminalNormal(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi - 2, pi, durPi, meter);
+    } else if (variant == "BTrTn5") {
+        handleMeterTerminalNormal(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi - 2, pi, durPi, meter);
+    } else if (variant == "CTrTn1") {
+        handleMeterTerminalNormal(EmbRet, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi - 2, pi, durPi, meter);
+    } else if (variant == "CTrTn5") {
+        handleMeterTerminalNormal(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi - 2, pi, durPi, meter);
+    }
+    
+    // Terminal Long Trills - Baroque and Classical
+    else if (variant == "BTrTl1") {
+        handleMeterTerminalLong(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi - 2, pi, durPi, meter);
+    } else if (variant == "BTrTl5") {
+        handleMeterTerminalLong(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi - 2, pi, durPi, meter);
+    } else if (variant == "CTrTl1") {
+        handleMeterTerminalLong(EmbRet, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi - 2, pi, durPi, meter);
+    } else if (variant == "CTrTl5") {
+        handleMeterTerminalLong(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi - 2, pi, durPi, meter);
+    }
+    return EmbRet;
+}
+
+bool referenceParseNoteLine(const std::string& line, int& track, std::string& noteName, int& duration,
+                            std::string& label) {
+    size_t pos = 0;
+    auto skipSpace = [&]() {
+        while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) ++pos;
+    };
+    auto parseInt = [&](int& value) {
+        skipSpace();
+        if (pos < line.size() && line[pos] == '+') ++pos;
+        auto result = std::from_chars(line.data() + pos, line.data() + line.size(), value);
+        if (result.ec != std::errc()) return false;
+        pos = result.ptr - line.data();
+        return true;
+    };
+
+    if (!parseInt(track)) return false;
+    skipSpace();
+    size_t nameStart = pos;
+    while (pos < line.size() && !std::isspace(static_cast<unsigned char>(line[pos]))) ++pos;
+    if (pos == nameStart) return false;
+    noteName = line.substr(nameStart, pos - nameStart);
+    if (!parseInt(duration)) return false;
+
+    // Trim leading blanks and trailing blanks and line endings
+    label = line.substr(pos);
+    label.erase(0, label.find_first_not_of(" \t"));
+    label.erase(label.find_last_not_of(" \t\r\n") + 1);
+    return true;
+}
+
+static bool isReferenceEligible(const std::string& label) {
+    static const std::vector<std::string> labels = {
+        "RLN", "CS", "I3", "I8", "U2R", "BM", "SPU", "SPD", "CH", "CW", "CD",
+        "HT", "FM", "RN", "LAD", "DN", "DNW", "SN", "LNSN", "SAN", "SMP", "DLP3"
+    };
+    return std::find(labels.begin(), labels.end(), label) != labels.end();
+}
+
+static int referenceVariantIndex(const std::string& code) {
+    const std::vector<TrillVariant>& table = allTrillVariants();
+    for (size_t i = 0; i < table.size(); ++i) {
+        if (table[i].code == code) return static_cast<int>(i);
+    }
+    return 0xFFFF;
+}
+
+// The row's note as convertToMidi would read it back from the text table;
+// false for rows it skips
+static bool referenceMidiNote(int track, const std::string& noteName, const std::string& label, int& noteNumber) {
+    if (track < 0 || noteName == "Note" || noteName == "Track" ||
+        label.find("MIDI File Analyzed") != std::string::npos) {
+        return false;
+    }
+    try {
+        noteNumber = getNoteNumber(noteName);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return noteNumber <= 127;
+}
+
+static void referenceRow(ReferenceOutput& out, int track, const std::string& noteName, int duration,
+                         const std::string& label, const std::string& variant, int kind) {
+    std::ostringstream row;
+    row << std::left
+        << std::setw(11) << track
+        << std::setw(11) << noteName
+        << std::setw(20) << duration
+        << std::setw(20) << label
+        << std::setw(25) << variant
+        << "\n";
+    out.text += row.str();
+
+    int noteNumber;
+    if (referenceMidiNote(track, noteName, label, noteNumber)) {
+        out.notes.push_back({track, duration, noteNumber, kind, kind == 2 ? referenceVariantIndex(variant) : 0xFFFF});
+    }
+}
+
+ReferenceOutput referenceTransform(const std::string& input, const AppState& state) {
+    ReferenceOutput out;
+    std::ostringstream header;
+    header << std::left << std::setw(11) << "Track"
+           << std::setw(11) << "Note"
+           << std::setw(20) << "Duration"
+           << std::setw(20) << "Label"
+           << std::setw(25) << "Trill_Variant"
+           << "\n";
+    header << "---------------------------------------------------------------------------------\n";
+    out.text = header.str();
+
+    std::mt19937_64 rng(state.seed);
+    bool randomVariant = state.selectedVariants.empty() ||
+        (state.selectedVariants.size() == 1 && state.selectedVariants[0] == "RANDOM");
+
+    std::istringstream lines(input);
+    std::string line;
+    while (std::getline(lines, line)) {
+        int track, duration;
+        std::string noteName, label;
+        if (!referenceParseNoteLine(line, track, noteName, duration, label)) {
+            out.text += line + "\n";
+            continue;
+        }
+        if (!isReferenceEligible(label)) {
+            referenceRow(out, track, noteName, duration, label, "", 0);
+            continue;
+        }
+
+        // Uniform in [0, 100) from the top 53 bits of the generator
+        double randomValue = static_cast<double>(rng() >> 11) / 9007199254740992.0 * 100.0;
+        if (!(randomValue < state.transformationPercentage)) {
+            referenceRow(out, track, noteName, duration, label, "ORIGINAL", 1);
+            continue;
+        }
+
+        int noteIndex;
+        try {
+            noteIndex = getNoteNumber(noteName);
+        } catch (const std::exception&) {
+            continue;  // Reported by the engine, no output
+        }
+        std::string variant;
+        if (randomVariant) {
+            variant = (*state.variantTable)[rng() % state.variantTable->size()].code;
+        } else {
+            variant = state.selectedVariants[rng() % state.selectedVariants.size()];
+        }
+        Segments transformed;
+        try {
+            transformed = referenceApplyTrill(noteIndex, duration, state.meter, variant);
+        } catch (const std::exception&) {
+            continue;
+        }
+        for (const auto& [transformedNote, transformedDuration] : transformed) {
+            referenceRow(out, track, getNoteName(transformedNote), transformedDuration, label, variant, 2);
+        }
+    }
+    return out;
+}
+
+static void appendBigEndian(std::string& out, uint32_t value, int bytes) {
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+std::string referenceEncodeMidi(const std::string& textTable) {
+    // Events of each track as (tick, note-on, note, velocity): sorted, note-offs
+    // come first at equal ticks
+    using Event = std::tuple<int, bool, int, int>;
+    std::map<int, std::vector<Event>> trackEvents;
+    std::map<int, int> trackPositions;
+
+    std::istringstream lines(textTable);
+    std::string line;
+    std::getline(lines, line);  // Column headers
+    std::getline(lines, line);  // Separator
+    while (std::getline(lines, line)) {
+        if (line.empty() || line[0] == '-' || line.find("MIDI File Analyzed") != std::string::npos) {
+            continue;
+        }
+        int track, duration, noteNumber;
+        std::string noteName, label;
+        if (!referenceParseNoteLine(line, track, noteName, duration, label) ||
+            !referenceMidiNote(track, noteName, label, noteNumber)) {
+            continue;
+        }
+        int& position = trackPositions[track];
+        trackEvents[track].push_back({position, true, noteNumber, 0x64});
+        trackEvents[track].push_back({position + duration, false, noteNumber, 0});
+        position += duration;
+    }
+
+    std::string smf = "MThd";
+    appendBigEndian(smf, 6, 4);
+    appendBigEndian(smf, 1, 2);
+    appendBigEndian(smf, static_cast<uint32_t>(trackEvents.size()), 2);
+    appendBigEndian(smf, 1024, 2);
+
+    for (auto& [trackNumber, events] : trackEvents) {
+        std::sort(events.begin(), events.end());
+        std::string track;
+        track += std::string("\x00\xC0\x00", 3);  // Program change to piano
+        int lastTime = 0;
+        for (const auto& [tick, isNoteOn, noteNumber, velocity] : events) {
+            // Variable-length delta time; a negative delta writes no bytes
+            int deltaTime = tick - lastTime;
+            lastTime = tick;
+            std::string vlq;
+            if (deltaTime == 0) {
+                vlq.push_back(0);
+            }
+            while (deltaTime > 0) {
+                vlq.insert(vlq.begin(), static_cast<char>((deltaTime & 0x7F) | (vlq.empty() ? 0 : 0x80)));
+                deltaTime >>= 7;
+            }
+            track += vlq;
+            track.push_back(static_cast<char>(isNoteOn ? 0x90 : 0x80));
+            track.push_back(static_cast<char>(noteNumber));
+            track.push_back(static_cast<char>(velocity));
+        }
+        track += std::string("\x00\xFF\x2F\x00", 4);  // End of track
+        smf += "MTrk";
+        appendBigEndian(smf, static_cast<uint32_t>(track.size()), 4);
+        smf += track;
+    }
+    return smf;
+}
@@ -0,0 +1,53 @@
+// Trill Transformation (C) 2025
+// Reference implementation of the engine, kept as the oracle for trill-diff.
+//
+// Every function here gives the results the engine gives, written as
+// plainly as possible: one line at a time, std::string and stream
+// formatting, no arenas, buffers or lookup tables. Optimized paths in
+// trillcore must match it byte for byte; change it only together with a
+// deliberate change in behaviour.
+#ifndef TRILL_REFERENCE_H
+#define TRILL_REFERENCE_H
+
+#include "TrillTransformation.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// One note as the engine's binary records describe it (see TransformBuffers)
+struct ReferenceNote {
+    int track = 0;
+    int duration = 0;
+    int noteNumber = 0;
+    int kind = 0;           // 0 unlabelled, 1 original, 2 trill
+    int variant = 0xFFFF;   // Index into allTrillVariants(), 0xFFFF for none
+
+    bool operator==(const ReferenceNote& other) const {
+        return track == other.track && duration == other.duration && noteNumber == other.noteNumber &&
+               kind == other.kind && variant == other.variant;
+    }
+    bool operator!=(const ReferenceNote& other) const { return !(*this == other); }
+};
+
+// Text table and notes of one transformation
+struct ReferenceOutput {
+    std::string text;
+    std::vector<ReferenceNote> notes;
+};
+
+// applyTrill: one explicit branch per variant code
+std::vector<std::pair<int, int>> referenceApplyTrill(int pi, int durPi, TimeMeter meter, const std::string& variant);
+
+// Parse "Track NoteName Duration [Label]"; false for malformed lines
+bool referenceParseNoteLine(const std::string& line, int& track, std::string& noteName, int& duration,
+                            std::string& label);
+
+// Transform input under the settings of state (percentage, variants, meter,
+// seed and variant table), as processFile and transformBuffer do
+ReferenceOutput referenceTransform(const std::string& input, const AppState& state);
+
+// The Standard MIDI File convertToMidi writes for a text table
+std::string referenceEncodeMidi(const std::string& textTable);
+
+#endif // TRILL_REFERENCE_H
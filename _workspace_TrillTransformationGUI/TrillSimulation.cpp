@@ -0,0 +1,369 @@
+// Trill Transformation (C) 2025
+// Outcome statistics of many seeds without producing any output.
+
+#include "TrillSimulation.h"
+
+#include <algorithm>
+#include <charconv>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+// Bytes of a text table field: the value padded to at least width columns
+// (the widths of TransformRun::row)
+static uint32_t fieldBytes(size_t length, size_t width) {
+    return static_cast<uint32_t>(std::max(length, width));
+}
+
+static size_t digits(int value) {
+    char text[16];
+    return static_cast<size_t>(std::to_chars(text, text + sizeof(text), value).ptr - text);
+}
+
+// Variants in the order the variant draw of a run indexes them
+static std::vector<const std::string*> variantDraws(const AppState& settings) {
+    std::vector<const std::string*> draws;
+    bool randomVariant = settings.selectedVariants.empty() ||
+        (settings.selectedVariants.size() == 1 && settings.selectedVariants[0] == "RANDOM");
+    if (randomVariant) {
+        for (const TrillVariant& variant : *settings.variantTable) {
+            draws.push_back(&variant.code);
+        }
+    } else {
+        for (const std::string& code : settings.selectedVariants) {
+            draws.push_back(&code);
+        }
+    }
+    return draws;
+}
+
+// Variant ID of a code: its position in the built-in table
+static size_t variantId(const std::string& code) {
+    const std::vector<TrillVariant>& variants = allTrillVariants();
+    for (size_t id = 0; id < variants.size(); ++id) {
+        if (variants[id].code == code) return id;
+    }
+    return RunStatistics::kVariants;
+}
+
+// Size of the text table header, measured from the engine itself
+static size_t textHeaderBytes() {
+    std::string header;
+    AppState empty;
+    TransformBuffers buffers;
+    buffers.text = &header;
+    transformNotes(nullptr, 0, buffers, empty);
+    return header.size();
+}
+
+RunSimulator::RunSimulator(const ParsedTable& table, const AppState& settings)
+    : percentage(settings.transformationPercentage) {
+    std::vector<const std::string*> draws = variantDraws(settings);
+    for (const std::string* code : draws) {
+        auto found = std::find(codes.begin(), codes.end(), *code);
+        drawCode.push_back(static_cast<uint32_t>(found - codes.begin()));
+        if (found == codes.end()) {
+            codes.push_back(*code);
+        }
+        variantBytes.push_back(fieldBytes(code->size(), 25));
+    }
+
+    fixedBytes = textHeaderBytes();
+
+    std::unordered_map<uint64_t, uint32_t> pairs;
+    TrillSegments segments;
+    for (const ParsedTable::Row& row : table.rows) {
+        if (!row.isNote) {
+            ++fixedRows;
+            fixedBytes += row.line.size() + 1;
+            continue;
+        }
+        uint32_t shared = fieldBytes(digits(row.track), 11) + fieldBytes(row.label.size(), 20) + 1;
+        uint32_t original = shared + fieldBytes(row.noteName.size(), 11) + fieldBytes(digits(row.duration), 20) +
+                            fieldBytes(0, 25);
+        if (!isEligibleLabel(row.label)) {
+            ++fixedRows;
+            fixedBytes += original;
+            continue;
+        }
+        ++eligible;
+
+        EligibleRow eligibleRow{kNoPair, shared, original};
+        if (row.noteNumber >= 0) {
+            uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(row.noteNumber)) << 32) |
+                           static_cast<uint32_t>(row.duration);
+            auto [entry, added] = pairs.emplace(key, static_cast<uint32_t>(pairs.size()));
+            eligibleRow.pair = entry->second;
+
+            // First time this pitch and duration occur: resolve every variant
+            for (size_t draw = 0; added && draw < draws.size(); ++draw) {
+                Trill trill;
+                try {
+                    applyTrill(row.noteNumber, row.duration, settings.meter, *draws[draw], segments);
+                    trill.rows = static_cast<uint32_t>(segments.size());
+                    for (const auto& [noteNumber, duration] : segments) {
+                        trill.bytes += fieldBytes(getNoteName(noteNumber).size(), 11) + fieldBytes(digits(duration), 20);
+                    }
+                } catch (const std::exception&) {
+                    trill.failed = true;
+                }
+                trills.push_back(trill);
+            }
+        }
+        rows.push_back(eligibleRow);
+    }
+}
+
+void RunSimulator::simulate(uint64_t seed, SeedOutcome& outcome) const {
+    std::mt19937_64 rng(seed);
+    size_t draws = drawCode.size();
+    outcome.seed = seed;
+    outcome.transformedNotes = 0;
+    outcome.outputRows = fixedRows;
+    outcome.textBytes = fixedBytes;
+    outcome.variantUsage.assign(codes.size(), 0);
+
+    // The same draws, in the same order, as TransformRun::transformNote
+    for (const EligibleRow& row : rows) {
+        if (!shouldTransformLabel(percentage, rng)) {
+            ++outcome.outputRows;
+            outcome.textBytes += row.originalBytes;
+            continue;
+        }
+        ++outcome.transformedNotes;
+        if (row.pair == kNoPair) continue;  // Invalid name: reported, nothing drawn
+
+        size_t draw = uniformIndex(rng, draws);
+        const Trill& trill = trills[row.pair * draws + draw];
+        if (trill.failed) continue;
+        ++outcome.variantUsage[drawCode[draw]];
+        outcome.outputRows += trill.rows;
+        outcome.textBytes += static_cast<size_t>(trill.rows) * (row.rowBytes + variantBytes[draw]) + trill.bytes;
+    }
+}
+
+// Bytes of a MIDI variable-length delta time, as MidiWriter::encode writes it
+// (a negative delta writes nothing)
+static size_t deltaBytes(int delta) {
+    if (delta == 0) return 1;
+    size_t bytes = 0;
+    for (; delta > 0; delta >>= 7) ++bytes;
+    return bytes;
+}
+
+// Capacity a doubling buffer reaches to hold size bytes
+static size_t grownCapacity(size_t size) {
+    size_t capacity = 1;
+    while (capacity < size) capacity <<= 1;
+    return size ? capacity : 0;
+}
+
+// Rows that carry no note for MIDI (MidiWriter::skipsRow)
+static bool skipsMidiRow(int track, std::string_view noteName, std::string_view label) {
+    return track < 0 || noteName == "Note" || noteName == "Track" ||
+           label.find("MIDI File Analyzed") != std::string_view::npos;
+}
+
+namespace {
+
+// MIDI bytes of one track as its notes arrive. Notes in a track follow one
+// another, so while no duration is negative the events stay in input order:
+// each note adds a note-on with delta 0, a note-off whose delta is the
+// duration, and 3 bytes of event each. A track with a negative duration
+// keeps its ticks and is measured after sorting, as the encoder sorts it.
+struct TrackTally {
+    size_t notes = 0;
+    size_t eventBytes = 0;
+    int position = 0;
+    bool sorted = true;
+    std::vector<int> ticks;
+
+    void add(int duration) {
+        ++notes;
+        if (sorted) {
+            eventBytes += 6 + 1 + (duration > 0 ? deltaBytes(duration) : 1);
+        } else {
+            ticks.push_back(position);
+            ticks.push_back(position + duration);
+        }
+        position += duration;
+    }
+
+    size_t midiBytes() {
+        if (!sorted) {
+            std::sort(ticks.begin(), ticks.end());
+            int last = 0;
+            for (int tick : ticks) {
+                eventBytes += 3 + deltaBytes(tick - last);
+                last = tick;
+            }
+        }
+        // MTrk, length, program change, events, end of track
+        return 8 + 3 + eventBytes + 4;
+    }
+};
+
+// Trill of one pitch and duration under one variant, reduced to its sizes
+struct TrillTally {
+    bool failed = false;
+    uint32_t rows = 0;
+    uint32_t bytes = 0;        // Note and duration fields of all rows
+    uint32_t midiNotes = 0;    // Segments within the MIDI range
+    uint32_t midiErrors = 0;   // Segments outside it
+    uint32_t eventBytes = 0;   // Event bytes of the MIDI notes in a sorted track
+    int advance = 0;           // Track position the MIDI notes move on
+};
+
+}  // namespace
+
+void estimateRun(const EstimatePiece* pieces, size_t count, RunEstimate& estimate) {
+    estimate = RunEstimate();
+    estimate.textBytes = textHeaderBytes();
+    RunStatistics& statistics = estimate.statistics;
+
+    // Tracks whose position moves back: inputs may carry negative durations,
+    // trills never do (applyTrill rejects them and splits positive ones)
+    std::set<int> unsorted;
+    for (size_t i = 0; i < count; ++i) {
+        for (const ParsedTable::Row& row : pieces[i].table->rows) {
+            if (row.isNote && row.duration < 0 && !skipsMidiRow(row.track, row.noteName, row.label)) {
+                unsorted.insert(row.track);
+            }
+        }
+    }
+
+    std::map<int, TrackTally> tracks;
+    int lastTrack = 0;
+    TrackTally* lastTally = nullptr;
+    auto trackTally = [&](int track) -> TrackTally& {
+        if (lastTally == nullptr || lastTrack != track) {
+            auto [entry, added] = tracks.emplace(track, TrackTally());
+            if (added) entry->second.sorted = unsorted.count(track) == 0;
+            lastTrack = track;
+            lastTally = &entry->second;
+        }
+        return *lastTally;
+    };
+
+    // A row left as it was: its text, and its note for MIDI
+    auto plainRow = [&](const ParsedTable::Row& row, size_t variantLength) {
+        ++estimate.outputRows;
+        estimate.textBytes += fieldBytes(digits(row.track), 11) + fieldBytes(row.noteName.size(), 11) +
+                              fieldBytes(digits(row.duration), 20) + fieldBytes(row.label.size(), 20) +
+                              fieldBytes(variantLength, 25) + 1;
+        if (skipsMidiRow(row.track, row.noteName, row.label)) return;
+        if (row.noteNumber < 0 || row.noteNumber > 127) {
+            ++estimate.midiErrors;
+            return;
+        }
+        trackTally(row.track).add(row.duration);
+    };
+
+    std::unordered_map<uint64_t, TrillTally> trills;
+    TrillSegments segments;
+    for (size_t i = 0; i < count; ++i) {
+        const AppState& settings = *pieces[i].settings;
+        std::vector<const std::string*> draws = variantDraws(settings);
+        std::vector<size_t> drawIds;
+        for (const std::string* code : draws) {
+            drawIds.push_back(variantId(*code));
+        }
+        std::mt19937_64 rng(settings.seed);
+
+        for (const ParsedTable::Row& row : pieces[i].table->rows) {
+            if (!row.isNote) {
+                ++estimate.outputRows;
+                estimate.textBytes += row.line.size() + 1;
+                continue;
+            }
+            RunStatistics::TrackCounts& trackCounts = statistics.trackCounts(row.track);
+            trackCounts.notes++;
+            size_t label = labelId(row.label);
+            if (label >= RunStatistics::kLabels) {
+                plainRow(row, 0);
+                continue;
+            }
+            statistics.eligibleNotes++;
+            statistics.labelEligible[label]++;
+            trackCounts.eligible++;
+            if (!shouldTransformLabel(settings.transformationPercentage, rng)) {
+                plainRow(row, 8);  // "ORIGINAL"
+                continue;
+            }
+            statistics.transformedNotes++;
+            statistics.labelTransformed[label]++;
+            trackCounts.transformed++;
+            if (row.noteNumber < 0) {
+                ++estimate.noteErrors;
+                continue;
+            }
+
+            size_t draw = uniformIndex(rng, draws.size());
+            const std::string& code = *draws[draw];
+            uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(row.duration)) << 32) |
+                           (static_cast<uint64_t>(row.noteNumber) << 16) | draw;
+            auto [entry, added] = trills.emplace(key, TrillTally());
+            TrillTally& trill = entry->second;
+            if (added) {
+                try {
+                    applyTrill(row.noteNumber, row.duration, settings.meter, code, segments);
+                    trill.rows = static_cast<uint32_t>(segments.size());
+                    for (const auto& [noteNumber, duration] : segments) {
+                        trill.bytes += fieldBytes(getNoteName(noteNumber).size(), 11) + fieldBytes(digits(duration), 20);
+                        // Below C0 the printed name does not read back; above G9 it is out of range
+                        if (noteNumber < 12 || noteNumber > 127) {
+                            ++trill.midiErrors;
+                            continue;
+                        }
+                        ++trill.midiNotes;
+                        trill.eventBytes += static_cast<uint32_t>(6 + 1 + (duration > 0 ? deltaBytes(duration) : 1));
+                        trill.advance += duration;
+                    }
+                } catch (const std::exception&) {
+                    trill.failed = true;
+                }
+            }
+            if (trill.failed) {
+                ++estimate.noteErrors;
+                continue;
+            }
+
+            if (drawIds[draw] < RunStatistics::kVariants) {
+                statistics.variantUsage[drawIds[draw]]++;
+            }
+            estimate.outputRows += trill.rows;
+            estimate.textBytes += trill.bytes + static_cast<size_t>(trill.rows) *
+                (fieldBytes(digits(row.track), 11) + fieldBytes(row.label.size(), 20) + fieldBytes(code.size(), 25) + 1);
+            if (skipsMidiRow(row.track, "", row.label)) continue;
+            estimate.midiErrors += trill.midiErrors;
+
+            TrackTally& tally = trackTally(row.track);
+            if (tally.sorted) {
+                tally.notes += trill.midiNotes;
+                tally.eventBytes += trill.eventBytes;
+                tally.position += trill.advance;
+            } else {
+                applyTrill(row.noteNumber, row.duration, settings.meter, code, segments);
+                for (const auto& [noteNumber, duration] : segments) {
+                    if (noteNumber >= 12 && noteNumber <= 127) tally.add(duration);
+                }
+            }
+        }
+    }
+
+    // Format 1 header, then one chunk per track; the binary stream holds one
+    // record per MIDI note
+    size_t midiNotes = 0;
+    estimate.midiBytes = 14;
+    for (auto& [track, tally] : tracks) {
+        TrackEstimate trackEstimate;
+        trackEstimate.track = track;
+        trackEstimate.notes = tally.notes;
+        trackEstimate.midiBytes = tally.midiBytes();
+        estimate.tracks.push_back(trackEstimate);
+        estimate.midiBytes += trackEstimate.midiBytes;
+        estimate.midiEventBytes += grownCapacity(2 * tally.notes) * 8;
+        midiNotes += tally.notes;
+    }
+    estimate.binaryBytes = 12 + 12 * midiNotes;
+}
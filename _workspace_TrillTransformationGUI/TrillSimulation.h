@@ -0,0 +1,100 @@
+// Trill Transformation (C) 2025
+// Outcome statistics of many seeds without producing any output.
+//
+// A run's random choices depend only on its seed and the parsed input, so
+// the simulator resolves every trill the input can produce once, per
+// distinct (pitch, duration, variant). Each seed then only replays its
+// percentage and variant draws, exactly as a real run makes them.
+#ifndef TRILL_SIMULATION_H
+#define TRILL_SIMULATION_H
+
+#include "TrillTransformation.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Statistics of one simulated run
+struct SeedOutcome {
+    uint64_t seed = 0;
+    int transformedNotes = 0;
+    size_t outputRows = 0;          // Rows of the text table below its header
+    size_t textBytes = 0;           // Size of the text table processFile would write
+    std::vector<int> variantUsage;  // Per entry of RunSimulator::variants()
+};
+
+class RunSimulator {
+public:
+    // Resolve the trills of table under the percentage, variants and meter of settings
+    RunSimulator(const ParsedTable& table, const AppState& settings);
+
+    int eligibleNotes() const { return eligible; }
+
+    // Codes the variant draw can pick, each once
+    const std::vector<std::string>& variants() const { return codes; }
+
+    // Replay the choices of seed. Const, so threads can share one simulator.
+    void simulate(uint64_t seed, SeedOutcome& outcome) const;
+
+private:
+    static const uint32_t kNoPair = 0xFFFFFFFF;
+
+    // An eligible row and the text bytes its output rows share
+    struct EligibleRow {
+        uint32_t pair;           // Distinct (pitch, duration), kNoPair for an invalid name
+        uint32_t rowBytes;       // Track and label fields plus newline of each row
+        uint32_t originalBytes;  // Whole row when left ORIGINAL
+    };
+
+    // Trill of one pair under one drawn variant
+    struct Trill {
+        uint32_t rows = 0;
+        uint32_t bytes = 0;   // Note and duration fields of all its rows
+        bool failed = false;  // applyTrill rejected it; nothing is written
+    };
+
+    double percentage;
+    int eligible = 0;
+    size_t fixedRows = 0;
+    size_t fixedBytes = 0;
+    std::vector<EligibleRow> rows;
+    std::vector<std::string> codes;
+    std::vector<uint32_t> drawCode;      // Draw index -> entry of codes
+    std::vector<uint32_t> variantBytes;  // Draw index -> variant field bytes
+    std::vector<Trill> trills;           // pair * draws + draw index
+};
+
+// One MIDI track of a dry run
+struct TrackEstimate {
+    int track = 0;
+    size_t notes = 0;       // Each is a note-on and a note-off event
+    size_t midiBytes = 0;   // MTrk chunk, header included
+};
+
+// Exact results and output sizes of a run, as processFile, transformBuffer
+// and the MIDI encoders would produce them
+struct RunEstimate {
+    RunStatistics statistics;
+    size_t noteErrors = 0;      // Notes the run reports as errors
+    size_t midiErrors = 0;      // Rows the MIDI encoder reports and skips
+    size_t outputRows = 0;
+    size_t textBytes = 0;
+    size_t binaryBytes = 0;
+    size_t midiBytes = 0;
+    size_t midiEventBytes = 0;  // Memory the MIDI writer holds its events in
+    std::vector<TrackEstimate> tracks;  // In ascending track order
+};
+
+// One piece of an input and the settings (seed included) it runs with.
+// An input split into chunks is estimated as its pieces in order.
+struct EstimatePiece {
+    const ParsedTable* table = nullptr;
+    const AppState* settings = nullptr;
+};
+
+// Run the eligibility, percentage and variant choices of pieces and total
+// the outputs they would produce, without formatting or writing anything
+void estimateRun(const EstimatePiece* pieces, size_t count, RunEstimate& estimate);
+
+#endif // TRILL_SIMULATION_H
@@ -0,0 +1,126 @@
+// Trill Transformation (C) 2025
+// Real-time building blocks for live note streams.
+
+#include "TrillStream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+// Index of the highest set bit of a non-zero value
+static int highestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) ++bit;
+    return bit;
+#endif
+}
+
+int LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < (1u << kSubBits)) return static_cast<int>(value);
+    int msb = highestBit(value);
+    int sub = static_cast<int>((value >> (msb - kSubBits)) & ((1u << kSubBits) - 1));
+    return ((msb - kSubBits + 1) << kSubBits) + sub;
+}
+
+uint64_t LatencyHistogram::bucketMidpoint(int bucket) {
+    if (bucket < (1 << kSubBits)) return static_cast<uint64_t>(bucket);
+    int group = bucket >> kSubBits;
+    uint64_t sub = static_cast<uint64_t>(bucket & ((1 << kSubBits) - 1));
+    int shift = group - 1;
+    uint64_t lower = ((uint64_t(1) << kSubBits) + sub) << shift;
+    return lower + ((uint64_t(1) << shift) >> 1);
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    ++counts[bucketOf(nanoseconds)];
+    ++total;
+    if (nanoseconds > maximum) maximum = nanoseconds;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            uint64_t value = bucketMidpoint(bucket);
+            return value < maximum ? value : maximum;
+        }
+    }
+    return maximum;
+}
+
+std::string LatencyHistogram::describe() const {
+    char text[96];
+    std::snprintf(text, sizeof(text), "p50 %.1f us, p99 %.1f us, max %.1f us",
+                  percentile(0.50) / 1000.0, percentile(0.99) / 1000.0, maximum / 1000.0);
+    return text;
+}
+
+TrillStreamer::TrillStreamer(const AppState& settings)
+    : percentage(settings.transformationPercentage), meter(settings.meter), rng(settings.seed) {
+    // Resolve variant codes to plans once, so the event path neither looks
+    // codes up nor builds the shared plan tables; RANDOM (or none) draws
+    // from the whole table
+    bool randomVariant = settings.selectedVariants.empty() ||
+        (settings.selectedVariants.size() == 1 && settings.selectedVariants[0] == "RANDOM");
+    std::vector<std::string_view> codes;
+    if (randomVariant) {
+        for (const TrillVariant& variant : *settings.variantTable) codes.push_back(variant.code);
+    } else {
+        codes.assign(settings.selectedVariants.begin(), settings.selectedVariants.end());
+    }
+    const std::vector<TrillVariant>& builtIn = allTrillVariants();
+    for (std::string_view code : codes) {
+        auto found = std::find_if(builtIn.begin(), builtIn.end(),
+                                  [&](const TrillVariant& variant) { return variant.code == code; });
+        if (found != builtIn.end()) {
+            plans.push_back(builtInTrillPlan(static_cast<size_t>(found - builtIn.begin()), meter));
+            continue;
+        }
+        // Codes outside the built-in table are decoded; unknown ones trill to nothing
+        TrillParameters parameters;
+        plans.push_back(decodeTrillVariant(code, parameters) ? buildTrillPlan(parameters, meter) : TrillPlan());
+    }
+    segments.reserve(kMaxEvents / 2);
+}
+
+size_t TrillStreamer::expand(const LiveNote& note, LiveEvent* out, bool& trilled) {
+    trilled = false;
+    size_t count = 0;
+    auto emit = [&](int64_t start, int noteNumber, int duration) {
+        if (count + 2 > kMaxEvents || noteNumber < 0 || noteNumber > 127) return;
+        out[count++] = LiveEvent{start, note.track, static_cast<uint8_t>(noteNumber), 0x64, true};
+        out[count++] = LiveEvent{start + duration, note.track, static_cast<uint8_t>(noteNumber), 0x00, false};
+    };
+
+    // Same choices as a file run: eligibility, then the percentage draw, then the variant draw.
+    // The variant is drawn even for notes applyTrill would reject, as a file run draws it.
+    if (isEligibleLabel(note.label) && shouldTransformLabel(percentage, rng)) {
+        const TrillPlan& plan = plans[uniformIndex(rng, plans.size())];
+        if (note.duration <= 0) {
+            emit(note.timeMs, note.noteNumber, note.duration);
+            return count;
+        }
+        applyTrill(note.noteNumber, note.duration, plan, segments);
+        trilled = true;
+
+        // Segments follow one another from the note's start
+        int64_t start = note.timeMs;
+        for (const auto& [noteNumber, duration] : segments) {
+            emit(start, noteNumber, duration);
+            start += duration;
+        }
+        std::sort(out, out + count, [](const LiveEvent& a, const LiveEvent& b) {
+            return a.timeMs < b.timeMs || (a.timeMs == b.timeMs && !a.noteOn && b.noteOn);
+        });
+        return count;
+    }
+
+    emit(note.timeMs, note.noteNumber, note.duration);
+    return count;
+}
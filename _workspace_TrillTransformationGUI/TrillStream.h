@@ -0,0 +1,122 @@
+// Trill Transformation (C) 2025
+// Real-time building blocks for live note streams.
+//
+// Nothing on the event path allocates: rings and histograms are fixed-size,
+// and the streamer resolves variants and reserves its trill buffer up front.
+#ifndef TRILL_STREAM_H
+#define TRILL_STREAM_H
+
+#include "TrillTransformation.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lock-free single-producer/single-consumer ring of Capacity slots
+// (a power of two). push and pop never block; push fails when full.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool push(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == Capacity) return false;
+        slots[head & (Capacity - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) return false;
+        item = slots[tail & (Capacity - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+private:
+    // Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::array<T, Capacity> slots{};
+};
+
+// Fixed-size log-linear histogram of durations in nanoseconds: 16 linear
+// sub-buckets per power of two, so any recorded value is reported within
+// 1/16 (about 6%). Record from one thread at a time.
+class LatencyHistogram {
+public:
+    void record(uint64_t nanoseconds);
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return maximum; }
+
+    // Value at or below which fraction (0..1) of the samples fall
+    uint64_t percentile(double fraction) const;
+
+    // "p50 X us, p99 Y us, max Z us"
+    std::string describe() const;
+
+private:
+    static const int kSubBits = 4;
+    static const int kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+    static int bucketOf(uint64_t value);
+    static uint64_t bucketMidpoint(int bucket);
+
+    std::array<uint64_t, kBuckets> counts{};
+    uint64_t total = 0;
+    uint64_t maximum = 0;
+};
+
+// One incoming note of a live stream. Times and durations are in
+// milliseconds; the label is stored inline so notes copy without allocating.
+struct LiveNote {
+    int64_t timeMs = 0;
+    int track = 0;
+    int noteNumber = 0;
+    int duration = 0;
+    char label[8] = {};
+    uint64_t arrivalNs = 0;  // Steady-clock time the note was read
+};
+
+// One scheduled note-on or note-off
+struct LiveEvent {
+    int64_t timeMs = 0;
+    int track = 0;
+    uint8_t noteNumber = 0;
+    uint8_t velocity = 0;
+    bool noteOn = false;
+};
+
+// Applies the trill transformation to one note at a time. Settings come
+// from an AppState (percentage, variants, meter, seed) as for a file run.
+class TrillStreamer {
+public:
+    // Most events a single note can expand to
+    static const size_t kMaxEvents = 256;
+
+    explicit TrillStreamer(const AppState& settings);
+
+    // Write the note-on/off events for note into out (room for kMaxEvents),
+    // in time order. Returns the number of events; trilled is set when the
+    // note was transformed.
+    size_t expand(const LiveNote& note, LiveEvent* out, bool& trilled);
+
+private:
+    double percentage;
+    TimeMeter meter;
+    std::mt19937_64 rng;
+    std::vector<TrillPlan> plans;  // Of each code a draw can pick, resolved before streaming
+    TrillSegments segments;
+};
+
+#endif // TRILL_STREAM_H
@@ -0,0 +1,143 @@
+// Trill Transformation (C) 2025
+// Optional recorder of timed spans, written as a Chrome trace-event file.
+
+#include "TrillTrace.h"
+#include "TrillTransformation.h"
+
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+std::atomic<bool> g_tracingEnabled{false};
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    int64_t id;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Spans of one thread, newest overwriting oldest once full
+struct TraceRing {
+    static const size_t kCapacity = 1 << 15;
+
+    std::string threadName;
+    std::atomic<size_t> recorded{0};
+    TraceEvent events[kCapacity];
+};
+
+// Rings of every thread that recorded, kept until the process exits so a
+// trace can be written after its threads are gone
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+    std::atomic<uint64_t> origin{0};
+};
+
+TraceRegistry& registry() {
+    static TraceRegistry instance;
+    return instance;
+}
+
+thread_local TraceRing* threadRing = nullptr;
+thread_local std::string threadName;
+
+TraceRing& ringOfThisThread() {
+    if (!threadRing) {
+        std::unique_ptr<TraceRing> ring(new TraceRing);
+        TraceRegistry& traces = registry();
+        std::lock_guard<std::mutex> lock(traces.mutex);
+        ring->threadName = threadName.empty() ? "thread " + std::to_string(traces.rings.size()) : threadName;
+        threadRing = ring.get();
+        traces.rings.push_back(std::move(ring));
+    }
+    return *threadRing;
+}
+
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted.push_back('\\');
+        quoted.push_back(c);
+    }
+    return quoted + "\"";
+}
+
+} // namespace
+
+void enableTracing() {
+    uint64_t unset = 0;
+    registry().origin.compare_exchange_strong(unset, steadyNanoseconds());
+    g_tracingEnabled.store(true, std::memory_order_relaxed);
+}
+
+void setTraceThreadName(const std::string& name) {
+    threadName = name;
+    if (threadRing) {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        threadRing->threadName = name;
+    }
+}
+
+void recordTraceSpan(const char* name, int64_t id, uint64_t startNs, uint64_t endNs) {
+    TraceRing& ring = ringOfThisThread();
+    size_t index = ring.recorded.load(std::memory_order_relaxed);
+    ring.events[index % TraceRing::kCapacity] = TraceEvent{name, id, startNs, endNs};
+    ring.recorded.store(index + 1, std::memory_order_release);
+}
+
+void TraceSpan::begin(const char* spanName) {
+    name = spanName;
+    start = steadyNanoseconds();
+}
+
+void TraceSpan::end() {
+    recordTraceSpan(name, id, start, steadyNanoseconds());
+}
+
+size_t droppedTraceSpans() {
+    TraceRegistry& traces = registry();
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    size_t dropped = 0;
+    for (const auto& ring : traces.rings) {
+        size_t recorded = ring->recorded.load(std::memory_order_acquire);
+        dropped += recorded > TraceRing::kCapacity ? recorded - TraceRing::kCapacity : 0;
+    }
+    return dropped;
+}
+
+bool writeChromeTrace(const std::string& path) {
+    TraceRegistry& traces = registry();
+    uint64_t origin = traces.origin.load();
+    std::stringstream json;
+    json << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    for (size_t tid = 0; tid < traces.rings.size(); ++tid) {
+        const TraceRing& ring = *traces.rings[tid];
+        json << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid + 1
+             << ", \"args\": {\"name\": " << jsonString(ring.threadName) << "}}";
+        first = false;
+
+        // Oldest surviving span first
+        size_t recorded = ring.recorded.load(std::memory_order_acquire);
+        size_t begin = recorded > TraceRing::kCapacity ? recorded - TraceRing::kCapacity : 0;
+        for (size_t i = begin; i < recorded; ++i) {
+            const TraceEvent& event = ring.events[i % TraceRing::kCapacity];
+            uint64_t start = event.start > origin ? event.start - origin : 0;
+            json << ",\n{\"name\": " << jsonString(event.name) << ", \"cat\": \"trill\", \"ph\": \"X\", \"pid\": 1"
+                 << ", \"tid\": " << tid + 1 << ", \"ts\": " << start / 1000.0
+                 << ", \"dur\": " << (event.end - event.start) / 1000.0;
+            if (event.id >= 0) {
+                json << ", \"args\": {\"id\": " << event.id << "}";
+            }
+            json << "}";
+        }
+    }
+    json << "\n]}\n";
+    return writeOutputFile(path, json.str());
+}
@@ -0,0 +1,62 @@
+// Trill Transformation (C) 2025
+// Optional recorder of timed spans, written as a Chrome trace-event file
+// for chrome://tracing or ui.perfetto.dev.
+//
+// Every thread records into its own fixed-size ring, so recording takes no
+// lock; a full ring overwrites its oldest spans. Spans are only placed
+// around stages, blocks and chunks, never per line, and while tracing is
+// off each costs a single relaxed atomic load.
+#ifndef TRILL_TRACE_H
+#define TRILL_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+extern std::atomic<bool> g_tracingEnabled;
+
+inline bool tracingEnabled() {
+    return g_tracingEnabled.load(std::memory_order_relaxed);
+}
+
+// Start recording. Timestamps in the trace are relative to the first call.
+void enableTracing();
+
+// Name shown for the calling thread's track in the trace
+void setTraceThreadName(const std::string& name);
+
+// Record a span of the calling thread. name must be a string literal (or
+// otherwise outlive the recorder); id is shown as an argument if >= 0.
+void recordTraceSpan(const char* name, int64_t id, uint64_t startNs, uint64_t endNs);
+
+// Write every thread's recorded spans to path as trace-event JSON, through a
+// temporary file renamed into place. Call once the traced threads are idle.
+bool writeChromeTrace(const std::string& path);
+
+// Spans lost to full rings so far
+size_t droppedTraceSpans();
+
+// Records its own lifetime as a span when tracing is on
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, int64_t id = -1) : id(id) {
+        if (tracingEnabled()) begin(name);
+    }
+    ~TraceSpan() {
+        if (name) end();
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    void begin(const char* spanName);
+    void end();
+
+    const char* name = nullptr;  // Null while tracing is off
+    int64_t id;
+    uint64_t start = 0;
+};
+
+#endif // TRILL_TRACE_H
@@ -1,40 +1,21 @@
 // Trill Transformation (C) 2025
 // Version with percentage control, multiple choice variant selection, and GUI without dependencies
+#include "TrillTransformation.h"
+#include "TrillTrace.h"
+
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <string>
-#include <vector>
-#include <map>
 #include <algorithm>
-#include <random>
 #include <chrono>
-#include <ctime>
 #include <iomanip>
 #include <stdexcept>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include <memory>
-#include <set>
-
-// Platform detection
-#if defined(_WIN32) || defined(_WIN64)
-    #define PLATFORM_WINDOWS
-    #include <windows.h>
-    #include <commdlg.h>
-    #include <commctrl.h>
-    #pragma comment(lib, "comctl32.lib")
-#elif defined(__linux__) || defined(__unix__)
-    #define PLATFORM_LINUX
-    #include <X11/Xlib.h>
-    #include <X11/Xutil.h>
-    #include <X11/keysym.h>
-    #include <unistd.h>
-    #include <sys/types.h>
-    #include <pwd.h>
-#else
-    #error "Unsupported platform"
-#endif
+#include <charconv>
+#include <filesystem>
 
 // Helper to get note name (from MIDI number)
 std::string getNoteName(int noteNumber) {
@@ -47,202 +28,220 @@ std::string getNoteName(int noteNumber) {
 }
 
 // Helper to get MIDI number from note name
-int getNoteNumber(const std::string& noteName) {
-    static const std::string noteNames[] = {
+int getNoteNumber(std::string_view noteName) {
+    static const std::string_view noteNames[] = {
         "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
     };
 
-    // Extract note and octave
-    std::string baseNote = noteName.substr(0, noteName.size() - 1);
-    int octave = std::stoi(noteName.substr(noteName.size() - 1));
+    // Extract note and octave (single trailing digit)
+    if (noteName.empty()) {
+        throw std::invalid_argument("Invalid note name: " + std::string(noteName));
+    }
+    std::string_view baseNote = noteName.substr(0, noteName.size() - 1);
+    char octaveChar = noteName.back();
+    if (octaveChar < '0' || octaveChar > '9') {
+        throw std::invalid_argument("Invalid note name: " + std::string(noteName));
+    }
+    int octave = octaveChar - '0';
 
     // Find base note index
     auto it = std::find(std::begin(noteNames), std::end(noteNames), baseNote);
     if (it == std::end(noteNames)) {
-        throw std::invalid_argument("Invalid note name: " + noteName);
+        throw std::invalid_argument("Invalid note name: " + std::string(noteName));
     }
     int noteIndex = std::distance(std::begin(noteNames), it);
 
     return (octave + 1) * 12 + noteIndex;
 }
 
-// Enum for TimeMeter
-enum TimeMeter {
-    DUPLE,
-    TRIPLE
+// Shape of one (type, length) combination under each meter. A table row
+// rather than a branch, so a new length is one more entry here.
+struct TrillShape {
+    TrillType type;
+    TrillLength length;
+    struct Meter {
+        int headMultiple, headDivision;
+        int alternations, division;
+        bool startsOnSecond;
+        int turnDivision;
+    } meters[2];  // DUPLE, TRIPLE
 };
 
-void handleMeterShortReg(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int pi, int durPi, TimeMeter meter) {
-    if (meter == DUPLE) {
-        int segment = durPi / 4;
-        EmbRet.push_back({p1, segment});
-        EmbRet.push_back({p2, segment});
-        EmbRet.push_back({p1, segment});
-        EmbRet.push_back({p2, durPi - 3 * segment}); // Use remaining duration
-    } else if (meter == TRIPLE) {
-        int segment = durPi / 6;
-        for (int i = 0; i < 5; ++i) { // Alternate p1 and p2
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
-        }
-        EmbRet.push_back({p2, durPi - 5 * segment}); // Remaining duration
-    }
-}
+static const TrillShape kTrillShapes[] = {
+    {REGULAR_TRILL,    SHORT_TRILL,  {{0, 1, 3, 4, false, 0},   {0, 1, 5, 6, false, 0}}},
+    {REGULAR_TRILL,    NORMAL_TRILL, {{0, 1, 6, 8, false, 0},   {0, 1, 6, 8, false, 0}}},
+    {REGULAR_TRILL,    LONG_TRILL,   {{0, 1, 7, 8, false, 0},   {0, 1, 7, 8, false, 0}}},
+    {DELAYED_TRILL,    NORMAL_TRILL, {{1, 4, 4, 8, false, 0},   {2, 8, 4, 8, true, 0}}},
+    {DELAYED_TRILL,    LONG_TRILL,   {{2, 8, 5, 8, true, 0},    {2, 8, 5, 8, true, 0}}},
+    {ASCENDING_TRILL,  SHORT_TRILL,  {{0, 1, 4, 8, false, 4},   {0, 1, 4, 8, false, 6}}},
+    {ASCENDING_TRILL,  NORMAL_TRILL, {{0, 1, 7, 8, false, 0},   {0, 1, 7, 8, false, 0}}},
+    {ASCENDING_TRILL,  LONG_TRILL,   {{0, 1, 15, 16, false, 0}, {0, 1, 11, 12, false, 0}}},
+    {DESCENDING_TRILL, SHORT_TRILL,  {{0, 1, 4, 8, false, 4},   {0, 1, 4, 8, false, 6}}},
+    {DESCENDING_TRILL, NORMAL_TRILL, {{0, 1, 7, 8, false, 0},   {0, 1, 7, 8, false, 0}}},
+    {DESCENDING_TRILL, LONG_TRILL,   {{0, 1, 15, 16, false, 0}, {0, 1, 11, 12, false, 0}}},
+    {TERMINAL_TRILL,   SHORT_TRILL,  {{0, 1, 3, 4, false, 0},   {0, 1, 5, 6, false, 0}}},
+    {TERMINAL_TRILL,   NORMAL_TRILL, {{0, 1, 7, 8, false, 0},   {0, 1, 11, 12, false, 0}}},
+    {TERMINAL_TRILL,   LONG_TRILL,   {{0, 1, 15, 16, false, 0}, {0, 1, 11, 12, false, 0}}},
+};
 
-void handleMeterNormalReg(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int p4, int p5, int pi, int durPi, TimeMeter meter) {
-    int segment = durPi / 8;
-    if (meter == DUPLE) {
-        for (int i = 0; i < 6; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
-        }
-        EmbRet.push_back({p2, durPi - 6 * segment}); // Remaining duration
-    } else if (meter == TRIPLE) {
-        for (int i = 0; i < 6; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
-        }
-        EmbRet.push_back({p2, durPi - 6 * segment}); // Remaining duration
+bool decodeTrillVariant(std::string_view code, TrillParameters& parameters) {
+    // CTrRn1 and CTrDen1 have always trilled a fourth above the main note;
+    // kept so their output does not change
+    static const std::pair<std::string_view, int> kIntervalExceptions[] = {
+        {"CTrRn1", 5}, {"CTrDen1", 5}
+    };
+    static const std::pair<char, int> kIntervals[] = {{'1', 2}, {'5', 1}};
+
+    if (code.size() < 6 || code.substr(1, 2) != "Tr") return false;
+    TrillParameters decoded;
+    if (code[0] == 'B') decoded.style = BAROQUE_STYLE;
+    else if (code[0] == 'C') decoded.style = CLASSICAL_STYLE;
+    else return false;
+
+    size_t position = 3;
+    switch (code[position++]) {
+        case 'R': decoded.type = REGULAR_TRILL; break;
+        case 'A': decoded.type = ASCENDING_TRILL; break;
+        case 'T': decoded.type = TERMINAL_TRILL; break;
+        case 'D':
+            decoded.type = DESCENDING_TRILL;
+            if (code[position] == 'e') {
+                decoded.type = DELAYED_TRILL;
+                ++position;
+            }
+            break;
+        default: return false;
     }
-}
-
-void handleMeterLongReg(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int pi, int durPi, TimeMeter meter) {
-    if (meter == DUPLE || meter == TRIPLE) {
-        int segment = durPi / 8;
-        for (int i = 0; i < 7; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
-        }
-        EmbRet.push_back({p2, durPi - 7 * segment}); // Remaining duration
+    if (code.size() != position + 2) return false;
+    switch (code[position++]) {
+        case 's': decoded.length = SHORT_TRILL; break;
+        case 'n': decoded.length = NORMAL_TRILL; break;
+        case 'l': decoded.length = LONG_TRILL; break;
+        default: return false;
     }
-}
-
-void handleMeterDelayedNormal(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int p4, int p5, int pi, int durPi, TimeMeter meter) {
-    if (meter == DUPLE) {
-        int segmentA = durPi / 4;
-        int segmentB = durPi / 8;
-        EmbRet.push_back({p1, segmentA});
-        EmbRet.push_back({p1, segmentB});
-        EmbRet.push_back({p2, segmentB});
-        EmbRet.push_back({p1, segmentB});
-        EmbRet.push_back({p2, segmentB});
-        EmbRet.push_back({p2, durPi - (segmentA + 4 * segmentB)}); // Remaining duration
-    } else if (meter == TRIPLE) {
-        int segmentA = durPi / 8;
-        EmbRet.push_back({p1, segmentA * 2}); // p1 at 1/4
-        for (int i = 0; i < 4; i++) {
-            EmbRet.push_back({i % 2 == 0 ? p2 : p1, segmentA});
-        }
-        EmbRet.push_back({p2, durPi - (segmentA * 6)}); // Remaining duration
+    auto interval = std::find_if(std::begin(kIntervals), std::end(kIntervals),
+                                 [&](const auto& entry) { return entry.first == code[position]; });
+    if (interval == std::end(kIntervals)) return false;
+    decoded.interval = interval->second;
+    for (const auto& exception : kIntervalExceptions) {
+        if (exception.first == code) decoded.interval = exception.second;
     }
+    parameters = decoded;
+    return true;
 }
 
-void handleMeterDelayedLong(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int p4, int p5, int pi, int durPi, TimeMeter meter) {
-    if (meter == DUPLE || meter == TRIPLE) {
-        int segment = durPi / 8;
-        EmbRet.push_back({p1, segment * 2}); // 1/4 duration
-        for (int i = 0; i < 5; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p2 : p1, segment});
-        }
-        EmbRet.push_back({p2, durPi - 7 * segment}); // Remaining duration
+TrillPlan buildTrillPlan(const TrillParameters& parameters, TimeMeter meter) {
+    TrillPlan plan;
+    for (const TrillShape& shape : kTrillShapes) {
+        if (shape.type != parameters.type || shape.length != parameters.length) continue;
+        const TrillShape::Meter& m = shape.meters[meter == TRIPLE ? 1 : 0];
+        plan.headMultiple = m.headMultiple;
+        plan.headDivision = m.headDivision;
+        plan.alternations = m.alternations;
+        plan.division = m.division;
+        plan.startsOnSecond = m.startsOnSecond;
+        plan.turnDivision = m.turnDivision;
+        plan.valid = true;
     }
-}
 
-void handleMeterAscendingShort(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int durPi, TimeMeter meter) {
-    int segment = durPi / 8;
-    if (meter == DUPLE) {
-        for (int i = 0; i < 4; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
-        }
-        EmbRet.push_back({p1, durPi / 4});
-        EmbRet.push_back({p2, durPi - (4 * segment + durPi / 4)}); // Remaining duration
-    } else if (meter == TRIPLE) {
-        for (int i = 0; i < 4; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
-        }
-        EmbRet.push_back({p1, durPi / 6});
-        EmbRet.push_back({p2, durPi - (4 * segment + durPi / 6)}); // Remaining duration
-    }
+    // The auxiliary note lies below for ascending trills, above otherwise.
+    // Classical regular, delayed and terminal normal/long trills start on
+    // the main note; every other trill starts on the auxiliary.
+    int auxiliary = parameters.type == ASCENDING_TRILL ? -parameters.interval : parameters.interval;
+    bool mainFirst = parameters.style == CLASSICAL_STYLE &&
+        (parameters.type == REGULAR_TRILL || parameters.type == DELAYED_TRILL ||
+         (parameters.type == TERMINAL_TRILL && parameters.length != SHORT_TRILL));
+    plan.firstOffset = mainFirst ? 0 : auxiliary;
+    plan.secondOffset = mainFirst ? auxiliary : 0;
+    return plan;
 }
 
-void handleMeterAscendingNormal(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int p8, int durPi, TimeMeter meter) {
-    if (meter == DUPLE) {
-        int segment = durPi / 8;
-        for (int i = 0; i < 7; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate p1 and p2
-        }
-        EmbRet.push_back({p2, durPi - 7 * segment}); // Remaining duration
-    } else if (meter == TRIPLE) {
-        int segment = durPi / 8;
-        for (int i = 0; i < 7; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate p1 and p2
+// Index of a code in the built-in table, or the table's size. Codes are
+// packed into a 64-bit key and looked up in a small open-addressed table, so
+// the cost does not depend on where a code sits in the table.
+static size_t builtInTrillIndex(std::string_view code) {
+    static const size_t kSlots = 128;
+    struct Slot {
+        uint64_t key = 0;
+        size_t index = 0;
+    };
+    auto pack = [](std::string_view text, uint64_t& key) {
+        if (text.empty() || text.size() > sizeof(key)) return false;
+        key = 0;
+        std::memcpy(&key, text.data(), text.size());
+        return true;
+    };
+    auto slotOf = [](uint64_t key) { return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 57); };
+    static const std::array<Slot, kSlots> slots = [&] {
+        std::array<Slot, kSlots> built{};
+        const std::vector<TrillVariant>& table = allTrillVariants();
+        for (size_t i = 0; i < table.size(); ++i) {
+            uint64_t key;
+            if (!pack(table[i].code, key)) continue;
+            size_t slot = slotOf(key);
+            while (built[slot].key != 0 && built[slot].key != key) slot = (slot + 1) % kSlots;
+            if (built[slot].key == 0) built[slot] = {key, i};
         }
-        EmbRet.push_back({p2, durPi - 7 * segment}); // Remaining duration
-    }
-}
+        return built;
+    }();
 
-void handleMeterTerminalShort(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int pi, int durPi, TimeMeter meter) {
-    if (meter == DUPLE) {
-        int segment = durPi / 4;
-        EmbRet.push_back({p1, segment});
-        EmbRet.push_back({p2, segment});
-        EmbRet.push_back({p1, segment});
-        EmbRet.push_back({p2, durPi - 3 * segment}); // Remaining duration
-    } else if (meter == TRIPLE) {
-        int segment = durPi / 6;
-        for (int i = 0; i < 5; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
+    uint64_t key;
+    if (pack(code, key)) {
+        for (size_t slot = slotOf(key); slots[slot].key != 0; slot = (slot + 1) % kSlots) {
+            if (slots[slot].key == key) return slots[slot].index;
         }
-        EmbRet.push_back({p2, durPi - 5 * segment}); // Remaining duration
     }
+    return allTrillVariants().size();
 }
 
-void handleMeterAscendingLong(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int p8, int p9, int p10, int p11, int p12, int durPi, TimeMeter meter) {
-    if (meter == DUPLE) {
-        int segment = durPi / 16;
-        for (int i = 0; i < 15; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate between p1 and p2 for 15 segments
-        }
-        EmbRet.push_back({p2, durPi - 15 * segment}); // Remaining time for the last segment
-    } else if (meter == TRIPLE) {
-        int segment = durPi / 12;
-        for (int i = 0; i < 11; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate between p1 and p2 for 11 segments
+const TrillPlan& builtInTrillPlan(size_t variantIndex, TimeMeter meter) {
+    static const std::vector<std::array<TrillPlan, 2>> plans = [] {
+        std::vector<std::array<TrillPlan, 2>> built;
+        for (const TrillVariant& variant : allTrillVariants()) {
+            TrillParameters parameters;
+            std::array<TrillPlan, 2> byMeter;
+            if (decodeTrillVariant(variant.code, parameters)) {
+                byMeter = {buildTrillPlan(parameters, DUPLE), buildTrillPlan(parameters, TRIPLE)};
+            }
+            built.push_back(byMeter);
         }
-        EmbRet.push_back({p2, durPi - 11 * segment}); // Remaining time for the last segment
-    }
+        return built;
+    }();
+    return plans[variantIndex][meter == TRIPLE ? 1 : 0];
 }
 
-void handleMeterTerminalNormal(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int pi, int p4, int p5, int p6, int p7, int durPi, TimeMeter meter) {
-    if (meter == DUPLE) {
-        int segment = durPi / 8;
-        for (int i = 0; i < 7; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
-        }
-        EmbRet.push_back({p2, durPi - 7 * segment});
-    } else if (meter == TRIPLE) {
-        int segment = durPi / 12;
-        for (int i = 0; i < 11; ++i) { // Alternate p1 and p2
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment});
-        }
-        EmbRet.push_back({p2, durPi - 11 * segment}); // Remaining duration
+void applyTrill(int pi, int durPi, const TrillPlan& plan, TrillSegments& EmbRet) {
+    if (durPi <= 0) {
+        throw std::invalid_argument("Duration (durPi) must be greater than 0");
     }
-}
 
-void handleMeterTerminalLong(std::vector<std::pair<int, int>>& EmbRet, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int p8, int p9, int p10, int p11, int p12, int p13, int p14, int p15, int p16, int durPi, TimeMeter meter) {
-    if (meter == DUPLE) {
-        int segment = durPi / 16;
-        for (int i = 0; i < 15; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate p1 and p2
-        }
-        EmbRet.push_back({p2, durPi - 15 * segment}); // Remaining duration
-    } else if (meter == TRIPLE) {
-        int segment = durPi / 12;
-        for (int i = 0; i < 11; ++i) {
-            EmbRet.push_back({i % 2 == 0 ? p1 : p2, segment}); // Alternate p1 and p2
-        }
-        EmbRet.push_back({p2, durPi - 11 * segment}); // Remaining duration
+    EmbRet.clear();
+    if (!plan.valid) return;
+
+    int first = pi + plan.firstOffset;
+    int second = pi + plan.secondOffset;
+    int used = 0;
+    if (plan.headMultiple > 0) {
+        int head = plan.headMultiple * (durPi / plan.headDivision);
+        EmbRet.push_back({first, head});
+        used += head;
+    }
+    int segment = durPi / plan.division;
+    for (int i = 0; i < plan.alternations; ++i) {
+        EmbRet.push_back({(i % 2 == 0) != plan.startsOnSecond ? first : second, segment});
     }
+    used += plan.alternations * segment;
+    if (plan.turnDivision > 0) {
+        int turn = durPi / plan.turnDivision;
+        EmbRet.push_back({first, turn});
+        used += turn;
+    }
+    EmbRet.push_back({second, durPi - used}); // Remaining duration
 }
 
-// Main function for trill transformation
-std::vector<std::pair<int, int>> applyTrill(int pi, int durPi, TimeMeter meter, const std::string& variant) {
+// Main function for trill transformation; replaces the contents of EmbRet
+// so a caller can reuse one buffer for every note in a run
+void applyTrill(int pi, int durPi, TimeMeter meter, const std::string& variant, TrillSegments& EmbRet) {
     if (durPi <= 0) {
         throw std::invalid_argument("Duration (durPi) must be greater than 0");
     }
@@ -250,175 +249,28 @@ std::vector<std::pair<int, int>> applyTrill(int pi, int durPi, TimeMeter meter,
         throw std::invalid_argument("Invalid TimeMeter");
     }
 
-    std::vector<std::pair<int, int>> EmbRet;
-    
-    // Short Reg Trills - Baroque and Classical
-    if (variant == "BTrRs1") {
-        handleMeterShortReg(EmbRet, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrRs5") {
-        handleMeterShortReg(EmbRet, pi + 1, pi, pi + 1, pi, durPi, meter);
-    } else if (variant == "CTrRs1") {
-        handleMeterShortReg(EmbRet, pi, pi + 2, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrRs5") {
-        handleMeterShortReg(EmbRet, pi, pi + 1, pi, pi + 1, durPi, meter);
-    }
-    
-    // Normal Reg Trills - Baroque and Classical
-    else if (variant == "BTrRn1") {
-        handleMeterNormalReg(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrRn5") {
-        handleMeterNormalReg(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, durPi, meter);
-    } else if (variant == "CTrRn1") {
-        handleMeterNormalReg(EmbRet, pi, pi + 5, pi, pi + 5, pi, pi + 5, durPi, meter);
-    } else if (variant == "CTrRn5") {
-        handleMeterNormalReg(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, durPi, meter);
-    }
-    
-    // Long Reg Trills - Baroque and Classical
-    else if (variant == "BTrRl1") {
-        handleMeterLongReg(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrRl5") {
-        handleMeterLongReg(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, durPi, meter);
-    } else if (variant == "CTrRl1") {
-        handleMeterLongReg(EmbRet, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrRl5") {
-        handleMeterLongReg(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, durPi, meter);
-    }
-    
-    // Delayed Normal Trills - Baroque and Classical
-    else if (variant == "BTrDen1") {
-        handleMeterDelayedNormal(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrDen5") {
-        handleMeterDelayedNormal(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, durPi, meter);
-    } else if (variant == "CTrDen1") {
-        handleMeterDelayedNormal(EmbRet, pi, pi + 5, pi, pi + 5, pi, pi + 5, durPi, meter);
-    } else if (variant == "CTrDen5") {
-        handleMeterDelayedNormal(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, durPi, meter);
-    }
-    
-    // Delayed Long Trills - Baroque and Classical
-    else if (variant == "BTrDel1") {
-        handleMeterDelayedLong(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrDel5") {
-        handleMeterDelayedLong(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, durPi, meter);
-    } else if (variant == "CTrDel1") {
-        handleMeterDelayedLong(EmbRet, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrDel5") {
-        handleMeterDelayedLong(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, durPi, meter);
-    }
-    
-    // Ascending Short Trills - Baroque and Classical
-    else if (variant == "BTrAs1") {
-        handleMeterAscendingShort(EmbRet, pi - 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrAs5") {
-        handleMeterAscendingShort(EmbRet, pi - 1, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "CTrAs1") {
-        handleMeterAscendingShort(EmbRet, pi - 2, pi, pi + 2, pi, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrAs5") {
-        handleMeterAscendingShort(EmbRet, pi - 1, pi, pi + 2, pi, pi, pi + 2, durPi, meter);
-    }
-    
-    // Ascending Normal Trills - Baroque and Classical
-    else if (variant == "BTrAn1") {
-        handleMeterAscendingNormal(EmbRet, pi - 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrAn5") {
-        handleMeterAscendingNormal(EmbRet, pi - 1, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "CTrAn1") {
-        handleMeterAscendingNormal(EmbRet, pi - 2, pi, pi + 2, pi, pi, pi + 2, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrAn5") {
-        handleMeterAscendingNormal(EmbRet, pi - 1, pi, pi + 2, pi, pi, pi + 2, pi, pi + 2, durPi, meter);
-    }
-    
-    // Ascending Long Trills - Baroque and Classical
-    else if (variant == "BTrAl1") {
-        handleMeterAscendingLong(EmbRet, pi - 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrAl5") {
-        handleMeterAscendingLong(EmbRet, pi - 1, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "CTrAl1") {
-        handleMeterAscendingLong(EmbRet, pi - 2, pi, pi + 2, pi, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrAl5") {
-        handleMeterAscendingLong(EmbRet, pi - 1, pi, pi + 2, pi, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
-    }
-    
-    // Descending Short Trills - Baroque and Classical
-    else if (variant == "BTrDs1") {
-        handleMeterAscendingShort(EmbRet, pi + 2, pi, pi - 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrDs5") {
-        handleMeterAscendingShort(EmbRet, pi + 1, pi, pi - 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "CTrDs1") {
-        handleMeterAscendingShort(EmbRet, pi + 2, pi, pi - 2, pi, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrDs5") {
-        handleMeterAscendingShort(EmbRet, pi + 1, pi, pi - 2, pi, pi, pi + 2, durPi, meter);
-    }
-    
-    // Descending Normal Trills - Baroque and Classical
-    else if (variant == "BTrDn1") {
-        handleMeterAscendingNormal(EmbRet, pi + 2, pi, pi - 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrDn5") {
-        handleMeterAscendingNormal(EmbRet, pi + 1, pi, pi - 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "CTrDn1") {
-        handleMeterAscendingNormal(EmbRet, pi + 2, pi, pi - 2, pi, pi, pi + 2, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrDn5") {
-        handleMeterAscendingNormal(EmbRet, pi + 1, pi, pi - 2, pi, pi, pi + 2, pi, pi + 2, durPi, meter);
-    }
-    
-    // Descending Long Trills - Baroque and Classical
-    else if (variant == "BTrDl1") {
-        handleMeterAscendingLong(EmbRet, pi + 2, pi, pi - 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "BTrDl5") {
-        handleMeterAscendingLong(EmbRet, pi + 1, pi, pi - 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, durPi, meter);
-    } else if (variant == "CTrDl1") {
-        handleMeterAscendingLong(EmbRet, pi + 2, pi, pi - 2, pi, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
-    } else if (variant == "CTrDl5") {
-        handleMeterAscendingLong(EmbRet, pi + 1, pi, pi - 2, pi, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, durPi, meter);
-    }
-    
-    // Terminal Short Trills - Baroque and Classical
-    else if (variant == "BTrTs1") {
-        handleMeterTerminalShort(EmbRet, pi + 2, pi, pi - 2, pi, durPi, meter);
-    } else if (variant == "BTrTs5") {
-        handleMeterTerminalShort(EmbRet, pi + 1, pi, pi - 2, pi, durPi, meter);
-    } else if (variant == "CTrTs1") {
-        handleMeterTerminalShort(EmbRet, pi + 2, pi, pi - 2, pi, durPi, meter);
-    } else if (variant == "CTrTs5") {
-        handleMeterTerminalShort(EmbRet, pi + 1, pi, pi - 2, pi, durPi, meter);
-    }
-    
-    // Terminal Normal Trills - Baroque and Classical
-    else if (variant == "BTrTn1") {
-        handleMeterTerminalNormal(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi - 2, pi, durPi, meter);
-    } else if (variant == "BTrTn5") {
-        handleMeterTerminalNormal(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi - 2, pi, durPi, meter);
-    } else if (variant == "CTrTn1") {
-        handleMeterTerminalNormal(EmbRet, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi - 2, pi, durPi, meter);
-    } else if (variant == "CTrTn5") {
-        handleMeterTerminalNormal(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi - 2, pi, durPi, meter);
-    }
-    
-    // Terminal Long Trills - Baroque and Classical
-    else if (variant == "BTrTl1") {
-        handleMeterTerminalLong(EmbRet, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi - 2, pi, durPi, meter);
-    } else if (variant == "BTrTl5") {
-        handleMeterTerminalLong(EmbRet, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi - 2, pi, durPi, meter);
-    } else if (variant == "CTrTl1") {
-        handleMeterTerminalLong(EmbRet, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi, pi + 2, pi - 2, pi, durPi, meter);
-    } else if (variant == "CTrTl5") {
-        handleMeterTerminalLong(EmbRet, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi, pi + 1, pi - 2, pi, durPi, meter);
-    }
-    
-    return EmbRet;
-}
-
-// Structure to represent a trill variant
-struct TrillVariant {
-    std::string code;
-    std::string description;
-};
+    // Built-in codes use their prebuilt plans; anything else is decoded
+    // here, and codes outside the grammar produce no segments
+    size_t index = builtInTrillIndex(variant);
+    if (index < allTrillVariants().size()) {
+        applyTrill(pi, durPi, builtInTrillPlan(index, meter), EmbRet);
+        return;
+    }
+    TrillParameters parameters;
+    TrillPlan plan;
+    if (decodeTrillVariant(variant, parameters)) plan = buildTrillPlan(parameters, meter);
+    applyTrill(pi, durPi, plan, EmbRet);
+}
 
-// Generate a random pool of trill variants for user selection
-std::vector<TrillVariant> generateRandomTrillVariantPool(int poolSize = 10) {
-    // Define the complete pool of trill variants
-    const std::vector<TrillVariant> allVariants = {
+std::vector<std::pair<int, int>> applyTrill(int pi, int durPi, TimeMeter meter, const std::string& variant) {
+    TrillSegments EmbRet;
+    applyTrill(pi, durPi, meter, variant, EmbRet);
+    return std::vector<std::pair<int, int>>(EmbRet.begin(), EmbRet.end());
+}
+
+// The complete pool of trill variants, built once
+const std::vector<TrillVariant>& allTrillVariants() {
+    static const std::vector<TrillVariant> allVariants = {
         // Regular Trills - Baroque and Classical - Short, Normal and Long
         {"BTrRs1", "Baroque Short Regular Trill - Major 2nd"},
         {"BTrRs5", "Baroque Short Regular Trill - Minor 2nd"},
@@ -494,9 +346,13 @@ std::vector<TrillVariant> generateRandomTrillVariantPool(int poolSize = 10) {
         {"CTrTl1", "Classical Terminal Long Trill - Major 2nd"},
         {"CTrTl5", "Classical Terminal Long Trill - Minor 2nd"}
     };
+    return allVariants;
+}
 
+// Generate a random pool of trill variants for user selection
+std::vector<TrillVariant> generateRandomTrillVariantPool(int poolSize) {
     // Create a copy of all variants and shuffle it
-    std::vector<TrillVariant> shuffledVariants = allVariants;
+    std::vector<TrillVariant> shuffledVariants = allTrillVariants();
 
     // Use modern random number generation
     std::random_device rd;
@@ -535,154 +391,716 @@ std::vector<int> parseUserChoices(const std::string& input, int maxChoice) {
     return choices;
 }
 
+// Uniform double in [0, 1) from the top 53 bits, identical on every platform
+static double uniformUnit(std::mt19937_64& rng) {
+    return static_cast<double>(rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Uniform index in [0, count)
+size_t uniformIndex(std::mt19937_64& rng, size_t count) {
+    return static_cast<size_t>(rng() % count);
+}
+
 // Check if a label should be transformed based on percentage
-bool shouldTransformLabel(double transformationPercentage) {
+bool shouldTransformLabel(double transformationPercentage, std::mt19937_64& rng) {
     // Generate random number between 0 and 100
-    double randomValue = (static_cast<double>(rand()) / RAND_MAX) * 100.0;
+    double randomValue = uniformUnit(rng) * 100.0;
     return randomValue < transformationPercentage;
 }
 
-// Structure to represent a MIDI note event
+// Packed 8-byte MIDI note event. The high word holds the tick (biased so
+// negative positions still order first); the low word holds the on/off flag,
+// the 7-bit pitch and the 7-bit velocity. The flag sits above the pitch so
+// that at equal ticks note-offs order before note-ons, which makes sorting a
+// plain integer comparison on the packed word.
 struct MidiEvent {
-    int track;
-    int noteNumber;
-    int startTime;
-    int duration;
-    bool isNoteOn;
+    uint64_t bits;
+
+    static MidiEvent make(int tick, int noteNumber, int velocity, bool isNoteOn) {
+        uint32_t biasedTick = static_cast<uint32_t>(tick) ^ 0x80000000u;
+        uint32_t low = (isNoteOn ? 0x8000u : 0u) |
+                       (static_cast<uint32_t>(noteNumber & 0x7F) << 8) |
+                       static_cast<uint32_t>(velocity & 0x7F);
+        return MidiEvent{(static_cast<uint64_t>(biasedTick) << 32) | low};
+    }
+
+    int tick() const { return static_cast<int>(static_cast<uint32_t>(bits >> 32) ^ 0x80000000u); }
+    int noteNumber() const { return static_cast<int>((bits >> 8) & 0x7F); }
+    int velocity() const { return static_cast<int>(bits & 0x7F); }
+    bool isNoteOn() const { return (bits & 0x8000u) != 0; }
+
+    bool operator<(const MidiEvent& other) const { return bits < other.bits; }
 };
+static_assert(sizeof(MidiEvent) == 8, "MidiEvent must stay packed");
+
+// Struct-of-arrays MIDI event storage. Columns are indexed by track slot and
+// track numbers are kept sorted, so tracks are written in ascending order.
+// Each track's events are a contiguous array of packed words.
+struct MidiTrackTable {
+    std::pmr::vector<int> trackNumbers;
+    std::pmr::vector<int> positions;   // Running tick position of each track
+    std::pmr::vector<std::pmr::vector<MidiEvent>> events;
+
+    explicit MidiTrackTable(std::pmr::memory_resource* resource)
+        : trackNumbers(resource), positions(resource), events(resource) {}
+
+    size_t size() const { return trackNumbers.size(); }
+
+    // Slot for a track number, inserting an empty track if it is new
+    size_t slot(int track) {
+        // Consecutive lines almost always belong to the same track
+        if (lastSlot < trackNumbers.size() && trackNumbers[lastSlot] == track) {
+            return lastSlot;
+        }
+        auto it = std::lower_bound(trackNumbers.begin(), trackNumbers.end(), track);
+        size_t index = it - trackNumbers.begin();
+        if (it == trackNumbers.end() || *it != track) {
+            trackNumbers.insert(it, track);
+            positions.insert(positions.begin() + index, 0);
+            events.emplace(events.begin() + index);
+        }
+        lastSlot = index;
+        return index;
+    }
 
-// Application state
-struct AppState {
-    std::string inputFile;
-    std::string outputFile;
-    std::string midiOutputFile;
-    double transformationPercentage = 50.0;
-    std::vector<std::string> selectedVariants;
-    bool processingComplete = false;
-    std::string statusMessage;
-    std::string resultSummary;
-    int totalEligibleNotes = 0;
-    int transformedNotes = 0;
-    std::map<std::string, int> variantUsageCount;
+private:
+    size_t lastSlot = 0;
 };
 
-// Function to process file with GUI integration
-void processFile(const std::string& inputFile, const std::string& outputFile, AppState& state) {
-    std::ifstream input(inputFile);
-    std::ofstream output(outputFile);
+// Memory resource that counts the allocations passed through it
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : upstream(upstream) {}
 
-    if (!input.is_open() || !output.is_open()) {
-        state.statusMessage = "Error opening files.";
-        return;
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+protected:
+    void* do_allocate(size_t size, size_t alignment) override {
+        ++allocations;
+        bytes += size;
+        return upstream->allocate(size, alignment);
+    }
+    void do_deallocate(void* p, size_t size, size_t alignment) override {
+        upstream->deallocate(p, size, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
     }
 
-    // Write header to the output file
-    output << std::left << std::setw(11) << "Track"
-           << std::setw(11) << "Note"
-           << std::setw(20) << "Duration"
-           << std::setw(20) << "Label"
-           << std::setw(25) << "Trill_Variant"
-           << "\n";
-    output << "---------------------------------------------------------------------------------\n";
+private:
+    std::pmr::memory_resource* upstream;
+};
 
-    // Reset statistics
-    state.totalEligibleNotes = 0;
-    state.transformedNotes = 0;
-    state.variantUsageCount.clear();
+// Memory resource that accounts what passes through it to one pool of a
+// MemoryUsage, while one is attached. Its upstream is the run's monotonic
+// arena, which keeps every block until the run ends, so a deallocation
+// (e.g. a vector regrowing) does not lower what the pool holds.
+class PoolResource : public std::pmr::memory_resource {
+public:
+    PoolResource(std::pmr::memory_resource* upstream, MemoryUsage::Pool pool)
+        : upstream(upstream), pool(pool) {}
+
+    MemoryUsage* usage = nullptr;
+
+protected:
+    void* do_allocate(size_t size, size_t alignment) override {
+        if (usage) usage->allocate(pool, size);
+        return upstream->allocate(size, alignment);
+    }
+    void do_deallocate(void* p, size_t size, size_t alignment) override {
+        upstream->deallocate(p, size, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
 
-    std::string line;
-    while (std::getline(input, line)) {
-        std::istringstream ss(line);
+private:
+    std::pmr::memory_resource* upstream;
+    MemoryUsage::Pool pool;
+};
 
-        int track, duration;
-        std::string noteName, label;
+// Per-run monotonic arena. Everything a run allocates (line buffers, labels,
+// trill segments, MIDI events) has the run's lifetime, so it is carved from
+// a few large blocks and released in one go when the arena is destroyed.
+// Buffers take it through the pool resource of their kind.
+struct RunArena {
+    CountingResource heap;                      // blocks taken from the heap
+    std::pmr::monotonic_buffer_resource blocks;
+    CountingResource resource;                  // requests served by the arena
+    PoolResource input{&resource, MemoryUsage::INPUT};
+    PoolResource notes{&resource, MemoryUsage::NOTES};
+    PoolResource midiEvents{&resource, MemoryUsage::MIDI_EVENTS};
+
+    explicit RunArena(size_t initialSize = 64 * 1024)
+        : blocks(initialSize, &heap), resource(&blocks) {}
+
+    // Account the pools to usage until report()
+    void track(MemoryUsage* usage) {
+        input.usage = notes.usage = midiEvents.usage = usage;
+    }
 
-        // Parse line with Note in string format (e.g., "C4")
-        if (!(ss >> track >> noteName >> duration)) {
-            output << line << "\n";  // Handle malformed lines
+    // Store the allocation counts and stop accounting, so buffers freed
+    // after the run leave its memory figures as they were at the end
+    void report(AppState& state) {
+        state.arenaRequests = resource.allocations;
+        state.arenaBlocks = heap.allocations;
+        state.arenaBytes = heap.bytes;
+        track(nullptr);
+    }
+};
+
+uint64_t steadyNanoseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Adds the time until it goes out of scope to one stage, and records it as
+// a trace span while tracing is on; does nothing otherwise
+class StageTimer {
+public:
+    StageTimer(StageTimings* timings, StageTimings::Stage stage)
+        : timings(timings), stage(stage), tracing(tracingEnabled()),
+          start(timings || tracing ? steadyNanoseconds() : 0) {}
+    ~StageTimer() {
+        if (!timings && !tracing) return;
+        uint64_t end = steadyNanoseconds();
+        if (timings) timings->nanoseconds[stage] += end - start;
+        if (tracing) recordTraceSpan(StageTimings::stageName(stage), -1, start, end);
+    }
+
+private:
+    StageTimings* timings;
+    StageTimings::Stage stage;
+    bool tracing;
+    uint64_t start;
+};
+
+// Batches progress updates for the hot loops: the per-line cost is a few
+// local increments, and the sink and token are consulted every kBatch lines.
+class ProgressReporter {
+public:
+    static const int kBatch = 1024;
+
+    ProgressReporter(ProgressSink* sink, const CancellationToken* cancel)
+        : sink(sink), cancel(cancel), lastNotify(std::chrono::steady_clock::now()) {
+        if (sink) {
+            sink->lines.store(0, std::memory_order_relaxed);
+            sink->notes.store(0, std::memory_order_relaxed);
+            sink->bytes.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void setTotalBytes(long long total) {
+        if (sink) sink->totalBytes.store(total, std::memory_order_relaxed);
+    }
+
+    // Count one input line; returns false once cancellation was requested
+    bool line(size_t lineBytes) {
+        ++lines;
+        bytes += lineBytes + 1;
+        if (--countdown > 0) return true;
+        return flush();
+    }
+
+    void note() { ++notes; }
+
+    // Publish the counters now; returns false once cancellation was requested
+    bool flush() {
+        countdown = kBatch;
+        if (sink) {
+            publish();
+            if (sink->onProgress) {
+                auto now = std::chrono::steady_clock::now();
+                if (now - lastNotify >= std::chrono::milliseconds(sink->intervalMs)) {
+                    lastNotify = now;
+                    sink->onProgress(*sink);
+                }
+            }
+        }
+        return !(cancel && cancel->isCancelled());
+    }
+
+    bool cancelled() const { return cancel && cancel->isCancelled(); }
+
+    // Final publish at the end of a run, always notifying
+    void finish() {
+        if (!sink) return;
+        publish();
+        if (sink->onProgress) sink->onProgress(*sink);
+    }
+
+private:
+    void publish() {
+        sink->lines.store(lines, std::memory_order_relaxed);
+        sink->notes.store(notes, std::memory_order_relaxed);
+        sink->bytes.store(bytes, std::memory_order_relaxed);
+    }
+
+    ProgressSink* sink;
+    const CancellationToken* cancel;
+    std::chrono::steady_clock::time_point lastNotify;
+    int countdown = kBatch;
+    long long lines = 0;
+    long long notes = 0;
+    long long bytes = 0;
+};
+
+// Output file written to a temporary sibling and moved into place by
+// commit(), so a cancelled or failed run never leaves a partial file behind
+class AtomicOutputFile {
+public:
+    AtomicOutputFile(const std::string& path, std::ios::openmode mode = std::ios::out)
+        : path(path), tempPath(path + ".part"), stream(tempPath, mode | std::ios::trunc) {}
+
+    ~AtomicOutputFile() {
+        if (!committed) {
+            stream.close();
+            std::error_code ignored;
+            std::filesystem::remove(tempPath, ignored);
+        }
+    }
+
+    bool is_open() const { return stream.is_open(); }
+
+    // Close the temporary file and rename it over the destination
+    bool commit() {
+        stream.close();
+        if (stream.fail()) return false;
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        committed = !error;
+        return committed;
+    }
+
+    const std::string path;
+    const std::string tempPath;
+    std::ofstream stream;
+
+private:
+    bool committed = false;
+};
+
+// Size of an open input stream in bytes (0 if it cannot be determined)
+static long long streamSize(std::istream& input) {
+    input.seekg(0, std::ios::end);
+    std::streamoff size = input.tellg();
+    input.seekg(0, std::ios::beg);
+    return size > 0 ? static_cast<long long>(size) : 0;
+}
+
+// Parse "Track NoteName Duration [Label]" without building a stream per line.
+// Note name and label are views into line; label is the trimmed remainder.
+// Returns false for malformed lines.
+static bool parseNoteLine(std::string_view line, int& track, std::string_view& noteName,
+                          int& duration, std::string_view& label) {
+    const char* p = line.data();
+    const char* end = p + line.size();
+    auto skipSpace = [&]() {
+        while (p < end && std::isspace(static_cast<unsigned char>(*p))) ++p;
+    };
+    auto parseInt = [&](int& value) {
+        skipSpace();
+        if (p < end && *p == '+') ++p;
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) return false;
+        p = result.ptr;
+        return true;
+    };
+
+    if (!parseInt(track)) return false;
+    skipSpace();
+    const char* nameStart = p;
+    while (p < end && !std::isspace(static_cast<unsigned char>(*p))) ++p;
+    if (p == nameStart) return false;
+    noteName = std::string_view(nameStart, p - nameStart);
+    if (!parseInt(duration)) return false;
+
+    // Trim leading whitespace and trailing carriage return/whitespace (Windows line endings)
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) --end;
+    label = std::string_view(p, end - p);
+    return true;
+}
+
+// Check if this label is eligible for transformation
+bool isEligibleLabel(std::string_view label) {
+    return labelId(label) < RunStatistics::kLabels;
+}
+
+const std::array<std::string_view, RunStatistics::kLabels>& eligibleLabels() {
+    static const std::array<std::string_view, RunStatistics::kLabels> labels = {
+        "RLN", "CS", "I3", "I8", "U2R", "BM", "SPU", "SPD", "CH", "CW", "CD",
+        "HT", "FM", "RN", "LAD", "DN", "DNW", "SN", "LNSN", "SAN", "SMP", "DLP3"
+    };
+    return labels;
+}
+
+size_t labelId(std::string_view label) {
+    // Every eligible label is 2 to 4 characters long
+    if (label.size() < 2 || label.size() > 4) return RunStatistics::kLabels;
+    const auto& labels = eligibleLabels();
+    for (size_t id = 0; id < labels.size(); ++id) {
+        if (labels[id] == label) return id;
+    }
+    return RunStatistics::kLabels;
+}
+
+void RunStatistics::clear() {
+    *this = RunStatistics();
+}
+
+RunStatistics::TrackCounts& RunStatistics::trackCounts(int track) {
+    // Consecutive notes almost always belong to the same track
+    if (lastTrack < tracks.size() && tracks[lastTrack].track == track) {
+        return tracks[lastTrack];
+    }
+    auto it = std::lower_bound(tracks.begin(), tracks.end(), track,
+                               [](const TrackCounts& counts, int value) { return counts.track < value; });
+    if (it == tracks.end() || it->track != track) {
+        TrackCounts counts;
+        counts.track = track;
+        it = tracks.insert(it, counts);
+    }
+    lastTrack = static_cast<size_t>(it - tracks.begin());
+    return *it;
+}
+
+void RunStatistics::merge(const RunStatistics& other) {
+    eligibleNotes += other.eligibleNotes;
+    transformedNotes += other.transformedNotes;
+    for (size_t i = 0; i < kVariants; ++i) {
+        variantUsage[i] += other.variantUsage[i];
+    }
+    for (size_t i = 0; i < kLabels; ++i) {
+        labelEligible[i] += other.labelEligible[i];
+        labelTransformed[i] += other.labelTransformed[i];
+    }
+    for (const TrackCounts& counts : other.tracks) {
+        TrackCounts& merged = trackCounts(counts.track);
+        merged.notes += counts.notes;
+        merged.eligible += counts.eligible;
+        merged.transformed += counts.transformed;
+    }
+}
+
+// Calls f(line) for every '\n'-terminated line of buffer (the last line may
+// be unterminated), like std::getline. Stops early when f returns false.
+template <typename F>
+static bool forEachLine(std::string_view buffer, F&& f) {
+    size_t start = 0;
+    while (start < buffer.size()) {
+        const void* found = std::memchr(buffer.data() + start, '\n', buffer.size() - start);
+        size_t end = found ? static_cast<const char*>(found) - buffer.data() : buffer.size();
+        if (!f(buffer.substr(start, end - start))) return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+// Calls f(line) for every line of input, reading in large blocks instead of
+// one getline per line. Lines are views into an arena buffer and are valid
+// only during the call. Stops early when f returns false.
+template <typename F>
+static bool forEachLine(std::istream& input, std::pmr::memory_resource* resource, F&& f,
+                        StageTimings* timings = nullptr) {
+    const size_t kBlockSize = 1 << 20;
+    std::pmr::string buffer(resource);
+    buffer.resize(kBlockSize);
+    size_t carry = 0;  // Bytes of an incomplete line kept from the last block
+
+    while (input) {
+        if (carry == buffer.size()) {
+            buffer.resize(buffer.size() * 2);  // A line longer than the buffer
+        }
+        {
+            StageTimer timer(timings, StageTimings::READ);
+            input.read(&buffer[carry], buffer.size() - carry);
+        }
+        size_t filled = carry + static_cast<size_t>(input.gcount());
+        if (filled == carry) break;
+
+        std::string_view block(buffer.data(), filled);
+        size_t lastNewline = block.rfind('\n');
+        if (lastNewline == std::string_view::npos) {
+            carry = filled;
             continue;
         }
+        TraceSpan span("lines");
+        if (!forEachLine(block.substr(0, lastNewline + 1), f)) return false;
+        carry = filled - (lastNewline + 1);
+        std::memmove(&buffer[0], buffer.data() + lastNewline + 1, carry);
+    }
+    if (carry > 0) {
+        return f(std::string_view(buffer.data(), carry));
+    }
+    return true;
+}
+
+// Appends value left-aligned in a field of width columns, like
+// std::left << std::setw(width) << value
+static void appendField(std::string& out, std::string_view value, size_t width) {
+    out.append(value);
+    if (value.size() < width) out.append(width - value.size(), ' ');
+}
 
-        std::getline(ss, label);
-        label.erase(0, label.find_first_not_of(" \t"));  // Trim leading whitespace
-        // Remove trailing carriage return and whitespace (Windows line endings)
-        label.erase(label.find_last_not_of(" \t\r\n") + 1);
+static void appendField(std::string& out, int value, size_t width) {
+    char digits[16];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    appendField(out, std::string_view(digits, result.ptr - digits), width);
+}
 
-        // Check if this label is eligible for transformation
-        if (label == "RLN" || label == "CS" || label == "I3" || label == "I8" ||
-            label == "U2R" || label == "BM" || label == "SPU" || label == "SPD" ||
-            label == "CH" || label == "CW" || label == "CD" || label == "HT" ||
-            label == "FM" || label == "RN" || label == "LAD" || label == "DN" ||
-            label == "DNW" || label == "SN" || label == "LNSN" || label == "SAN" ||
-            label == "SMP" || label == "DLP3") {
-
-            state.totalEligibleNotes++;
-
-            // Check if this note should be transformed based on percentage
-            if (shouldTransformLabel(state.transformationPercentage)) {
-                state.transformedNotes++;
-
-                try {
-                    // Convert note name to MIDI number
-                    int noteIndex = getNoteNumber(noteName);
-
-                    // Randomly select a variant from the user's choices
-                    std::string selectedVariant;
-                    if (state.selectedVariants.empty() || (state.selectedVariants.size() == 1 && state.selectedVariants[0] == "RANDOM")) {
-                        // Use a random variant from the complete list
-                        std::vector<TrillVariant> allVariants = generateRandomTrillVariantPool(100); // Get a large pool
-                        selectedVariant = allVariants[rand() % allVariants.size()].code;
-                    } else {
-                        // Use one of the user's selected variants randomly
-                        selectedVariant = state.selectedVariants[rand() % state.selectedVariants.size()];
-                    }
+static void appendU16(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+static void appendU32(std::string& out, uint32_t value) {
+    appendU16(out, value & 0xFFFF);
+    appendU16(out, value >> 16);
+}
+
+static uint32_t readU32(std::string_view data, size_t pos) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | static_cast<unsigned char>(data[pos + i]);
+    }
+    return value;
+}
+
+static void appendBigEndian(std::string& out, uint32_t value, int bytes) {
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+// Header written at the top of every text table
+static void appendTextHeader(std::string& out) {
+    appendField(out, "Track", 11);
+    appendField(out, "Note", 11);
+    appendField(out, "Duration", 20);
+    appendField(out, "Label", 20);
+    appendField(out, "Trill_Variant", 25);
+    out += "\n";
+    out += "---------------------------------------------------------------------------------\n";
+}
+
+// Binary record kinds and the variant index of rows without a trill
+static const uint32_t kBinaryPlain = 0;
+static const uint32_t kBinaryOriginal = 1;
+static const uint32_t kBinaryTrill = 2;
+static const uint32_t kNoVariant = 0xFFFF;
+
+// Index of a variant code in the built-in table, or kNoVariant
+static uint32_t variantIndex(std::string_view code) {
+    size_t index = builtInTrillIndex(code);
+    return index < allTrillVariants().size() ? static_cast<uint32_t>(index) : kNoVariant;
+}
+
+// Output buffer that is appended to during a run and, when drain is set,
+// flushed into that stream once it grows past kDrainSize
+struct OutputChannel {
+    static const size_t kDrainSize = 1 << 20;
+
+    std::string* buffer = nullptr;
+    std::ostream* drain = nullptr;
+    size_t startSize = 0;  // Caller's content before the run, kept on rollback
+    StageTimings* timings = nullptr;  // Drains count as WRITE, forced ones as FLUSH
+
+    explicit operator bool() const { return buffer != nullptr; }
+
+    void open(std::string* target, std::ostream* stream) {
+        buffer = target;
+        drain = stream;
+        startSize = target ? target->size() : 0;
+    }
+
+    void flush(bool force) {
+        if (buffer && drain && (force || buffer->size() >= kDrainSize)) {
+            StageTimer timer(timings, force ? StageTimings::FLUSH : StageTimings::WRITE);
+            drain->write(buffer->data(), buffer->size());
+            buffer->clear();
+        }
+    }
+
+    void rollback() {
+        if (buffer && !drain) buffer->resize(startSize);
+    }
+};
+
+// MIDI number of a note name, or -1 if the name is invalid
+static int noteNumberOrInvalid(std::string_view noteName) {
+    try {
+        return getNoteNumber(noteName);
+    } catch (const std::exception&) {
+        return -1;
+    }
+}
+
+// Collects note events per track and encodes them as a Standard MIDI File
+class MidiWriter {
+public:
+    explicit MidiWriter(std::pmr::memory_resource* resource) : tracks(resource) {}
+
+    // Add a note at the end of its track
+    void addNote(int track, int noteNumber, int duration) {
+        // FIXED: Use track-specific positioning for sequential notes within each track
+        size_t slot = tracks.slot(track);
+        int& trackPosition = tracks.positions[slot];
+        std::pmr::vector<MidiEvent>& events = tracks.events[slot];
+
+        // Create note-on event at the track's current position
+        events.push_back(MidiEvent::make(trackPosition, noteNumber, 0x64, true));
+
+        // Create note-off event
+        events.push_back(MidiEvent::make(trackPosition + duration, noteNumber, 0x00, false));
+
+        // Update the position for this track (notes within a track are sequential)
+        trackPosition += duration;
+    }
+
+    // Add the note of one text-table row by name; throws std::invalid_argument
+    // if the name is invalid or outside the MIDI range
+    void addNamedNote(int track, std::string_view noteName, int duration) {
+        int noteNumber = getNoteNumber(noteName);
+        if (noteNumber > 127) {
+            throw std::invalid_argument("Note out of MIDI range: " + std::string(noteName));
+        }
+        addNote(track, noteNumber, duration);
+    }
+
+    // Rows that carry no note for MIDI: header rows, separator lines, analyzer
+    // banners and negative tracks (whose rows start with '-')
+    static bool skipsRow(int track, std::string_view noteName, std::string_view label) {
+        return track < 0 || noteName == "Note" || noteName == "Track" ||
+               label.find("MIDI File Analyzed") != std::string_view::npos;
+    }
+
+    // Add the note of one text-table line, skipping non-note lines.
+    // Returns true if a note was added.
+    bool addTableLine(std::string_view line, size_t lineNumber, AppState& state) {
+        // Skip lines that don't contain note data
+        if (line.empty() || line[0] == '-' || line.find("MIDI File Analyzed") != std::string_view::npos) {
+            return false;
+        }
+
+        // Parse the line
+        int track, duration;
+        std::string_view noteName, label;
+        if (!parseNoteLine(line, track, noteName, duration, label)) {
+            return false; // Skip malformed lines
+        }
+
+        // Skip header or non-note lines
+        if (noteName == "Note" || noteName == "Track") {
+            return false;
+        }
 
-                    // Apply trill transformation
-                    auto transformed = applyTrill(noteIndex, duration, DUPLE, selectedVariant);
-
-                    // Track variant usage
-                    state.variantUsageCount[selectedVariant]++;
-
-                    // Output the transformed notes
-                    for (const auto& [transformedNote, transformedDuration] : transformed) {
-                        std::string transNote = getNoteName(transformedNote); // Convert MIDI to readable name
-                        output << std::left
-                               << std::setw(11) << track
-                               << std::setw(11) << transNote
-                               << std::setw(20) << transformedDuration
-                               << std::setw(20) << label
-                               << std::setw(25) << selectedVariant
-                               << "\n";
+        try {
+            addNamedNote(track, noteName, duration);
+            return true;
+        } catch (const std::exception& e) {
+            bool named = noteNumberOrInvalid(noteName) >= 0;
+            state.diagnostics.add(named ? Diagnostics::NOTE_OUT_OF_RANGE : Diagnostics::INVALID_NOTE_NAME, lineNumber, [&] {
+                return "Error processing note '" + std::string(noteName) + "': " + std::string(e.what());
+            });
+            return false;
+        }
+    }
+
+    // Append the file to out, draining it between tracks. Returns false if
+    // cancelled; the caller discards the partial output.
+    bool encode(OutputChannel& out, const ProgressReporter& progress) {
+        std::string& smf = *out.buffer;
+
+        // Write MIDI header
+        // Format: MThd + <length> + <format> + <tracks> + <division>
+        smf.append("MThd", 4);            // Chunk type
+        appendBigEndian(smf, 6, 4);       // Header length (always 6 bytes)
+        appendBigEndian(smf, 1, 2);       // Format (0 = single track, 1 = multiple tracks, same timebase)
+        appendBigEndian(smf, static_cast<uint32_t>(tracks.size()), 2);  // Number of tracks
+        appendBigEndian(smf, 1024, 2);    // Division (ticks per quarter note = 1024)
+
+        // Write each track
+        for (std::pmr::vector<MidiEvent>& sortedEvents : tracks.events) {
+            if (progress.cancelled()) {
+                return false;
+            }
+
+            // Sort events by time, note-offs first. Notes within a track are
+            // appended in order, so the events are usually sorted already.
+            {
+                StageTimer timer(out.timings, StageTimings::SORT);
+                if (!std::is_sorted(sortedEvents.begin(), sortedEvents.end())) {
+                    std::sort(sortedEvents.begin(), sortedEvents.end());
+                }
+            }
+            bool tracing = tracingEnabled();
+            uint64_t encodeStart = out.timings || tracing ? steadyNanoseconds() : 0;
+
+            // Write track header with a placeholder length, filled in below
+            smf.append("MTrk", 4);
+            size_t trackLengthPos = smf.size();
+            smf.append(4, '\0');
+            size_t trackStartPos = smf.size();
+
+            // Set instrument (program change) - using piano (0) as default
+            smf.append({0x00, static_cast<char>(0xC0), 0x00}); // Delta time, command, program number
+
+            int lastTime = 0;
+            for (const MidiEvent& event : sortedEvents) {
+                // Write delta time (variable length)
+                int deltaTime = event.tick() - lastTime;
+                lastTime = event.tick();
+
+                // Convert delta time to variable length quantity (at most 5 bytes for 32 bits)
+                char vlq[5];
+                int vlqLength = 0;
+                if (deltaTime == 0) {
+                    vlq[vlqLength++] = 0;
+                } else {
+                    while (deltaTime > 0) {
+                        char byte = deltaTime & 0x7F;
+                        deltaTime >>= 7;
+                        if (vlqLength > 0) {
+                            byte |= 0x80;
+                        }
+                        vlq[vlqLength++] = byte;
                     }
-                } catch (const std::exception& e) {
-                    // Handle cases where getNoteNumber produces an error
-                    state.statusMessage += "Error processing note '" + noteName + "': " + e.what() + "\n";
+                    std::reverse(vlq, vlq + vlqLength);
                 }
-            } else {
-                // Output original data for notes not selected for transformation
-                output << std::left
-                       << std::setw(11) << track
-                       << std::setw(11) << noteName
-                       << std::setw(20) << duration
-                       << std::setw(20) << label
-                       << std::setw(25) << "ORIGINAL" // Mark as original
-                       << "\n";
+                smf.append(vlq, vlqLength);
+
+                // Write note event: 0x90 note on / 0x80 note off | channel, note, velocity
+                smf.push_back(static_cast<char>(event.isNoteOn() ? 0x90 : 0x80));
+                smf.push_back(static_cast<char>(event.noteNumber()));
+                smf.push_back(static_cast<char>(event.velocity()));
             }
-        } else {
-            // Output original data for non-eligible labels
-            output << std::left
-                   << std::setw(11) << track
-                   << std::setw(11) << noteName
-                   << std::setw(20) << duration
-                   << std::setw(20) << label
-                   << std::setw(25) << "" // Empty variant column
-                   << "\n";
+
+            // Write end of track: delta time, meta event, end of track, length
+            smf.append({0x00, static_cast<char>(0xFF), 0x2F, 0x00});
+
+            // Calculate and write track length
+            uint32_t trackLength = static_cast<uint32_t>(smf.size() - trackStartPos);
+            for (int i = 0; i < 4; ++i) {
+                smf[trackLengthPos + i] = static_cast<char>((trackLength >> (24 - 8 * i)) & 0xFF);
+            }
+            if (out.timings || tracing) {
+                uint64_t encodeEnd = steadyNanoseconds();
+                if (out.timings) out.timings->nanoseconds[StageTimings::ENCODE] += encodeEnd - encodeStart;
+                if (tracing) recordTraceSpan("encode", -1, encodeStart, encodeEnd);
+            }
+            out.flush(false);
         }
+        return true;
     }
 
-    input.close();
-    output.close();
+private:
+    MidiTrackTable tracks;
+};
 
+std::string transformationSummary(const AppState& state, const std::string& destination) {
     // Calculate actual percentage
     double actualPercentage = state.totalEligibleNotes > 0 ?
         (static_cast<double>(state.transformedNotes) / state.totalEligibleNotes) * 100.0 : 0.0;
@@ -706,191 +1124,1044 @@ void processFile(const std::string& inputFile, const std::string& outputFile, Ap
         summary << "Variant selection: Random\n";
     }
 
-    summary << "Processing complete. Transformed results written to " << outputFile << "\n";
-    state.resultSummary = summary.str();
-    state.statusMessage = "Processing complete!";
-    state.processingComplete = true;
+    if (!state.diagnostics.empty()) {
+        summary << state.diagnostics.summary() << "\n";
+    }
+
+    summary << "Memory: " << state.arenaRequests << " allocations served from "
+            << state.arenaBlocks << " arena blocks (" << state.arenaBytes / 1024 << " KB)\n";
+    if (state.memory.peakTotal > 0) {
+        summary << state.memory.summary();
+    }
+    if (state.timings.wallNanoseconds > 0) {
+        summary << state.timings.summary();
+    }
+    summary << "Processing complete. Transformed results written to " << destination << "\n";
+    return summary.str();
 }
 
-// Function to convert processed data to MIDI file with MIDI sync fix
-void convertToMidi(const std::string& inputFile, const std::string& outputFile, AppState& state) {
-    std::ifstream input(inputFile);
-    if (!input.is_open()) {
-        state.statusMessage += "Error opening input file: " + inputFile + "\n";
-        return;
+void Diagnostics::clear() {
+    *this = Diagnostics();
+}
+
+size_t Diagnostics::total() const {
+    size_t sum = 0;
+    for (size_t count : counts) {
+        sum += count;
     }
+    return sum;
+}
 
-    // Skip header lines
-    std::string line;
-    std::getline(input, line); // Skip column headers
-    std::getline(input, line); // Skip separator line
+void Diagnostics::merge(const Diagnostics& other, size_t lineOffset) {
+    for (size_t i = 0; i < kCategories; ++i) {
+        counts[i] += other.counts[i];
+    }
+    for (size_t i = 0; i < other.examples.size() && examples.size() < kExamples; ++i) {
+        const Example& example = other.examples[i];
+        examples.push_back(Example{example.line + lineOffset, example.category, example.text});
+    }
+}
 
-    // Parse the file and collect note events
-    std::map<int, std::vector<MidiEvent>> trackEvents;
-    std::map<int, int> trackPositions; // FIXED: Track positions for sequential notes within each track
+std::string Diagnostics::summary() const {
+    static const char* const names[kCategories][2] = {
+        {"invalid note name", "invalid note names"},
+        {"note outside the MIDI range", "notes outside the MIDI range"},
+        {"rejected trill", "rejected trills"}
+    };
+    size_t problems = total();
+    std::string text = std::to_string(problems) + (problems == 1 ? " problem" : " problems") + " in the input: ";
+    bool first = true;
+    for (size_t i = 0; i < kCategories; ++i) {
+        if (counts[i] == 0) continue;
+        text += (first ? "" : ", ") + std::to_string(counts[i]) + " " + names[i][counts[i] == 1 ? 0 : 1];
+        first = false;
+    }
+    text += "\n";
+    for (const Example& example : examples) {
+        text += "  line " + std::to_string(example.line) + ": " + example.text + "\n";
+    }
+    if (problems > examples.size()) {
+        text += "  (and " + std::to_string(problems - examples.size()) + " more)\n";
+    }
+    return text;
+}
 
-    while (std::getline(input, line)) {
-        std::istringstream ss(line);
-        int track;
-        std::string noteName;
-        int duration;
-        std::string label, variant;
+const char* Diagnostics::categoryName(Category category) {
+    static const char* const names[kCategories] = {"invalid_note_name", "note_out_of_range", "trill_rejected"};
+    return names[category];
+}
 
-        // Skip lines that don't contain note data
-        if (line.empty() || line[0] == '-' || line.find("MIDI File Analyzed") != std::string::npos) {
-            continue;
+const char* StageTimings::stageName(Stage stage) {
+    static const char* const names[kStages] = {
+        "open", "read", "parse", "select", "transform", "format", "write",
+        "midi_collect", "sort", "encode", "flush"
+    };
+    return names[stage];
+}
+
+void StageTimings::merge(const StageTimings& other) {
+    for (size_t i = 0; i < kStages; ++i) {
+        nanoseconds[i] += other.nanoseconds[i];
+    }
+    wallNanoseconds += other.wallNanoseconds;
+    lines += other.lines;
+    bytes += other.bytes;
+}
+
+std::string StageTimings::summary() const {
+    double seconds = wallNanoseconds / 1e9;
+    std::stringstream text;
+    text << std::fixed << std::setprecision(1)
+         << "Timing: " << wallNanoseconds / 1e6 << " ms for " << lines << " lines ("
+         << std::setprecision(0) << (seconds > 0 ? lines / seconds : 0.0) << " lines/s, "
+         << std::setprecision(1) << (seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0.0) << " MB/s)\n";
+    bool anySampled = false;
+    for (size_t i = 0; i < kStages; ++i) {
+        Stage stage = static_cast<Stage>(i);
+        if (nanoseconds[i] == 0) continue;
+        anySampled = anySampled || sampled(stage);
+        text << "  " << std::left << std::setw(14) << (std::string(stageName(stage)) + (sampled(stage) ? "~" : ""))
+             << std::right << std::setw(10) << nanoseconds[i] / 1e6 << " ms"
+             << std::setw(7) << (wallNanoseconds > 0 ? 100.0 * nanoseconds[i] / wallNanoseconds : 0.0) << "%\n";
+    }
+    if (anySampled) {
+        text << "  (~ estimated from 1 line in " << kSampleEvery << ")\n";
+    }
+    return text.str();
+}
+
+std::string runStatsJson(const AppState& state) {
+    const StageTimings& timings = state.timings;
+    double seconds = timings.wallNanoseconds / 1e9;
+    std::stringstream json;
+    json << std::fixed << std::setprecision(1)
+         << "{\"wall_ns\": " << timings.wallNanoseconds
+         << ", \"lines\": " << timings.lines
+         << ", \"bytes\": " << timings.bytes
+         << ", \"lines_per_second\": " << (seconds > 0 ? timings.lines / seconds : 0.0)
+         << ", \"bytes_per_second\": " << (seconds > 0 ? timings.bytes / seconds : 0.0)
+         << ", \"stages_ns\": {";
+    for (size_t i = 0; i < StageTimings::kStages; ++i) {
+        json << (i ? ", " : "") << "\"" << StageTimings::stageName(static_cast<StageTimings::Stage>(i)) << "\": "
+             << timings.nanoseconds[i];
+    }
+    json << "}, \"sample_every\": " << StageTimings::kSampleEvery
+         << ", \"eligible_notes\": " << state.totalEligibleNotes
+         << ", \"transformed_notes\": " << state.transformedNotes
+         << ", \"problems\": " << state.diagnostics.total()
+         << ", \"allocations\": {\"arena_requests\": " << state.arenaRequests
+         << ", \"arena_blocks\": " << state.arenaBlocks
+         << ", \"arena_bytes\": " << state.arenaBytes << "}"
+         << ", \"memory\": {\"peak_bytes\": " << state.memory.peakTotal
+         << ", \"current_bytes\": " << state.memory.currentTotal << ", \"pools\": {";
+    for (size_t i = 0; i < MemoryUsage::kPools; ++i) {
+        json << (i ? ", " : "") << "\"" << MemoryUsage::poolName(static_cast<MemoryUsage::Pool>(i)) << "\": "
+             << "{\"peak_bytes\": " << state.memory.peak[i] << ", \"current_bytes\": " << state.memory.current[i]
+             << ", \"allocations\": " << state.memory.allocations[i] << "}";
+    }
+    json << "}}}";
+    return json.str();
+}
+
+static double unixSeconds() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void RunMetrics::add(const AppState& state, uint64_t bytesWritten, bool ok) {
+    ++runs;
+    failedRuns += ok ? 0 : 1;
+    lines += state.timings.lines;
+    inputBytes += state.timings.bytes;
+    outputBytes += bytesWritten;
+    eligibleNotes += state.totalEligibleNotes;
+    transformedNotes += state.transformedNotes;
+    for (const auto& [code, count] : state.variantUsageCount) {
+        variantNotes[code] += count;
+    }
+    for (size_t i = 0; i < StageTimings::kStages; ++i) {
+        stageNanoseconds[i] += state.timings.nanoseconds[i];
+    }
+    wallNanoseconds += state.timings.wallNanoseconds;
+    for (size_t i = 0; i < Diagnostics::kCategories; ++i) {
+        problems[i] += state.diagnostics.counts[i];
+    }
+    peakMemoryBytes = std::max(peakMemoryBytes, state.memory.peakTotal);
+    lastPeakMemoryBytes = state.memory.peakTotal;
+    lastRunOk = ok;
+    lastRunTimestamp = unixSeconds();
+}
+
+void RunMetrics::addFailure() {
+    ++runs;
+    ++failedRuns;
+    lastRunOk = false;
+    lastRunTimestamp = unixSeconds();
+}
+
+void RunMetrics::merge(const RunMetrics& other) {
+    runs += other.runs;
+    failedRuns += other.failedRuns;
+    lines += other.lines;
+    inputBytes += other.inputBytes;
+    outputBytes += other.outputBytes;
+    eligibleNotes += other.eligibleNotes;
+    transformedNotes += other.transformedNotes;
+    for (const auto& [code, count] : other.variantNotes) {
+        variantNotes[code] += count;
+    }
+    for (size_t i = 0; i < StageTimings::kStages; ++i) {
+        stageNanoseconds[i] += other.stageNanoseconds[i];
+    }
+    wallNanoseconds += other.wallNanoseconds;
+    for (size_t i = 0; i < Diagnostics::kCategories; ++i) {
+        problems[i] += other.problems[i];
+    }
+    peakMemoryBytes = std::max(peakMemoryBytes, other.peakMemoryBytes);
+    if (other.runs > 0 && other.lastRunTimestamp >= lastRunTimestamp) {
+        lastPeakMemoryBytes = other.lastPeakMemoryBytes;
+        lastRunOk = other.lastRunOk;
+        lastRunTimestamp = other.lastRunTimestamp;
+    }
+}
+
+// Label value with backslash, quote and newline escaped
+static std::string metricLabel(std::string_view value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') escaped.push_back('\\');
+        if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped.push_back(c);
         }
+    }
+    return escaped;
+}
 
-        // Parse the line
-        if (!(ss >> track >> noteName >> duration)) {
-            continue; // Skip malformed lines
+std::string RunMetrics::prometheusText() const {
+    std::stringstream text;
+    auto header = [&text](const char* name, const char* type, const char* help) {
+        text << "# HELP trill_" << name << " " << help << "\n# TYPE trill_" << name << " " << type << "\n";
+    };
+    header("runs_total", "counter", "Transformation runs finished, by result.");
+    text << "trill_runs_total{result=\"ok\"} " << runs - failedRuns << "\n"
+         << "trill_runs_total{result=\"failed\"} " << failedRuns << "\n";
+    header("lines_processed_total", "counter", "Input lines processed.");
+    text << "trill_lines_processed_total " << lines << "\n";
+    header("input_bytes_total", "counter", "Input bytes processed.");
+    text << "trill_input_bytes_total " << inputBytes << "\n";
+    header("output_bytes_total", "counter", "Bytes written to output files.");
+    text << "trill_output_bytes_total " << outputBytes << "\n";
+    header("eligible_notes_total", "counter", "Notes with a label eligible for transformation.");
+    text << "trill_eligible_notes_total " << eligibleNotes << "\n";
+    header("notes_transformed_total", "counter", "Notes transformed, by trill variant.");
+    for (const auto& [code, count] : variantNotes) {
+        text << "trill_notes_transformed_total{variant=\"" << metricLabel(code) << "\"} " << count << "\n";
+    }
+    header("input_problems_total", "counter", "Problems found in the input, by category.");
+    for (size_t i = 0; i < Diagnostics::kCategories; ++i) {
+        text << "trill_input_problems_total{category=\""
+             << Diagnostics::categoryName(static_cast<Diagnostics::Category>(i)) << "\"} " << problems[i] << "\n";
+    }
+
+    text << std::fixed << std::setprecision(6);
+    header("stage_seconds_total", "counter", "Time spent per processing stage (per-line stages estimated from samples).");
+    for (size_t i = 0; i < StageTimings::kStages; ++i) {
+        text << "trill_stage_seconds_total{stage=\"" << StageTimings::stageName(static_cast<StageTimings::Stage>(i))
+             << "\"} " << stageNanoseconds[i] / 1e9 << "\n";
+    }
+    header("run_seconds_total", "counter", "Wall time of the runs.");
+    text << "trill_run_seconds_total " << wallNanoseconds / 1e9 << "\n";
+
+    header("memory_peak_bytes", "gauge", "Largest peak memory of a run.");
+    text << "trill_memory_peak_bytes " << peakMemoryBytes << "\n";
+    header("last_run_memory_peak_bytes", "gauge", "Peak memory of the latest run.");
+    text << "trill_last_run_memory_peak_bytes " << lastPeakMemoryBytes << "\n";
+    header("last_run_success", "gauge", "1 if the latest run succeeded, else 0.");
+    text << "trill_last_run_success " << (lastRunOk ? 1 : 0) << "\n";
+    header("last_run_timestamp_seconds", "gauge", "Unix time the latest run ended.");
+    text << std::setprecision(3) << "trill_last_run_timestamp_seconds " << lastRunTimestamp << "\n";
+    return text.str();
+}
+
+const char* MemoryUsage::poolName(Pool pool) {
+    static const char* const names[kPools] = {"input", "notes", "midi_events", "output"};
+    return names[pool];
+}
+
+void MemoryUsage::merge(const MemoryUsage& other) {
+    for (size_t i = 0; i < kPools; ++i) {
+        current[i] += other.current[i];
+        peak[i] += other.peak[i];
+        allocations[i] += other.allocations[i];
+    }
+    currentTotal += other.currentTotal;
+    peakTotal += other.peakTotal;
+}
+
+std::string MemoryUsage::summary() const {
+    const double kMegabyte = 1024.0 * 1024.0;
+    size_t count = 0;
+    std::stringstream text;
+    text << std::fixed << std::setprecision(1) << "Peak memory: " << peakTotal / kMegabyte << " MB (";
+    for (size_t i = 0; i < kPools; ++i) {
+        text << (i ? ", " : "") << poolName(static_cast<Pool>(i)) << " " << peak[i] / kMegabyte;
+        count += allocations[i];
+    }
+    text << " MB at their own peaks), " << currentTotal / kMegabyte << " MB held at the end, "
+         << count << " allocations\n";
+    return text.str();
+}
+
+void publishStatistics(AppState& state) {
+    const RunStatistics& statistics = state.statistics;
+    state.totalEligibleNotes = statistics.eligibleNotes;
+    state.transformedNotes = statistics.transformedNotes;
+    const std::vector<TrillVariant>& variants = allTrillVariants();
+    for (size_t id = 0; id < variants.size() && id < RunStatistics::kVariants; ++id) {
+        if (statistics.variantUsage[id] > 0) {
+            state.variantUsageCount[variants[id].code] = statistics.variantUsage[id];
         }
+    }
+}
 
-        // Skip header or non-note lines
-        if (noteName == "Note" || noteName == "Track") {
-            continue;
+std::string statisticsBreakdown(const RunStatistics& statistics) {
+    auto percent = [](uint64_t part, uint64_t whole) {
+        return whole > 0 ? 100.0 * part / whole : 0.0;
+    };
+    std::stringstream breakdown;
+    breakdown << std::fixed << std::setprecision(1) << "By label:\n"
+              << std::left << std::setw(8) << "  Label" << std::right << std::setw(12) << "Eligible"
+              << std::setw(14) << "Transformed" << std::setw(8) << "%" << "\n";
+    for (size_t id = 0; id < RunStatistics::kLabels; ++id) {
+        if (statistics.labelEligible[id] == 0) continue;
+        breakdown << "  " << std::left << std::setw(6) << eligibleLabels()[id] << std::right
+                  << std::setw(12) << statistics.labelEligible[id] << std::setw(14) << statistics.labelTransformed[id]
+                  << std::setw(8) << percent(statistics.labelTransformed[id], statistics.labelEligible[id]) << "\n";
+    }
+    breakdown << "By track:\n"
+              << std::left << std::setw(8) << "  Track" << std::right << std::setw(12) << "Notes"
+              << std::setw(12) << "Eligible" << std::setw(14) << "Transformed" << std::setw(8) << "%" << "\n";
+    for (const RunStatistics::TrackCounts& counts : statistics.tracks) {
+        breakdown << "  " << std::left << std::setw(6) << counts.track << std::right
+                  << std::setw(12) << counts.notes << std::setw(12) << counts.eligible
+                  << std::setw(14) << counts.transformed << std::setw(8) << percent(counts.transformed, counts.eligible)
+                  << "\n";
+    }
+    return breakdown.str();
+}
+
+// Output channels of one transformation run
+struct RunOutputs {
+    OutputChannel text;
+    OutputChannel binary;
+    OutputChannel midi;
+    bool midiDiagnostics = false;  // See TransformBuffers
+};
+
+// One transformation run: statistics, random choices and output for each
+// input line or note. Shared by processFile and the in-memory APIs.
+class TransformRun {
+public:
+    TransformRun(AppState& state, RunArena& arena, ProgressReporter& progress, RunOutputs& out)
+        : state(state), arena(arena), progress(progress), out(out),
+          transformed(&arena.notes), midi(&arena.midiEvents) {}
+
+    // Reset statistics, seed the generator and write headers
+    void begin() {
+        state.statistics.clear();
+        state.diagnostics.clear();
+        state.timings.clear();
+        state.memory.clear();
+        arena.track(&state.memory);
+        startNs = steadyNanoseconds();
+        out.text.timings = out.binary.timings = out.midi.timings = &state.timings;
+        state.totalEligibleNotes = 0;
+        state.transformedNotes = 0;
+        state.variantUsageCount.clear();
+        state.cancelled = false;
+        state.rng.seed(state.seed);
+
+        randomVariant = state.selectedVariants.empty() ||
+            (state.selectedVariants.size() == 1 && state.selectedVariants[0] == "RANDOM");
+        for (const std::string& code : state.selectedVariants) {
+            selectedIndex.push_back(variantIndex(code));
         }
 
-        try {
-            int noteNumber = getNoteNumber(noteName);
+        if (out.text) {
+            appendTextHeader(*out.text.buffer);
+        }
+        if (out.binary) {
+            binaryCountPos = out.binary.buffer->size() + 8;
+            out.binary.buffer->append(kBinaryMagic, 4);
+            appendU32(*out.binary.buffer, kBinaryVersion);
+            appendU32(*out.binary.buffer, 0);  // Record count, patched in finish()
+        }
+    }
+
+    // Transform one input line; returns false once cancellation was requested
+    bool line(std::string_view line) {
+        if (!progress.line(line.size())) {
+            state.cancelled = true;
+            return false;
+        }
+        ++lineNumber;
+        inputBytes += line.size() + 1;
+        startSample();
+
+        int track, duration;
+        std::string_view noteName, label;
+
+        // Parse line with Note in string format (e.g., "C4")
+        bool parsed = parseNoteLine(line, track, noteName, duration, label);
+        mark(StageTimings::PARSE);
+        if (!parsed) {
+            if (out.text) {
+                out.text.buffer->append(line);  // Handle malformed lines
+                out.text.buffer->push_back('\n');
+            }
+            mark(StageTimings::FORMAT);
+        } else {
+            transformNote(track, noteName, duration, label, -1);
+        }
+        flush(false);
+        return true;
+    }
 
-            // FIXED: Use track-specific positioning for sequential notes within each track
-            int& trackPosition = trackPositions[track];
+    // Transform one row of a parsed table. Progress is counted by the caller,
+    // which shares one table among several runs.
+    void parsedRow(const ParsedTable::Row& parsed) {
+        ++lineNumber;
+        inputBytes += parsed.line.size() + 1;
+        startSample();
+        if (!parsed.isNote) {
+            if (out.text) {
+                out.text.buffer->append(parsed.line);
+                out.text.buffer->push_back('\n');
+            }
+            mark(StageTimings::FORMAT);
+        } else {
+            transformNote(parsed.track, parsed.noteName, parsed.duration, parsed.label, parsed.noteNumber);
+        }
+        flush(false);
+    }
 
-            // Create note-on event at the track's current position
-            MidiEvent noteOn{track, noteNumber, trackPosition, duration, true};
-            trackEvents[track].push_back(noteOn);
+    // Transform one pre-parsed note; returns false once cancellation was requested
+    bool note(int track, std::string_view noteName, int duration, std::string_view label) {
+        if (!progress.line(0)) {
+            state.cancelled = true;
+            return false;
+        }
+        ++lineNumber;
+        startSample();
+        transformNote(track, noteName, duration, label, -1);
+        flush(false);
+        return true;
+    }
 
-            // Create note-off event
-            MidiEvent noteOff{track, noteNumber, trackPosition + duration, 0, false};
-            trackEvents[track].push_back(noteOff);
+    // Encode MIDI, patch the binary header and flush everything.
+    // Returns false if the run was cancelled.
+    bool finish() {
+        publishStatistics(state);
+        progress.finish();
+        if (!state.cancelled && out.midi && !midi.encode(out.midi, progress)) {
+            state.cancelled = true;
+        }
+        holdOutputs();
+        if (state.cancelled) {
+            out.text.rollback();
+            out.binary.rollback();
+            out.midi.rollback();
+            arena.report(state);
+            recordTimings();
+            return false;
+        }
+        if (out.binary) {
+            std::string& binary = *out.binary.buffer;
+            for (int i = 0; i < 4; ++i) {
+                binary[binaryCountPos + i] = static_cast<char>((binaryRecords >> (8 * i)) & 0xFF);
+            }
+        }
+        flush(true);
+        arena.report(state);
+        recordTimings();
+        return true;
+    }
 
-            // Update the position for this track (notes within a track are sequential)
-            trackPosition += duration;
+    // Record the result summary; destination names where the results went
+    void summarize(const std::string& destination) {
+        state.resultSummary = transformationSummary(state, destination);
+        state.statusMessage = "Processing complete!";
+        if (!state.diagnostics.empty()) {
+            state.statusMessage += "\n" + state.diagnostics.summary();
+        }
+        state.processingComplete = true;
+    }
 
-        } catch (const std::exception& e) {
-            state.statusMessage += "Error processing note '" + noteName + "': " + std::string(e.what()) + "\n";
+private:
+    static constexpr const char* kBinaryMagic = "TRLB";
+    static const uint32_t kBinaryVersion = 1;
+
+    // Record the lines, bytes and time of the run, also when it was
+    // cancelled, so they cover the same lines as its note counts
+    void recordTimings() {
+        // Scale the sampled per-line stages to every line
+        StageTimings& timings = state.timings;
+        if (sampledLines > 0) {
+            for (size_t i = StageTimings::PARSE; i <= StageTimings::FORMAT; ++i) {
+                timings.nanoseconds[i] += sampledNs[i] * lineNumber / sampledLines;
+            }
         }
+        timings.lines += lineNumber;
+        timings.bytes += inputBytes;
+        timings.wallNanoseconds += steadyNanoseconds() - startNs;
     }
 
-    input.close();
+    // Time the per-line stages of every kSampleEvery-th line
+    void startSample() {
+        sampling = lineNumber % StageTimings::kSampleEvery == 0;
+        if (sampling) {
+            ++sampledLines;
+            lastMark = steadyNanoseconds();
+        }
+    }
 
-    // Write MIDI file
-    std::ofstream midiFile(outputFile, std::ios::binary);
-    if (!midiFile.is_open()) {
-        state.statusMessage += "Error opening output MIDI file: " + outputFile + "\n";
-        return;
+    // On a sampled line, add the time since the last mark to stage
+    void mark(StageTimings::Stage stage) {
+        if (!sampling) return;
+        uint64_t now = steadyNanoseconds();
+        sampledNs[stage] += now - lastMark;
+        lastMark = now;
     }
 
-    // Write MIDI header
-    // Format: MThd + <length> + <format> + <tracks> + <division>
-    midiFile.write("MThd", 4); // Chunk type
-
-    // Header length (always 6 bytes)
-    char headerLength[4] = {0, 0, 0, 6};
-    midiFile.write(headerLength, 4);
-
-    // Format (0 = single track, 1 = multiple tracks, same timebase)
-    char format[2] = {0, 1};
-    midiFile.write(format, 2);
-
-    // Number of tracks
-    int numTracks = trackEvents.size();
-    char tracksCount[2] = {static_cast<char>((numTracks >> 8) & 0xFF),
-                          static_cast<char>(numTracks & 0xFF)};
-    midiFile.write(tracksCount, 2);
-
-    // Division (ticks per quarter note = 1024)
-    char division[2] = {0x04, 0x00}; // 1024 in big-endian
-    midiFile.write(division, 2);
-
-    // Write each track
-    for (const auto& [trackNum, events] : trackEvents) {
-        // Sort events by time
-        std::vector<MidiEvent> sortedEvents = events;
-        std::sort(sortedEvents.begin(), sortedEvents.end(),
-                 [](const MidiEvent& a, const MidiEvent& b) {
-                     return a.startTime < b.startTime ||
-                            (a.startTime == b.startTime && !a.isNoteOn && b.isNoteOn);
-                 });
-
-        // Write track header
-        midiFile.write("MTrk", 4);
-
-        // Placeholder for track length (will be filled in later)
-        long trackLengthPos = midiFile.tellp();
-        midiFile.write("\0\0\0\0", 4);
-
-        // Track start position
-        long trackStartPos = midiFile.tellp();
-
-        // Write track events
-        int lastTime = 0;
-
-        // Set instrument (program change) - using piano (0) as default
-        char programChange[3] = {0x00, static_cast<char>(0xC0), 0x00}; // Delta time, command, program number
-        midiFile.write(programChange, 3);
-
-        for (const auto& event : sortedEvents) {
-            // Write delta time (variable length)
-            int deltaTime = event.startTime - lastTime;
-            lastTime = event.startTime;
-
-            // Convert delta time to variable length quantity
-            std::vector<char> vlq;
-            if (deltaTime == 0) {
-                vlq.push_back(0);
+    // noteNumber is the MIDI number of noteName if already known, else -1
+    void transformNote(int track, std::string_view noteName, int duration, std::string_view labelText,
+                       int noteNumber) {
+        RunStatistics& statistics = state.statistics;
+        RunStatistics::TrackCounts& trackCounts = statistics.trackCounts(track);
+        trackCounts.notes++;
+
+        // Check if this label is eligible for transformation
+        size_t label = labelId(labelText);
+        if (label >= RunStatistics::kLabels) {
+            // Output original data for non-eligible labels
+            mark(StageTimings::SELECT);
+            row(track, noteName, noteNumber, duration, labelText, "", kBinaryPlain, kNoVariant);
+            mark(StageTimings::FORMAT);
+            return;
+        }
+
+        statistics.eligibleNotes++;
+        statistics.labelEligible[label]++;
+        trackCounts.eligible++;
+
+        // Check if this note should be transformed based on percentage
+        if (!shouldTransformLabel(state.transformationPercentage, state.rng)) {
+            // Output original data for notes not selected for transformation
+            mark(StageTimings::SELECT);
+            row(track, noteName, noteNumber, duration, labelText, "ORIGINAL", kBinaryOriginal, kNoVariant);
+            mark(StageTimings::FORMAT);
+            return;
+        }
+
+        statistics.transformedNotes++;
+        statistics.labelTransformed[label]++;
+        trackCounts.transformed++;
+
+        Diagnostics::Category problem = Diagnostics::INVALID_NOTE_NAME;
+        try {
+            // Convert note name to MIDI number
+            int noteIndex = noteNumber >= 0 ? noteNumber : getNoteNumber(noteName);
+            problem = Diagnostics::TRILL_REJECTED;
+
+            // Randomly select a variant from the user's choices
+            const std::string* selected;
+            uint32_t selectedVariantIndex;
+            if (randomVariant) {
+                // Use a random variant from the complete list
+                const std::vector<TrillVariant>& allVariants = *state.variantTable;
+                size_t choice = uniformIndex(state.rng, allVariants.size());
+                selected = &allVariants[choice].code;
+                selectedVariantIndex = state.variantTable == &allTrillVariants() ?
+                    static_cast<uint32_t>(choice) : variantIndex(*selected);
             } else {
-                while (deltaTime > 0) {
-                    char byte = deltaTime & 0x7F;
-                    deltaTime >>= 7;
-                    if (!vlq.empty()) {
-                        byte |= 0x80;
-                    }
-                    vlq.push_back(byte);
-                }
-                std::reverse(vlq.begin(), vlq.end());
+                // Use one of the user's selected variants randomly
+                size_t choice = uniformIndex(state.rng, state.selectedVariants.size());
+                selected = &state.selectedVariants[choice];
+                selectedVariantIndex = selectedIndex[choice];
             }
+            const std::string& selectedVariant = *selected;
+            mark(StageTimings::SELECT);
 
-            for (char byte : vlq) {
-                midiFile.put(byte);
+            // Apply trill transformation
+            if (selectedVariantIndex < allTrillVariants().size()) {
+                applyTrill(noteIndex, duration, builtInTrillPlan(selectedVariantIndex, state.meter), transformed);
+            } else {
+                applyTrill(noteIndex, duration, state.meter, selectedVariant, transformed);
             }
+            mark(StageTimings::TRANSFORM);
 
-            // Write note event
-            if (event.isNoteOn) {
-                // Note on: 0x90 | channel, note, velocity
-                midiFile.put(0x90);
-                midiFile.put(static_cast<char>(event.noteNumber));
-                midiFile.put(0x64); // Velocity (100)
+            // Track variant usage; codes outside the built-in table by name
+            if (selectedVariantIndex < RunStatistics::kVariants) {
+                statistics.variantUsage[selectedVariantIndex]++;
             } else {
-                // Note off: 0x80 | channel, note, velocity
-                midiFile.put(0x80);
-                midiFile.put(static_cast<char>(event.noteNumber));
-                midiFile.put(0x00); // Velocity (0)
+                state.variantUsageCount[selectedVariant]++;
+            }
+            progress.note();
+
+            // Output the transformed notes
+            for (const auto& [transformedNote, transformedDuration] : transformed) {
+                std::string transNote = getNoteName(transformedNote); // Convert MIDI to readable name
+                row(track, transNote, transformedNote, transformedDuration, labelText, selectedVariant,
+                    kBinaryTrill, selectedVariantIndex);
+            }
+            mark(StageTimings::FORMAT);
+        } catch (const std::exception& e) {
+            // Handle cases where getNoteNumber or applyTrill produces an error
+            state.diagnostics.add(problem, lineNumber, [&] {
+                return "Error processing note '" + std::string(noteName) + "': " + e.what();
+            });
+            mark(StageTimings::TRANSFORM);
+        }
+    }
+
+    // Emit one output row to every requested format. noteNumber is -1 when
+    // the row carries an input note name that has not been resolved yet;
+    // numbers outside the named range (C0 to 127) are looked up again to
+    // report the error, since their names do not read back as notes.
+    void row(int track, std::string_view noteName, int noteNumber, int duration,
+             std::string_view label, std::string_view variant, uint32_t kind, uint32_t variantId) {
+        if (out.text) {
+            std::string& text = *out.text.buffer;
+            appendField(text, track, 11);
+            appendField(text, noteName, 11);
+            appendField(text, duration, 20);
+            appendField(text, label, 20);
+            appendField(text, variant, 25);
+            text.push_back('\n');
+        }
+
+        // MIDI and binary records carry only rows convertToMidi would read as notes
+        if ((!out.midi && !out.binary) || MidiWriter::skipsRow(track, noteName, label)) {
+            return;
+        }
+        if (noteNumber < 12 || noteNumber > 127) {
+            Diagnostics::Category problem = Diagnostics::INVALID_NOTE_NAME;
+            try {
+                noteNumber = getNoteNumber(noteName);
+                if (noteNumber > 127) {
+                    problem = Diagnostics::NOTE_OUT_OF_RANGE;
+                    throw std::invalid_argument("Note out of MIDI range: " + std::string(noteName));
+                }
+            } catch (const std::exception& e) {
+                if (out.midi || out.midiDiagnostics) {
+                    state.diagnostics.add(problem, lineNumber, [&] {
+                        return "Error processing note '" + std::string(noteName) + "': " + e.what();
+                    });
+                }
+                return;
+            }
+        }
+        if (out.midi) {
+            midi.addNote(track, noteNumber, duration);
+        }
+        if (out.binary) {
+            // Record: int32 track, int32 duration, uint8 note, uint8 kind, uint16 variant
+            std::string& binary = *out.binary.buffer;
+            appendU32(binary, static_cast<uint32_t>(track));
+            appendU32(binary, static_cast<uint32_t>(duration));
+            binary.push_back(static_cast<char>(noteNumber));
+            binary.push_back(static_cast<char>(kind));
+            appendU16(binary, variantId);
+            ++binaryRecords;
+        }
+    }
+
+    // Account the output buffers by their capacity
+    void holdOutputs() {
+        size_t bytes = 0;
+        for (const OutputChannel* channel : {&out.text, &out.binary, &out.midi}) {
+            if (*channel) bytes += channel->buffer->capacity();
+        }
+        state.memory.hold(MemoryUsage::OUTPUT, bytes);
+    }
+
+    void flush(bool force) {
+        if (sampling) holdOutputs();
+
+        // The binary channel is never drained: its header is patched in finish()
+        out.text.flush(force);
+        out.midi.flush(force);
+    }
+
+    AppState& state;
+    RunArena& arena;
+    ProgressReporter& progress;
+    RunOutputs& out;
+    TrillSegments transformed;
+    MidiWriter midi;
+    size_t lineNumber = 0;  // Input line (or note entry) being processed
+    size_t inputBytes = 0;
+    uint64_t startNs = 0;
+    bool sampling = false;
+    uint64_t lastMark = 0;
+    uint64_t sampledLines = 0;
+    std::array<uint64_t, StageTimings::kStages> sampledNs{};
+    bool randomVariant = false;
+    std::vector<uint32_t> selectedIndex;
+    size_t binaryCountPos = 0;
+    uint32_t binaryRecords = 0;
+};
+
+// Function to process file with GUI integration
+void processFile(const std::string& inputFile, const std::string& outputFile, AppState& state,
+                 ProgressSink* progressSink, const CancellationToken* cancel) {
+    TraceSpan span("processFile");
+    uint64_t started = steadyNanoseconds();
+    std::ifstream input(inputFile);
+    AtomicOutputFile outputFileWriter(outputFile);
+    uint64_t opened = steadyNanoseconds();
+
+    if (!input.is_open() || !outputFileWriter.is_open()) {
+        state.statusMessage = "Error opening files.";
+        return;
+    }
+
+    ProgressReporter progress(progressSink, cancel);
+    progress.setTotalBytes(streamSize(input));
+
+    // All per-run buffers come from the arena and are reused line to line
+    RunArena arena;
+    std::string text;
+    RunOutputs out;
+    out.text.open(&text, &outputFileWriter.stream);
+
+    TransformRun run(state, arena, progress, out);
+    run.begin();
+    state.timings.nanoseconds[StageTimings::OPEN] = opened - started;
+    forEachLine(input, &arena.input, [&](std::string_view line) { return run.line(line); }, &state.timings);
+    input.close();
+
+    if (!run.finish()) {
+        state.resultSummary = "Processing cancelled after " + std::to_string(state.totalEligibleNotes) +
+                              " eligible notes.\n";
+        state.statusMessage = "Processing cancelled.";
+        state.processingComplete = false;
+        return;
+    }
+    bool committed;
+    {
+        StageTimer timer(&state.timings, StageTimings::FLUSH);
+        committed = outputFileWriter.commit();
+    }
+    if (!committed) {
+        state.statusMessage = "Error writing output file: " + outputFile;
+        return;
+    }
+    state.timings.wallNanoseconds = steadyNanoseconds() - started;
+    run.summarize(outputFile);
+}
+
+// Shared tail of the in-memory runs
+static void finishBufferRun(TransformRun& run, AppState& state) {
+    if (!run.finish()) {
+        state.resultSummary = "Processing cancelled after " + std::to_string(state.totalEligibleNotes) +
+                              " eligible notes.\n";
+        state.statusMessage = "Processing cancelled.";
+        state.processingComplete = false;
+        return;
+    }
+    run.summarize("memory");
+}
+
+void transformBuffer(std::string_view input, const TransformBuffers& buffers, AppState& state,
+                     ProgressSink* progressSink, const CancellationToken* cancel) {
+    TraceSpan span("transformBuffer");
+    ProgressReporter progress(progressSink, cancel);
+    progress.setTotalBytes(static_cast<long long>(input.size()));
+
+    RunArena arena;
+    RunOutputs out;
+    out.text.open(buffers.text, nullptr);
+    out.binary.open(buffers.binary, nullptr);
+    out.midi.open(buffers.midi, nullptr);
+    out.midiDiagnostics = buffers.midiDiagnostics;
+
+    TransformRun run(state, arena, progress, out);
+    run.begin();
+    forEachLine(input, [&](std::string_view line) { return run.line(line); });
+    finishBufferRun(run, state);
+}
+
+void transformNotes(const NoteEntry* notes, size_t count, const TransformBuffers& buffers, AppState& state,
+                    ProgressSink* progressSink, const CancellationToken* cancel) {
+    TraceSpan span("transformNotes");
+    ProgressReporter progress(progressSink, cancel);
+
+    RunArena arena;
+    RunOutputs out;
+    out.text.open(buffers.text, nullptr);
+    out.binary.open(buffers.binary, nullptr);
+    out.midi.open(buffers.midi, nullptr);
+    out.midiDiagnostics = buffers.midiDiagnostics;
+
+    TransformRun run(state, arena, progress, out);
+    run.begin();
+    for (size_t i = 0; i < count; ++i) {
+        if (!run.note(notes[i].track, notes[i].noteName, notes[i].duration, notes[i].label)) {
+            break;
+        }
+    }
+    finishBufferRun(run, state);
+}
+
+void parseTable(std::string_view input, ParsedTable& table) {
+    table.rows.clear();
+    table.rows.reserve(static_cast<size_t>(std::count(input.begin(), input.end(), '\n')) + 1);
+    table.bytes = input.size();
+    forEachLine(input, [&](std::string_view line) {
+        ParsedTable::Row row;
+        row.line = line;
+        row.isNote = parseNoteLine(line, row.track, row.noteName, row.duration, row.label);
+        if (row.isNote) {
+            // Resolve the name once for every configuration
+            try {
+                row.noteNumber = getNoteNumber(row.noteName);
+            } catch (const std::exception&) {
+                row.noteNumber = -1;
+            }
+        }
+        table.rows.push_back(row);
+        return true;
+    });
+}
+
+void transformSweep(const ParsedTable& table, const SweepConfig* configs, size_t count,
+                    ProgressSink* progressSink, const CancellationToken* cancel) {
+    TraceSpan span("transformSweep");
+    // One reporter counts the shared rows once and the notes of every run
+    ProgressReporter progress(progressSink, cancel);
+    progress.setTotalBytes(static_cast<long long>(table.bytes));
+
+    std::vector<std::unique_ptr<RunArena>> arenas;
+    std::vector<RunOutputs> outputs(count);
+    std::vector<std::unique_ptr<TransformRun>> runs;
+    for (size_t i = 0; i < count; ++i) {
+        arenas.emplace_back(new RunArena);
+        outputs[i].text.open(configs[i].buffers.text, nullptr);
+        outputs[i].binary.open(configs[i].buffers.binary, nullptr);
+        outputs[i].midi.open(configs[i].buffers.midi, nullptr);
+        outputs[i].midiDiagnostics = configs[i].buffers.midiDiagnostics;
+        runs.emplace_back(new TransformRun(*configs[i].state, *arenas[i], progress, outputs[i]));
+        runs[i]->begin();
+    }
+
+    // Rows outer, configurations inner: each row is read once while it is hot
+    for (const ParsedTable::Row& row : table.rows) {
+        if (!progress.line(row.line.size())) {
+            for (size_t i = 0; i < count; ++i) {
+                configs[i].state->cancelled = true;
             }
+            break;
+        }
+        for (const std::unique_ptr<TransformRun>& run : runs) {
+            run->parsedRow(row);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        finishBufferRun(*runs[i], *configs[i].state);
+    }
+}
+
+// Collect the notes of a text table into writer; false if cancelled. The
+// time spent, less any input reading, counts as the MIDI_COLLECT stage.
+template <typename LineSource>
+static bool collectMidiNotes(LineSource&& forEachTableLine, MidiWriter& writer, ProgressReporter& progress,
+                             AppState& state) {
+    // Skip header lines
+    int headerLines = 2;
+    size_t lineNumber = 0;
+    state.diagnostics.clear();
+    uint64_t started = steadyNanoseconds();
+    uint64_t readBefore = state.timings.nanoseconds[StageTimings::READ];
+    bool completed = forEachTableLine([&](std::string_view line) {
+        ++lineNumber;
+        if (headerLines > 0) {
+            --headerLines; // Skip column headers and separator line
+            return true;
+        }
+        if (!progress.line(line.size())) {
+            state.cancelled = true;
+            return false;
         }
+        if (writer.addTableLine(line, lineNumber, state)) {
+            progress.note();
+        }
+        return true;
+    });
+    uint64_t reading = state.timings.nanoseconds[StageTimings::READ] - readBefore;
+    state.timings.nanoseconds[StageTimings::MIDI_COLLECT] += steadyNanoseconds() - started - reading;
+    state.timings.lines += lineNumber;
+    if (!state.diagnostics.empty()) {
+        state.statusMessage += state.diagnostics.summary();
+    }
+    return completed;
+}
+
+// Function to convert processed data to MIDI file with MIDI sync fix
+void convertToMidi(const std::string& inputFile, const std::string& outputFile, AppState& state,
+                   ProgressSink* progressSink, const CancellationToken* cancel) {
+    TraceSpan span("convertToMidi");
+    uint64_t started = steadyNanoseconds();
+    state.timings.clear();
+    state.memory.clear();
+    std::ifstream input(inputFile);
+    if (!input.is_open()) {
+        state.statusMessage += "Error opening input file: " + inputFile + "\n";
+        return;
+    }
+    state.timings.nanoseconds[StageTimings::OPEN] = steadyNanoseconds() - started;
+
+    // Size the arena from the input so most runs need only a block or two
+    long long inputSize = streamSize(input);
+    RunArena arena(std::max<size_t>(64 * 1024, static_cast<size_t>(inputSize)));
+    arena.track(&state.memory);
+    state.cancelled = false;
+    ProgressReporter progress(progressSink, cancel);
+    progress.setTotalBytes(inputSize);
+    state.timings.bytes = static_cast<uint64_t>(inputSize);
+
+    // Parse the file and collect note events
+    MidiWriter writer(&arena.midiEvents);
+    collectMidiNotes([&](auto&& f) { return forEachLine(input, &arena.input, f, &state.timings); },
+                     writer, progress, state);
+    input.close();
+    arena.report(state);
+    progress.finish();
 
-        // Write end of track
-        midiFile.put(0x00); // Delta time
-        midiFile.put(0xFF); // Meta event
-        midiFile.put(0x2F); // End of track
-        midiFile.put(0x00); // Length
+    if (state.cancelled) {
+        state.statusMessage += "MIDI conversion cancelled.\n";
+        return;
+    }
 
-        // Calculate and write track length
-        long trackEndPos = midiFile.tellp();
-        long trackLength = trackEndPos - trackStartPos;
+    // Write MIDI file
+    uint64_t opening = steadyNanoseconds();
+    AtomicOutputFile midiFileWriter(outputFile, std::ios::binary);
+    state.timings.nanoseconds[StageTimings::OPEN] += steadyNanoseconds() - opening;
+    if (!midiFileWriter.is_open()) {
+        state.statusMessage += "Error opening output MIDI file: " + outputFile + "\n";
+        return;
+    }
 
-        midiFile.seekp(trackLengthPos);
-        char trackLengthBytes[4] = {
-            static_cast<char>((trackLength >> 24) & 0xFF),
-            static_cast<char>((trackLength >> 16) & 0xFF),
-            static_cast<char>((trackLength >> 8) & 0xFF),
-            static_cast<char>(trackLength & 0xFF)
-        };
-        midiFile.write(trackLengthBytes, 4);
-        midiFile.seekp(trackEndPos);
+    std::string smf;
+    OutputChannel channel;
+    channel.open(&smf, &midiFileWriter.stream);
+    channel.timings = &state.timings;
+    if (!writer.encode(channel, progress)) {
+        state.cancelled = true;
+        state.statusMessage += "MIDI conversion cancelled.\n";
+        return;
     }
+    channel.flush(true);
+    state.memory.hold(MemoryUsage::OUTPUT, smf.capacity());
 
-    midiFile.close();
+    bool committed;
+    {
+        StageTimer timer(&state.timings, StageTimings::FLUSH);
+        committed = midiFileWriter.commit();
+    }
+    if (!committed) {
+        state.statusMessage += "Error writing output MIDI file: " + outputFile + "\n";
+        return;
+    }
+    state.timings.wallNanoseconds = steadyNanoseconds() - started;
     state.statusMessage += "MIDI file created successfully: " + outputFile + "\n";
-}
\ No newline at end of file
+    state.statusMessage += "Memory: " + std::to_string(state.arenaRequests) + " allocations served from " +
+                           std::to_string(state.arenaBlocks) + " arena blocks\n";
+    state.statusMessage += state.memory.summary();
+    state.statusMessage += state.timings.summary();
+}
+
+void encodeMidi(std::string_view textTable, std::string& smf, AppState& state,
+                ProgressSink* progressSink, const CancellationToken* cancel) {
+    TraceSpan span("encodeMidi");
+    RunArena arena(std::max<size_t>(64 * 1024, textTable.size()));
+    arena.track(&state.memory);
+    state.cancelled = false;
+    ProgressReporter progress(progressSink, cancel);
+    progress.setTotalBytes(static_cast<long long>(textTable.size()));
+
+    MidiWriter writer(&arena.midiEvents);
+    collectMidiNotes([&](auto&& f) { return forEachLine(textTable, f); }, writer, progress, state);
+    arena.report(state);
+    progress.finish();
+
+    OutputChannel channel;
+    channel.open(&smf, nullptr);
+    channel.timings = &state.timings;
+    if (state.cancelled || !writer.encode(channel, progress)) {
+        channel.rollback();
+        state.cancelled = true;
+        state.statusMessage += "MIDI conversion cancelled.\n";
+        return;
+    }
+    state.memory.hold(MemoryUsage::OUTPUT, state.memory.current[MemoryUsage::OUTPUT] + smf.capacity());
+    state.statusMessage += "MIDI encoded in memory (" + std::to_string(smf.size() - channel.startSize) + " bytes)\n";
+}
+
+void encodeMidiRecords(const std::vector<std::string_view>& binaryStreams, std::string& smf, AppState& state,
+                       ProgressSink* progressSink, const CancellationToken* cancel) {
+    TraceSpan span("encodeMidiRecords");
+    RunArena arena;
+    arena.track(&state.memory);
+    state.cancelled = false;
+    ProgressReporter progress(progressSink, cancel);
+
+    MidiWriter writer(&arena.midiEvents);
+    uint64_t started = steadyNanoseconds();
+    for (std::string_view stream : binaryStreams) {
+        if (stream.size() < 12 || stream.compare(0, 4, "TRLB") != 0 || readU32(stream, 4) != 1) {
+            state.statusMessage += "Invalid binary record stream\n";
+            return;
+        }
+        for (size_t pos = 12; pos + 12 <= stream.size(); pos += 12) {
+            if (!progress.line(12)) {
+                state.cancelled = true;
+                break;
+            }
+            int track = static_cast<int32_t>(readU32(stream, pos));
+            int duration = static_cast<int32_t>(readU32(stream, pos + 4));
+            writer.addNote(track, static_cast<unsigned char>(stream[pos + 8]), duration);
+            progress.note();
+        }
+    }
+    state.timings.nanoseconds[StageTimings::MIDI_COLLECT] += steadyNanoseconds() - started;
+    arena.report(state);
+    progress.finish();
+
+    OutputChannel channel;
+    channel.open(&smf, nullptr);
+    channel.timings = &state.timings;
+    if (state.cancelled || !writer.encode(channel, progress)) {
+        channel.rollback();
+        state.cancelled = true;
+        state.statusMessage += "MIDI conversion cancelled.\n";
+        return;
+    }
+    state.memory.hold(MemoryUsage::OUTPUT, state.memory.current[MemoryUsage::OUTPUT] + smf.capacity());
+}
+
+bool writeOutputFile(const std::string& path, std::string_view data) {
+    return writeOutputFile(path, std::vector<std::string_view>{data});
+}
+
+bool writeOutputFile(const std::string& path, const std::vector<std::string_view>& parts) {
+    AtomicOutputFile file(path, std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    for (std::string_view data : parts) {
+        file.stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    return file.commit();
+}
@@ -0,0 +1,492 @@
+// Trill Transformation (C) 2025
+// Public interface of the trill transformation engine (trillcore).
+//
+// The engine is reentrant: every job carries its own AppState, which owns
+// the job's settings, random number generator and statistics. Independent
+// jobs can run concurrently in one process as long as each uses its own
+// AppState. The built-in variant table is immutable and shared.
+#ifndef TRILL_TRANSFORMATION_H
+#define TRILL_TRANSFORMATION_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Enum for TimeMeter
+enum TimeMeter {
+    DUPLE,
+    TRIPLE
+};
+
+// Sequence of (MIDI note, duration) segments produced by a trill.
+// Uses a polymorphic allocator so a run can carve them from its arena.
+using TrillSegments = std::pmr::vector<std::pair<int, int>>;
+
+// Structure to represent a trill variant
+struct TrillVariant {
+    std::string code;
+    std::string description;
+};
+
+// Helper to get note name (from MIDI number)
+std::string getNoteName(int noteNumber);
+
+// Helper to get MIDI number from note name; throws std::invalid_argument
+int getNoteNumber(std::string_view noteName);
+
+// Main function for trill transformation; replaces the contents of EmbRet
+// so a caller can reuse one buffer for every note in a run
+void applyTrill(int pi, int durPi, TimeMeter meter, const std::string& variant, TrillSegments& EmbRet);
+std::vector<std::pair<int, int>> applyTrill(int pi, int durPi, TimeMeter meter, const std::string& variant);
+
+// Variant codes read <style>Tr<type><length><interval>:
+//   style     B Baroque, C Classical
+//   type      R regular, De delayed, A ascending, D descending, T terminal
+//   length    s short, n normal, l long (delayed: n and l)
+//   interval  1 major second, 5 minor second
+enum TrillStyle { BAROQUE_STYLE, CLASSICAL_STYLE };
+enum TrillType { REGULAR_TRILL, DELAYED_TRILL, ASCENDING_TRILL, DESCENDING_TRILL, TERMINAL_TRILL };
+enum TrillLength { SHORT_TRILL, NORMAL_TRILL, LONG_TRILL };
+
+struct TrillParameters {
+    TrillStyle style = BAROQUE_STYLE;
+    TrillType type = REGULAR_TRILL;
+    TrillLength length = NORMAL_TRILL;
+    int interval = 2;  // Semitones between the main note and the auxiliary
+};
+
+// Decode a variant code; false if it does not follow the grammar
+bool decodeTrillVariant(std::string_view code, TrillParameters& parameters);
+
+// How a trill divides one note under one meter: an optional leading note,
+// a run of alternating notes, an optional turn note, then the second voice
+// for whatever duration is left. Pitches are offsets from the main note.
+struct TrillPlan {
+    int firstOffset = 0;          // Voice that leads the alternation
+    int secondOffset = 0;         // Voice that ends the trill
+    int headMultiple = 0;         // Leading first-voice note of headMultiple * (duration / headDivision)
+    int headDivision = 1;
+    int alternations = 0;         // Alternating notes of duration / division each
+    int division = 1;
+    bool startsOnSecond = false;  // The alternation begins with the second voice
+    int turnDivision = 0;         // First-voice note of duration / turnDivision after it, if > 0
+    bool valid = false;           // False when no shape exists (e.g. delayed short)
+};
+
+// Plan for parameters under meter
+TrillPlan buildTrillPlan(const TrillParameters& parameters, TimeMeter meter);
+
+// Prebuilt plan of a variant by its index in allTrillVariants()
+const TrillPlan& builtInTrillPlan(size_t variantIndex, TimeMeter meter);
+
+// Apply a plan to one note; replaces the contents of EmbRet
+void applyTrill(int pi, int durPi, const TrillPlan& plan, TrillSegments& EmbRet);
+
+// The complete pool of trill variants, built once
+const std::vector<TrillVariant>& allTrillVariants();
+
+// Generate a random pool of trill variants for user selection
+std::vector<TrillVariant> generateRandomTrillVariantPool(int poolSize = 10);
+
+// Parse user input for multiple choice selection
+std::vector<int> parseUserChoices(const std::string& input, int maxChoice);
+
+// Cooperative cancellation flag shared between a caller and a running job.
+// The engine polls it between batches of lines; cancel() may be called from
+// any thread, including a signal handler.
+struct CancellationToken {
+    std::atomic<bool> requested{false};
+
+    void cancel() { requested.store(true, std::memory_order_relaxed); }
+    void reset() { requested.store(false, std::memory_order_relaxed); }
+    bool isCancelled() const { return requested.load(std::memory_order_relaxed); }
+};
+
+// Live progress of a run. The engine publishes counters with relaxed atomic
+// stores, so any thread can read them without locking. onProgress, if set,
+// is called on the worker thread at most every intervalMs and once at the end.
+struct ProgressSink {
+    std::atomic<long long> lines{0};
+    std::atomic<long long> notes{0};
+    std::atomic<long long> bytes{0};
+    std::atomic<long long> totalBytes{0};
+    std::function<void(const ProgressSink&)> onProgress;
+    int intervalMs = 50;
+};
+
+// Counters of one run in fixed arrays, indexed by variant ID (position in
+// allTrillVariants()) and label ID (position in eligibleLabels()), so a run
+// counts with plain increments. Parallel runs keep one copy each, aligned to
+// its own cache lines, and merge the copies at the end.
+struct alignas(64) RunStatistics {
+    static const size_t kVariants = 64;  // Room for every built-in variant
+    static const size_t kLabels = 22;    // Eligible labels
+
+    // Notes of one track; tracks are kept in ascending order
+    struct TrackCounts {
+        int track = 0;
+        uint64_t notes = 0;
+        uint64_t eligible = 0;
+        uint64_t transformed = 0;
+    };
+
+    // 64-bit, as inputs of billions of notes are summed across runs
+    uint64_t eligibleNotes = 0;
+    uint64_t transformedNotes = 0;
+    std::array<uint64_t, kVariants> variantUsage{};
+    std::array<uint64_t, kLabels> labelEligible{};
+    std::array<uint64_t, kLabels> labelTransformed{};
+    std::vector<TrackCounts> tracks;
+
+    void clear();
+
+    // Counts of track, added in order if new
+    TrackCounts& trackCounts(int track);
+
+    // Add the counts of other
+    void merge(const RunStatistics& other);
+
+private:
+    size_t lastTrack = 0;
+};
+
+// Labels whose notes are eligible for transformation, in label ID order
+const std::array<std::string_view, RunStatistics::kLabels>& eligibleLabels();
+
+// Label ID of label, or RunStatistics::kLabels if it is not eligible
+size_t labelId(std::string_view label);
+
+// Problems found in a run's input: an exact count per category, and the
+// line and text of the first kExamples. Nothing else is kept, so even a
+// badly corrupted input costs bounded memory.
+struct Diagnostics {
+    enum Category : uint8_t {
+        INVALID_NOTE_NAME,
+        NOTE_OUT_OF_RANGE,
+        TRILL_REJECTED,
+        kCategories
+    };
+
+    struct Example {
+        uint64_t line;  // 1-based input line (entry for parsed notes)
+        Category category;
+        std::string text;
+    };
+
+    static const size_t kExamples = 10;
+
+    std::array<size_t, kCategories> counts{};
+    std::vector<Example> examples;
+
+    void clear();
+    size_t total() const;
+    bool empty() const { return total() == 0; }
+
+    // Record a problem; describe() builds its text and is only called for
+    // the first kExamples problems
+    template <typename Describe>
+    void add(Category category, size_t line, Describe&& describe) {
+        ++counts[category];
+        if (examples.size() < kExamples) {
+            examples.push_back(Example{line, category, describe()});
+        }
+    }
+
+    // Add the problems of other, whose line numbers start after lineOffset lines
+    void merge(const Diagnostics& other, size_t lineOffset);
+
+    // Counts per category followed by the examples
+    std::string summary() const;
+
+    // Identifier of a category, e.g. "invalid_note_name"
+    static const char* categoryName(Category category);
+};
+
+// Where the time of a run went, from steady-clock timestamps. Stages that
+// happen a few times per run are timed exactly. The per-line stages (parse,
+// select, transform, format) interleave on every line, so they are timed on
+// one line in kSampleEvery and scaled to all lines.
+struct StageTimings {
+    enum Stage : uint8_t {
+        OPEN,
+        READ,
+        PARSE,
+        SELECT,
+        TRANSFORM,
+        FORMAT,
+        WRITE,
+        MIDI_COLLECT,
+        SORT,
+        ENCODE,
+        FLUSH,
+        kStages
+    };
+
+    static const uint64_t kSampleEvery = 64;
+
+    std::array<uint64_t, kStages> nanoseconds{};
+    uint64_t wallNanoseconds = 0;  // The whole run
+    uint64_t lines = 0;
+    uint64_t bytes = 0;            // Input bytes
+
+    static const char* stageName(Stage stage);
+    static bool sampled(Stage stage) { return stage >= PARSE && stage <= FORMAT; }
+
+    void clear() { *this = StageTimings(); }
+
+    // Add the stage times, lines and bytes of other (e.g. another chunk)
+    void merge(const StageTimings& other);
+
+    // Time and share of each stage, lines/sec and bytes/sec
+    std::string summary() const;
+};
+
+// Bytes a run holds in each kind of buffer, with peaks and allocation
+// counts. Arena buffers are counted as they are requested and stay counted
+// until the run ends, as the arena holds them; output buffers by their
+// capacity, checked every few lines and at the end.
+struct MemoryUsage {
+    enum Pool : uint8_t {
+        INPUT,        // Input read buffers (or the whole input held in memory)
+        NOTES,        // Trill segment buffers and parsed tables
+        MIDI_EVENTS,  // Note events collected for MIDI encoding
+        OUTPUT,       // Text, binary and MIDI output buffers
+        kPools
+    };
+
+    std::array<size_t, kPools> current{};
+    std::array<size_t, kPools> peak{};
+    std::array<size_t, kPools> allocations{};
+    size_t currentTotal = 0;
+    size_t peakTotal = 0;  // Of all pools together
+
+    static const char* poolName(Pool pool);
+
+    void allocate(Pool pool, size_t bytes) {
+        ++allocations[pool];
+        current[pool] += bytes;
+        currentTotal += bytes;
+        peak[pool] = std::max(peak[pool], current[pool]);
+        peakTotal = std::max(peakTotal, currentTotal);
+    }
+
+    // Set what pool holds now, for buffers that are not allocated through
+    // an arena (their growth is not counted as allocations)
+    void hold(Pool pool, size_t bytes) {
+        currentTotal = currentTotal - current[pool] + bytes;
+        current[pool] = bytes;
+        peak[pool] = std::max(peak[pool], bytes);
+        peakTotal = std::max(peakTotal, currentTotal);
+    }
+
+    void clear() { *this = MemoryUsage(); }
+
+    // Add other's usage, as of a run alongside this one: peaks add up
+    void merge(const MemoryUsage& other);
+
+    // Peak and current bytes per pool and the allocation count
+    std::string summary() const;
+};
+
+// Current steady-clock time in nanoseconds, for StageTimings
+uint64_t steadyNanoseconds();
+
+// Application state: one transformation job's settings, random number
+// generator and statistics
+struct AppState {
+    std::string inputFile;
+    std::string outputFile;
+    std::string midiOutputFile;
+    double transformationPercentage = 50.0;
+    std::vector<std::string> selectedVariants;
+    TimeMeter meter = DUPLE;
+    // Each run reseeds rng from seed, so a run is reproducible from its seed
+    uint64_t seed = 1;
+    std::mt19937_64 rng;
+    // Table RANDOM selection draws from
+    const std::vector<TrillVariant>* variantTable = &allTrillVariants();
+    bool processingComplete = false;
+    // Short status of the last run; problems in the input are summarized
+    // here from diagnostics rather than listed one by one
+    std::string statusMessage;
+    Diagnostics diagnostics;
+    std::string resultSummary;
+    // Statistics of the last run. The run counts into statistics; the three
+    // summary fields below are filled from it when the run ends.
+    RunStatistics statistics;
+    uint64_t totalEligibleNotes = 0;
+    uint64_t transformedNotes = 0;
+    std::map<std::string, uint64_t> variantUsageCount;
+    // Allocation counts for the last run: requests served by the run arena
+    // versus the blocks it actually took from the heap
+    size_t arenaRequests = 0;
+    size_t arenaBlocks = 0;
+    size_t arenaBytes = 0;
+    // Stage timings of the last run. Every run and convertToMidi starts
+    // them afresh; encodeMidi and encodeMidiRecords add to them.
+    StageTimings timings;
+    // Memory held by the last run, per kind of buffer; the current figures
+    // are as of the end of the run. Reset and extended like timings.
+    MemoryUsage memory;
+    bool cancelled = false;
+};
+
+// Check if a label should be transformed based on percentage
+bool shouldTransformLabel(double transformationPercentage, std::mt19937_64& rng);
+
+// Uniform index in [0, count), as used for variant selection
+size_t uniformIndex(std::mt19937_64& rng, size_t count);
+
+// Check if notes with this label are eligible for transformation
+bool isEligibleLabel(std::string_view label);
+
+// Transform inputFile into the text table outputFile. Progress and
+// cancellation are optional; a cancelled run leaves outputFile untouched.
+void processFile(const std::string& inputFile, const std::string& outputFile, AppState& state,
+                 ProgressSink* progressSink = nullptr, const CancellationToken* cancel = nullptr);
+
+// Convert a text table written by processFile into a Standard MIDI File.
+// Progress and cancellation are optional; a cancelled run leaves outputFile untouched.
+void convertToMidi(const std::string& inputFile, const std::string& outputFile, AppState& state,
+                   ProgressSink* progressSink = nullptr, const CancellationToken* cancel = nullptr);
+
+// The statistics summary a finished run stores in resultSummary; destination
+// names where the results went. Lets callers that merge runs report them alike.
+std::string transformationSummary(const AppState& state, const std::string& destination);
+
+// Timings, throughput and allocation counts of the last run as a JSON object
+std::string runStatsJson(const AppState& state);
+
+// Counters and gauges over the runs of a process, for monitoring. Counters
+// only grow; the memory gauges keep the largest and the latest run's peak.
+struct RunMetrics {
+    uint64_t runs = 0;
+    uint64_t failedRuns = 0;
+    uint64_t lines = 0;
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;           // Written to output files
+    uint64_t eligibleNotes = 0;
+    uint64_t transformedNotes = 0;
+    std::map<std::string, uint64_t> variantNotes;  // Transformed notes per variant code
+    std::array<uint64_t, StageTimings::kStages> stageNanoseconds{};
+    uint64_t wallNanoseconds = 0;
+    std::array<uint64_t, Diagnostics::kCategories> problems{};
+    size_t peakMemoryBytes = 0;
+    size_t lastPeakMemoryBytes = 0;
+    bool lastRunOk = false;
+    double lastRunTimestamp = 0;        // Unix time the latest run ended
+
+    // Add a finished run of state that wrote bytesWritten bytes
+    void add(const AppState& state, uint64_t bytesWritten, bool ok);
+
+    // Add a run that failed before it processed anything (e.g. an unreadable input)
+    void addFailure();
+
+    // Add the runs of other, e.g. another file of a batch
+    void merge(const RunMetrics& other);
+
+    // Prometheus text exposition format, metric names prefixed with trill_
+    std::string prometheusText() const;
+};
+
+// Per-label and per-track tables of statistics
+std::string statisticsBreakdown(const RunStatistics& statistics);
+
+// Fill the summary fields of state (totals and variantUsageCount) from its
+// statistics, as a run does when it ends. Variants counted outside the
+// built-in table are kept in variantUsageCount as they are.
+void publishStatistics(AppState& state);
+
+// Caller-owned output buffers for the in-memory API. Results are appended;
+// a null pointer skips that format.
+//   text:   the same table processFile writes
+//   binary: "TRLB", uint32 version (1), uint32 record count, then one
+//           12-byte record per note: int32 track, int32 duration, uint8 MIDI
+//           note, uint8 kind (0 unlabelled, 1 original, 2 trill), uint16
+//           variant index into allTrillVariants() (0xFFFF for none); all
+//           little-endian
+//   midi:   the Standard MIDI File convertToMidi would write for the text
+struct TransformBuffers {
+    std::string* text = nullptr;
+    std::string* binary = nullptr;
+    std::string* midi = nullptr;
+    // Report the rows MIDI would skip even without a midi buffer, for
+    // callers that encode the binary records with encodeMidiRecords later
+    bool midiDiagnostics = false;
+};
+
+// One input note for transformNotes; the views must outlive the call
+struct NoteEntry {
+    int track;
+    std::string_view noteName;
+    int duration;
+    std::string_view label;
+};
+
+// Transform an input table held in memory. Statistics and messages go to
+// state as for processFile; a cancelled run leaves the buffers unchanged.
+void transformBuffer(std::string_view input, const TransformBuffers& buffers, AppState& state,
+                     ProgressSink* progressSink = nullptr, const CancellationToken* cancel = nullptr);
+
+// Transform already parsed notes, skipping text parsing entirely
+void transformNotes(const NoteEntry* notes, size_t count, const TransformBuffers& buffers, AppState& state,
+                    ProgressSink* progressSink = nullptr, const CancellationToken* cancel = nullptr);
+
+// An input table parsed once so several transformations can share it.
+// Rows are views into the text it was parsed from, which must outlive it.
+struct ParsedTable {
+    struct Row {
+        std::string_view line;      // The whole line, copied as is if not a note
+        std::string_view noteName;
+        std::string_view label;
+        int track = 0;
+        int duration = 0;
+        int noteNumber = -1;        // MIDI number of noteName, -1 if not a valid name
+        bool isNote = false;
+    };
+    std::vector<Row> rows;
+    size_t bytes = 0;
+};
+
+// Parse input into table, replacing its rows
+void parseTable(std::string_view input, ParsedTable& table);
+
+// One configuration of a sweep: its settings and statistics, and its outputs
+struct SweepConfig {
+    AppState* state = nullptr;
+    TransformBuffers buffers;
+};
+
+// Transform a parsed table under count configurations in a single pass over
+// its rows. Each configuration gives exactly the output transformBuffer
+// would give it for the same text.
+void transformSweep(const ParsedTable& table, const SweepConfig* configs, size_t count,
+                    ProgressSink* progressSink = nullptr, const CancellationToken* cancel = nullptr);
+
+// Encode a text table held in memory as a Standard MIDI File appended to smf
+void encodeMidi(std::string_view textTable, std::string& smf, AppState& state,
+                ProgressSink* progressSink = nullptr, const CancellationToken* cancel = nullptr);
+
+// Encode binary record streams (see TransformBuffers) as one Standard MIDI
+// File appended to smf. Streams are read in order as if concatenated, so the
+// outputs of consecutive pieces of one input give the MIDI file of the whole.
+void encodeMidiRecords(const std::vector<std::string_view>& binaryStreams, std::string& smf, AppState& state,
+                       ProgressSink* progressSink = nullptr, const CancellationToken* cancel = nullptr);
+
+// Write data to path through a temporary file renamed into place, so readers
+// never see a partial file. Returns false on any I/O error.
+bool writeOutputFile(const std::string& path, std::string_view data);
+
+// Write the concatenation of parts the same way
+bool writeOutputFile(const std::string& path, const std::vector<std::string_view>& parts);
+
+#endif // TRILL_TRANSFORMATION_H
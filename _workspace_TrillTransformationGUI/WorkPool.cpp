@@ -0,0 +1,116 @@
+// Trill Transformation (C) 2025
+// Work-stealing thread pool shared by the batch tools.
+
+#include "WorkPool.h"
+#include "TrillTrace.h"
+
+// The pool and deque of the worker running on this thread, if any
+static thread_local const WorkPool* currentPool = nullptr;
+static thread_local unsigned currentIndex = 0;
+
+WorkPool::WorkPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&WorkPool::run, this, i);
+    }
+}
+
+WorkPool::~WorkPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    taskReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkPool::submit(Task task) {
+    // Count the task as queued before any thief can pop and uncount it
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        ++unfinished;
+        ++queued;
+    }
+
+    // Keep work split off by a task on its own worker; spread the rest
+    unsigned index = currentPool == this ? currentIndex
+                                         : nextQueue++ % static_cast<unsigned>(queues.size());
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    taskReady.notify_one();
+}
+
+int WorkPool::currentWorker() const {
+    return currentPool == this ? static_cast<int>(currentIndex) : -1;
+}
+
+void WorkPool::wait() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this] { return unfinished == 0; });
+}
+
+// Pop the newest task of our own deque, or steal the oldest of another
+bool WorkPool::takeTask(unsigned index, Task& task) {
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue& victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::run(unsigned index) {
+    currentPool = this;
+    currentIndex = index;
+    setTraceThreadName("worker " + std::to_string(index));
+
+    Task task;
+    for (;;) {
+        if (!takeTask(index, task)) {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            taskReady.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) {
+                return;
+            }
+            continue;
+        }
+
+        try {
+            task();
+        } catch (...) {
+            // Tasks report their own errors; an escaped exception must not
+            // take the worker down with the pool still counting the task
+        }
+        task = nullptr;
+
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (--unfinished == 0) {
+            allDone.notify_all();
+        }
+    }
+}
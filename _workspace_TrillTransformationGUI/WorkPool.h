@@ -0,0 +1,67 @@
+// Trill Transformation (C) 2025
+// Work-stealing thread pool shared by the batch tools.
+//
+// Every worker owns a deque of tasks. A worker pops its own newest task
+// first and, when its deque is empty, steals the oldest task of another
+// worker. Tasks submitted from inside a task go to the submitting worker's
+// deque, so a task that splits its work keeps the pieces local until idle
+// workers steal them.
+#ifndef TRILL_WORK_POOL_H
+#define TRILL_WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkPool {
+public:
+    using Task = std::function<void()>;
+
+    // Start threadCount workers (at least one)
+    explicit WorkPool(unsigned threadCount);
+
+    // Finish every queued task, then stop the workers
+    ~WorkPool();
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    // Queue a task; callable from any thread, including from a task
+    void submit(Task task);
+
+    // Block until every submitted task, and every task they submitted, has run
+    void wait();
+
+    unsigned threadCount() const { return static_cast<unsigned>(workers.size()); }
+
+    // Index of the calling worker of this pool, or -1 on any other thread;
+    // lets tasks keep per-worker state without locking
+    int currentWorker() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(unsigned index);
+    bool takeTask(unsigned index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex stateMutex;
+    std::condition_variable taskReady;
+    std::condition_variable allDone;
+    std::atomic<size_t> queued{0};   // Tasks waiting in some deque
+    size_t unfinished = 0;           // Tasks submitted but not yet finished
+    std::atomic<unsigned> nextQueue{0};
+    bool stopping = false;
+};
+
+#endif // TRILL_WORK_POOL_H
@@ -2,11 +2,18 @@
 // This file provides the main function and platform-specific entry points
 // for the Trill Transformation tool.
 
+#include "TrillTransformation.h"
+
 #include <iostream>
 #include <string>
 #include <vector>
 #include <memory>
 #include <map>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <csignal>
+#include <cstdio>
 
 // Platform detection
 #if defined(_WIN32) || defined(_WIN64)
@@ -23,28 +30,61 @@
     #include <unistd.h>
     #include <sys/types.h>
     #include <pwd.h>
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <cstring>
 #else
     #error "Unsupported platform"
 #endif
 
-// Forward declarations of functions from TrillTransformation.cpp
-struct AppState {
-    std::string inputFile;
-    std::string outputFile;
-    std::string midiOutputFile;
-    double transformationPercentage = 50.0;
-    std::vector<std::string> selectedVariants;
-    bool processingComplete = false;
-    std::string statusMessage;
-    std::string resultSummary;
-    int totalEligibleNotes = 0;
-    int transformedNotes = 0;
-    std::map<std::string, int> variantUsageCount;
-};
+#ifndef PLATFORM_WINDOWS
+// Shared by the command-line paths: Ctrl-C cancels the run in progress
+static CancellationToken g_interrupt;
+
+static void onInterrupt(int) {
+    g_interrupt.cancel();
+}
+
+// Run the command-line job described by state, reporting progress on stderr
+static int runCommandLine(AppState& state, bool showProgress) {
+    std::signal(SIGINT, onInterrupt);
+
+    ProgressSink progress;
+    progress.intervalMs = 200;
+    if (showProgress) {
+        progress.onProgress = [](const ProgressSink& p) {
+            long long total = p.totalBytes.load(std::memory_order_relaxed);
+            long long percent = total > 0 ? p.bytes.load(std::memory_order_relaxed) * 100 / total : 0;
+            std::cerr << "\r" << (percent > 100 ? 100 : percent) << "%  "
+                      << p.lines.load(std::memory_order_relaxed) << " lines" << std::flush;
+        };
+    }
+
+    // Process the file
+    processFile(state.inputFile, state.outputFile, state, &progress, &g_interrupt);
+    if (showProgress) {
+        std::cerr << std::endl;
+    }
+    std::cout << state.statusMessage << std::endl;
+    if (state.cancelled) {
+        return 130;
+    }
 
-// Forward declarations of functions from TrillTransformation.cpp
-void processFile(const std::string& inputFile, const std::string& outputFile, AppState& state);
-void convertToMidi(const std::string& inputFile, const std::string& outputFile, AppState& state);
+    // Generate MIDI if output file is specified
+    if (!state.midiOutputFile.empty()) {
+        convertToMidi(state.outputFile, state.midiOutputFile, state, &progress, &g_interrupt);
+        if (showProgress) {
+            std::cerr << std::endl;
+        }
+        std::cout << state.statusMessage << std::endl;
+        if (state.cancelled) {
+            return 130;
+        }
+    }
+
+    return 0;
+}
+#endif
 
 // Constants
 const int WINDOW_WIDTH = 800;
@@ -55,6 +95,69 @@ const char* WINDOW_TITLE = "Trill Transformation Tool";
 // Windows GUI implementation
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
+// Messages posted from the worker thread to the window
+const UINT WM_TRILL_PROGRESS = WM_APP + 1;  // counters changed
+const UINT WM_TRILL_DONE = WM_APP + 2;      // wParam: job kind, lParam: finished AppState*
+
+enum JobKind {
+    JOB_PROCESS = 0,
+    JOB_MIDI = 1
+};
+
+// Background job shared by the window and its worker thread. The worker
+// runs on its own copy of AppState and hands it back with WM_TRILL_DONE.
+struct WorkerJob {
+    HWND hwnd = NULL;
+    std::thread thread;
+    ProgressSink progress;
+    CancellationToken cancel;
+    bool busy = false;
+};
+
+static WorkerJob g_job;
+
+// Enable or disable the controls that must not be used while a job runs
+static void setBusy(HWND hwnd, bool busy) {
+    g_job.busy = busy;
+    EnableWindow(GetDlgItem(hwnd, 1), !busy);
+    EnableWindow(GetDlgItem(hwnd, 2), !busy);
+    EnableWindow(GetDlgItem(hwnd, 3), !busy);
+    EnableWindow(GetDlgItem(hwnd, 4), !busy);
+    EnableWindow(GetDlgItem(hwnd, 5), !busy);
+    EnableWindow(GetDlgItem(hwnd, 6), !busy);
+    EnableWindow(GetDlgItem(hwnd, 7), !busy);
+    EnableWindow(GetDlgItem(hwnd, 9), busy);
+}
+
+// Run processFile or convertToMidi on a worker thread
+static void startJob(HWND hwnd, const AppState& state, JobKind kind) {
+    if (g_job.thread.joinable()) {
+        g_job.thread.join();
+    }
+
+    AppState* job = new AppState(state);
+    g_job.hwnd = hwnd;
+    g_job.cancel.reset();
+    // Called on the worker thread by the engine, rate limited
+    g_job.progress.onProgress = [hwnd](const ProgressSink&) {
+        PostMessage(hwnd, WM_TRILL_PROGRESS, 0, 0);
+    };
+
+    setBusy(hwnd, true);
+    SetWindowText(GetDlgItem(hwnd, 10), "Working...");
+
+    g_job.thread = std::thread([hwnd, job, kind]() {
+        if (kind == JOB_PROCESS) {
+            processFile(job->inputFile, job->outputFile, *job, &g_job.progress, &g_job.cancel);
+        } else {
+            convertToMidi(job->outputFile, job->midiOutputFile, *job, &g_job.progress, &g_job.cancel);
+        }
+        if (!PostMessage(hwnd, WM_TRILL_DONE, kind, (LPARAM)job)) {
+            delete job;  // Window is gone
+        }
+    });
+}
+
 // Windows entry point
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
     // Initialize common controls
@@ -199,6 +302,18 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             // Set button color to medium green
             SetClassLongPtr(hButton7, GCLP_HBRBACKGROUND, (LONG_PTR)hBrush);
 
+            // Cancel button, enabled while a job is running
+            CreateWindow(
+                "BUTTON", "Cancel", WS_TABSTOP | WS_VISIBLE | WS_CHILD | WS_DISABLED,
+                340, 260, 100, 30, hwnd, (HMENU)9, NULL, NULL
+            );
+
+            // Progress text
+            CreateWindow(
+                "STATIC", "", WS_VISIBLE | WS_CHILD,
+                450, 265, WINDOW_WIDTH - 470, 20, hwnd, (HMENU)10, NULL, NULL
+            );
+
             // Status text
             CreateWindow(
                 "EDIT", "", WS_VISIBLE | WS_CHILD | WS_BORDER | ES_MULTILINE | ES_AUTOVSCROLL | ES_READONLY,
@@ -329,12 +444,8 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                         state->selectedVariants.push_back("BTrTs1");
                     }
 
-                    // Process the file
-                    processFile(state->inputFile, state->outputFile, *state);
-
-                    // Update status
-                    HWND hStatus = GetDlgItem(hwnd, 8);
-                    SetWindowText(hStatus, state->resultSummary.c_str());
+                    // Process the file in the background
+                    startJob(hwnd, *state, JOB_PROCESS);
                     break;
                 }
 
@@ -344,31 +455,70 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                         break;
                     }
 
-                    // Convert to MIDI
-                    convertToMidi(state->outputFile, state->midiOutputFile, *state);
-
-                    // Update status
-                    HWND hStatus = GetDlgItem(hwnd, 8);
-                    std::string currentText;
-                    int textLength = GetWindowTextLength(hStatus);
-                    if (textLength > 0) {
-                        char* buffer = new char[textLength + 1];
-                        GetWindowText(hStatus, buffer, textLength + 1);
-                        currentText = buffer;
-                        delete[] buffer;
-                    }
-                    currentText += "\n" + state->statusMessage;
-                    SetWindowText(hStatus, currentText.c_str());
+                    // Convert to MIDI in the background
+                    startJob(hwnd, *state, JOB_MIDI);
+                    break;
+                }
+
+                case 9: { // Cancel
+                    g_job.cancel.cancel();
+                    SetWindowText(GetDlgItem(hwnd, 10), "Cancelling...");
                     break;
                 }
             }
             break;
         }
 
+        case WM_TRILL_PROGRESS: {
+            // Read the worker's counters; no locking needed
+            if (!g_job.busy) {
+                break;
+            }
+            long long total = g_job.progress.totalBytes.load(std::memory_order_relaxed);
+            long long bytes = g_job.progress.bytes.load(std::memory_order_relaxed);
+            int percent = total > 0 ? (int)(bytes * 100 / total) : 0;
+            char text[160];
+            snprintf(text, sizeof(text), "%d%%  %lld lines, %lld notes",
+                     percent > 100 ? 100 : percent,
+                     g_job.progress.lines.load(std::memory_order_relaxed),
+                     g_job.progress.notes.load(std::memory_order_relaxed));
+            SetWindowText(GetDlgItem(hwnd, 10), text);
+            break;
+        }
+
+        case WM_TRILL_DONE: {
+            // Take the finished job's results back on the UI thread
+            AppState* job = (AppState*)lParam;
+            if (g_job.thread.joinable()) {
+                g_job.thread.join();
+            }
+            *state = *job;
+            delete job;
+            setBusy(hwnd, false);
+            SetWindowText(GetDlgItem(hwnd, 10), state->cancelled ? "Cancelled" : "Done");
+
+            HWND hStatus = GetDlgItem(hwnd, 8);
+            if (wParam == JOB_PROCESS) {
+                SetWindowText(hStatus, state->resultSummary.c_str());
+            } else {
+                std::string currentText;
+                int textLength = GetWindowTextLength(hStatus);
+                if (textLength > 0) {
+                    char* buffer = new char[textLength + 1];
+                    GetWindowText(hStatus, buffer, textLength + 1);
+                    currentText = buffer;
+                    delete[] buffer;
+                }
+                currentText += "\n" + state->statusMessage;
+                SetWindowText(hStatus, currentText.c_str());
+            }
+            return 0;
+        }
+
         case WM_HSCROLL: {
             // Handle trackbar changes
             HWND hTrackbar = GetDlgItem(hwnd, 4);
-            if ((HWND)lParam == hTrackbar) {
+            if ((HWND)lParam == hTrackbar && !g_job.busy) {
                 int pos = SendMessage(hTrackbar, TBM_GETPOS, 0, 0);
                 state->transformationPercentage = pos;
             }
@@ -384,6 +534,11 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         }
 
         case WM_DESTROY:
+            // Stop a running job before the window goes away
+            g_job.cancel.cancel();
+            if (g_job.thread.joinable()) {
+                g_job.thread.join();
+            }
             PostQuitMessage(0);
             return 0;
     }
@@ -394,6 +549,169 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 #elif defined(PLATFORM_LINUX)
 // Linux GUI implementation using X11
 
+// Display resources, allocated once at startup
+struct X11Gui {
+    Display* display = NULL;
+    Window window = 0;
+    int screen = 0;
+    unsigned long teal = 0;
+    unsigned long green = 0;
+    unsigned long darkGreen = 0;
+    unsigned long white = 0;
+    GC textGC = NULL;
+    GC buttonGC = NULL;
+    GC handleGC = NULL;
+    GC backgroundGC = NULL;
+};
+
+// Background job state. The worker runs on its own copy of AppState and
+// wakes the event loop through a pipe: 'p' for progress, 'd' when done.
+struct X11Worker {
+    std::thread thread;
+    ProgressSink progress;
+    CancellationToken cancel;
+    AppState* job = nullptr;
+    bool busy = false;
+    int wakeFds[2] = {-1, -1};
+};
+
+// Status and progress regions, the only parts redrawn while a job runs
+const int PROGRESS_X = 450, PROGRESS_Y = 300, PROGRESS_W = WINDOW_WIDTH - 470, PROGRESS_H = 30;
+const int STATUS_X = 20, STATUS_Y = 340, STATUS_W = WINDOW_WIDTH - 40, STATUS_H = 240;
+
+static unsigned long allocColor(Display* display, Colormap colormap, const char* spec) {
+    XColor color;
+    XParseColor(display, colormap, spec, &color);
+    XAllocColor(display, colormap, &color);
+    return color.pixel;
+}
+
+static GC createGC(Display* display, Window window, unsigned long foreground) {
+    XGCValues values;
+    values.foreground = foreground;
+    return XCreateGC(display, window, GCForeground, &values);
+}
+
+static void drawText(const X11Gui& gui, int x, int y, const std::string& text) {
+    XDrawString(gui.display, gui.window, gui.textGC, x, y, text.c_str(), text.length());
+}
+
+static void drawButton(const X11Gui& gui, int x, int y, int w, int h, const char* label, int textX) {
+    XFillRectangle(gui.display, gui.window, gui.buttonGC, x, y, w, h);
+    XDrawRectangle(gui.display, gui.window, gui.textGC, x, y, w, h);
+    drawText(gui, textX, y + 20, label);
+}
+
+// Labels, buttons and the variant box
+static void drawControls(const X11Gui& gui) {
+    drawText(gui, 20, 30, "Input File:");
+    drawText(gui, 20, 70, "Output File:");
+    drawText(gui, 20, 110, "MIDI Output:");
+    drawText(gui, 20, 150, "Transformation %:");
+    drawText(gui, 20, 210, "Variant Selection:");
+    drawText(gui, 20, 270, "Status:");
+
+    // Draw title
+    drawText(gui, 330, 30, "Trill Transformation Tool");
+    drawText(gui, 330, 50, "Transforms eligible notes with trills");
+
+    drawButton(gui, 150, 20, 150, 30, "Select Input File", 170);
+    drawButton(gui, 150, 60, 150, 30, "Select Output File", 170);
+    drawButton(gui, 150, 100, 150, 30, "Select MIDI Output", 170);
+
+    // Draw variant selection
+    XFillRectangle(gui.display, gui.window, gui.buttonGC, 150, 200, 200, 30);
+    XDrawRectangle(gui.display, gui.window, gui.textGC, 150, 200, 200, 30);
+    drawText(gui, 170, 220, "Random");
+
+    drawButton(gui, 20, 300, 150, 30, "Process File", 60);
+    drawButton(gui, 180, 300, 150, 30, "Generate MIDI", 210);
+    drawButton(gui, 340, 300, 100, 30, "Cancel", 370);
+}
+
+static void drawSlider(const X11Gui& gui, const AppState& state) {
+    // The handle can sit just past the track, so clear that too
+    XFillRectangle(gui.display, gui.window, gui.backgroundGC, 150, 140, 211, 21);
+    XFillRectangle(gui.display, gui.window, gui.buttonGC, 150, 140, 200, 20);
+    XDrawRectangle(gui.display, gui.window, gui.textGC, 150, 140, 200, 20);
+    int sliderPos = 150 + (state.transformationPercentage * 2);
+    XFillRectangle(gui.display, gui.window, gui.handleGC, sliderPos, 140, 10, 20);
+}
+
+static void drawProgress(const X11Gui& gui, const X11Worker& worker) {
+    XFillRectangle(gui.display, gui.window, gui.backgroundGC, PROGRESS_X, PROGRESS_Y, PROGRESS_W, PROGRESS_H);
+    if (!worker.busy) {
+        return;
+    }
+    long long total = worker.progress.totalBytes.load(std::memory_order_relaxed);
+    long long bytes = worker.progress.bytes.load(std::memory_order_relaxed);
+    int percent = total > 0 ? static_cast<int>(bytes * 100 / total) : 0;
+    if (percent > 100) percent = 100;
+
+    // Bar plus counters
+    XDrawRectangle(gui.display, gui.window, gui.textGC, PROGRESS_X, PROGRESS_Y, 100, 10);
+    XFillRectangle(gui.display, gui.window, gui.buttonGC, PROGRESS_X + 1, PROGRESS_Y + 1, percent, 9);
+    drawText(gui, PROGRESS_X, PROGRESS_Y + 25,
+             std::to_string(worker.progress.lines.load(std::memory_order_relaxed)) + " lines, " +
+             std::to_string(worker.progress.notes.load(std::memory_order_relaxed)) + " notes");
+}
+
+// Status message followed by the result summary, one text line per row
+static void drawStatus(const X11Gui& gui, const AppState& state) {
+    XFillRectangle(gui.display, gui.window, gui.backgroundGC, STATUS_X, STATUS_Y, STATUS_W, STATUS_H);
+    XDrawRectangle(gui.display, gui.window, gui.textGC, STATUS_X, STATUS_Y, STATUS_W, STATUS_H);
+
+    std::string text = state.statusMessage;
+    if (!state.resultSummary.empty()) {
+        text += "\n" + state.resultSummary;
+    }
+    int y = STATUS_Y + 20;
+    size_t start = 0;
+    while (start < text.size() && y < STATUS_Y + STATUS_H) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        drawText(gui, STATUS_X + 10, y, text.substr(start, end - start));
+        y += 15;
+        start = end + 1;
+    }
+}
+
+// Run processFile or convertToMidi on a worker thread
+static void startJob(X11Worker& worker, const AppState& state, bool midi) {
+    worker.job = new AppState(state);
+    worker.cancel.reset();
+    worker.progress.lines = 0;
+    worker.progress.notes = 0;
+    worker.progress.bytes = 0;
+    worker.busy = true;
+
+    AppState* job = worker.job;
+    ProgressSink* progress = &worker.progress;
+    CancellationToken* cancel = &worker.cancel;
+    int wakeFd = worker.wakeFds[1];
+    worker.thread = std::thread([job, midi, wakeFd, progress, cancel]() {
+        if (midi) {
+            convertToMidi(job->outputFile, job->midiOutputFile, *job, progress, cancel);
+        } else {
+            processFile(job->inputFile, job->outputFile, *job, progress, cancel);
+        }
+        char byte = 'd';
+        ssize_t ignored = write(wakeFd, &byte, 1);
+        (void)ignored;
+    });
+}
+
+// Take a finished job's results back on the UI thread
+static void finishJob(X11Worker& worker, AppState& state) {
+    if (worker.thread.joinable()) {
+        worker.thread.join();
+    }
+    state = *worker.job;
+    delete worker.job;
+    worker.job = nullptr;
+    worker.busy = false;
+}
+
 int main(int argc, char* argv[]) {
     // Check if we're running in command-line mode
     if (argc >= 3) {
@@ -416,17 +734,7 @@ int main(int argc, char* argv[]) {
             state.selectedVariants.push_back("RANDOM");
         }
         
-        // Process the file
-        processFile(state.inputFile, state.outputFile, state);
-        std::cout << state.statusMessage << std::endl;
-        
-        // Generate MIDI if output file is specified
-        if (!state.midiOutputFile.empty()) {
-            convertToMidi(state.outputFile, state.midiOutputFile, state);
-            std::cout << state.statusMessage << std::endl;
-        }
-        
-        return 0;
+        return runCommandLine(state, isatty(STDERR_FILENO));
     }
 
     // GUI mode
@@ -436,218 +744,219 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // Get screen
-    int screen = DefaultScreen(display);
-    
-    // Create window with teal background
-    XColor teal_color;
-    Colormap colormap = DefaultColormap(display, screen);
-    XParseColor(display, colormap, "#008080", &teal_color); // Teal color
-    XAllocColor(display, colormap, &teal_color);
-    
-    Window window = XCreateSimpleWindow(
-        display, RootWindow(display, screen),
+    X11Gui gui;
+    gui.display = display;
+    gui.screen = DefaultScreen(display);
+
+    // Allocate colors once for the lifetime of the window
+    Colormap colormap = DefaultColormap(display, gui.screen);
+    gui.teal = allocColor(display, colormap, "#008080");        // Teal background
+    gui.green = allocColor(display, colormap, "#009600");       // Medium green buttons
+    gui.darkGreen = allocColor(display, colormap, "#006400");   // Slider handle
+    gui.white = WhitePixel(display, gui.screen);
+
+    gui.window = XCreateSimpleWindow(
+        display, RootWindow(display, gui.screen),
         10, 10, WINDOW_WIDTH, WINDOW_HEIGHT, 1,
-        BlackPixel(display, screen), teal_color.pixel
+        BlackPixel(display, gui.screen), gui.teal
     );
-    
+
     // Set window title
-    XStoreName(display, window, WINDOW_TITLE);
-    
+    XStoreName(display, gui.window, WINDOW_TITLE);
+
     // Select window events
-    XSelectInput(display, window, ExposureMask | ButtonPressMask | KeyPressMask);
-    
-    // Create GC for drawing
-    GC gc = XCreateGC(display, window, 0, NULL);
-    
+    XSelectInput(display, gui.window, ExposureMask | ButtonPressMask | KeyPressMask);
+
+    // Create one GC per color so drawing never has to switch foregrounds
+    gui.textGC = createGC(display, gui.window, gui.white);
+    gui.buttonGC = createGC(display, gui.window, gui.green);
+    gui.handleGC = createGC(display, gui.window, gui.darkGreen);
+    gui.backgroundGC = createGC(display, gui.window, gui.teal);
+
     // Map window to display
-    XMapWindow(display, window);
-    
+    XMapWindow(display, gui.window);
+
     // Create application state
     AppState state;
-    
-    // Event loop
+
+    // Wakeup pipe: the worker writes a byte when progress changes or it finishes
+    X11Worker worker;
+    if (pipe(worker.wakeFds) != 0) {
+        std::cerr << "Cannot create wakeup pipe" << std::endl;
+        return 1;
+    }
+    fcntl(worker.wakeFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(worker.wakeFds[1], F_SETFL, O_NONBLOCK);
+    // Called on the worker thread by the engine, rate limited
+    int wakeFd = worker.wakeFds[1];
+    worker.progress.onProgress = [wakeFd](const ProgressSink&) {
+        char byte = 'p';
+        ssize_t ignored = write(wakeFd, &byte, 1);
+        (void)ignored;
+    };
+
+    // Event loop: drain queued X events, then sleep in poll on the X
+    // connection and the wakeup pipe
     XEvent event;
     bool running = true;
-    
+    pollfd fds[2];
+    fds[0].fd = ConnectionNumber(display);
+    fds[0].events = POLLIN;
+    fds[1].fd = worker.wakeFds[0];
+    fds[1].events = POLLIN;
+
     while (running) {
-        XNextEvent(display, &event);
-        
-        switch (event.type) {
-            case Expose: {
-                // Draw UI elements
-                XDrawString(display, window, gc, 20, 30, "Input File:", 11);
-                XDrawString(display, window, gc, 20, 70, "Output File:", 12);
-                XDrawString(display, window, gc, 20, 110, "MIDI Output:", 12);
-                XDrawString(display, window, gc, 20, 150, "Transformation %:", 17);
-                XDrawString(display, window, gc, 20, 210, "Variant Selection:", 18);
-                XDrawString(display, window, gc, 20, 270, "Status:", 7);
-                
-                // Draw title
-                XDrawString(display, window, gc, 200, 30, "Trill Transformation Tool", 24);
-                XDrawString(display, window, gc, 200, 50, "Transforms eligible notes with trills", 35);
-                
-                // Create medium green color for buttons
-                XColor green_color;
-                XParseColor(display, colormap, "#009600", &green_color); // Medium green color
-                XAllocColor(display, colormap, &green_color);
-                
-                // Save original foreground color
-                unsigned long original_fg = XGetForeground(display, gc);
-                
-                // Set green color for button backgrounds
-                XSetForeground(display, gc, green_color.pixel);
-                
-                // Draw buttons with green background
-                XFillRectangle(display, window, gc, 150, 20, 150, 30);
-                XFillRectangle(display, window, gc, 150, 60, 150, 30);
-                XFillRectangle(display, window, gc, 150, 100, 150, 30);
-                
-                // Reset to white for text
-                XSetForeground(display, gc, WhitePixel(display, screen));
-                
-                // Draw button text
-                XDrawString(display, window, gc, 170, 40, "Select Input File", 16);
-                XDrawString(display, window, gc, 170, 80, "Select Output File", 17);
-                XDrawString(display, window, gc, 170, 120, "Select MIDI Output", 17);
-                
-                // Draw button borders
-                XDrawRectangle(display, window, gc, 150, 20, 150, 30);
-                XDrawRectangle(display, window, gc, 150, 60, 150, 30);
-                XDrawRectangle(display, window, gc, 150, 100, 150, 30);
-                
-                // Draw slider with green background
-                XSetForeground(display, gc, green_color.pixel);
-                XFillRectangle(display, window, gc, 150, 140, 200, 20);
-                
-                // Reset to white for border
-                XSetForeground(display, gc, WhitePixel(display, screen));
-                XDrawRectangle(display, window, gc, 150, 140, 200, 20);
-                
-                // Draw slider handle with darker green
-                XColor dark_green;
-                XParseColor(display, colormap, "#006400", &dark_green);
-                XAllocColor(display, colormap, &dark_green);
-                XSetForeground(display, gc, dark_green.pixel);
-                
-                int sliderPos = 150 + (state.transformationPercentage * 2);
-                XFillRectangle(display, window, gc, sliderPos, 140, 10, 20);
-                
-                // Draw variant selection with green background
-                XSetForeground(display, gc, green_color.pixel);
-                XFillRectangle(display, window, gc, 150, 200, 200, 30);
-                
-                // Reset to white for text and border
-                XSetForeground(display, gc, WhitePixel(display, screen));
-                XDrawRectangle(display, window, gc, 150, 200, 200, 30);
-                XDrawString(display, window, gc, 170, 220, "Random", 6);
-                
-                // Draw process buttons with green background
-                XSetForeground(display, gc, green_color.pixel);
-                XFillRectangle(display, window, gc, 20, 300, 150, 30);
-                XFillRectangle(display, window, gc, 180, 300, 150, 30);
-                
-                // Reset to white for text
-                XSetForeground(display, gc, WhitePixel(display, screen));
-                
-                // Draw button text
-                XDrawString(display, window, gc, 60, 320, "Process File", 12);
-                XDrawString(display, window, gc, 210, 320, "Generate MIDI", 13);
-                
-                // Draw button borders
-                XDrawRectangle(display, window, gc, 20, 300, 150, 30);
-                XDrawRectangle(display, window, gc, 180, 300, 150, 30);
-                
-                // Draw status area
-                XDrawRectangle(display, window, gc, 20, 340, WINDOW_WIDTH - 40, 240);
-                if (!state.statusMessage.empty()) {
-                    XDrawString(display, window, gc, 30, 360, state.statusMessage.c_str(), state.statusMessage.length());
-                }
-                break;
-            }
-                
-            case ButtonPress: {
-                // Handle button clicks
-                int x = event.xbutton.x;
-                int y = event.xbutton.y;
-                
-                // Input file button
-                if (x >= 150 && x <= 300 && y >= 20 && y <= 50) {
-                    // Open file dialog (simplified)
-                    state.inputFile = "/tmp/input.txt";
-                    state.statusMessage = "Input file selected: " + state.inputFile;
-                    XClearArea(display, window, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, True);
-                }
-                
-                // Output file button
-                else if (x >= 150 && x <= 300 && y >= 60 && y <= 90) {
-                    // Open file dialog (simplified)
-                    state.outputFile = "/tmp/output.txt";
-                    state.statusMessage = "Output file selected: " + state.outputFile;
-                    XClearArea(display, window, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, True);
-                }
-                
-                // MIDI output file button
-                else if (x >= 150 && x <= 300 && y >= 100 && y <= 130) {
-                    // Open file dialog (simplified)
-                    state.midiOutputFile = "/tmp/output.mid";
-                    state.statusMessage = "MIDI output file selected: " + state.midiOutputFile;
-                    XClearArea(display, window, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, True);
-                }
-                
-                // Slider
-                else if (x >= 150 && x <= 350 && y >= 140 && y <= 160) {
-                    state.transformationPercentage = (x - 150) / 2;
-                    if (state.transformationPercentage < 0) state.transformationPercentage = 0;
-                    if (state.transformationPercentage > 100) state.transformationPercentage = 100;
-                    XClearArea(display, window, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, True);
-                }
-                
-                // Variant selection
-                else if (x >= 150 && x <= 350 && y >= 200 && y <= 230) {
-                    // Toggle through variants (simplified)
-                    state.selectedVariants.clear();
-                    state.selectedVariants.push_back("RANDOM");
-                    XClearArea(display, window, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, True);
+        while (running && XPending(display) > 0) {
+            XNextEvent(display, &event);
+
+            switch (event.type) {
+                case Expose: {
+                    // Redraw once per batch of expose events
+                    if (event.xexpose.count == 0) {
+                        drawControls(gui);
+                        drawSlider(gui, state);
+                        drawProgress(gui, worker);
+                        drawStatus(gui, state);
+                    }
+                    break;
                 }
-                
-                // Process file button
-                else if (x >= 20 && x <= 170 && y >= 300 && y <= 330) {
-                    if (state.inputFile.empty() || state.outputFile.empty()) {
-                        state.statusMessage = "Error: Please select input and output files.";
-                    } else {
-                        processFile(state.inputFile, state.outputFile, state);
+
+                case ButtonPress: {
+                    // Handle button clicks
+                    int x = event.xbutton.x;
+                    int y = event.xbutton.y;
+
+                    // Cancel button works while a job is running
+                    if (x >= 340 && x <= 440 && y >= 300 && y <= 330) {
+                        if (worker.busy) {
+                            worker.cancel.cancel();
+                            state.statusMessage = "Cancelling...";
+                            drawStatus(gui, state);
+                        }
+                        break;
                     }
-                    XClearArea(display, window, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, True);
+
+                    // Everything else edits the state the worker may be using
+                    if (worker.busy) {
+                        break;
+                    }
+
+                    // Input file button
+                    if (x >= 150 && x <= 300 && y >= 20 && y <= 50) {
+                        // Open file dialog (simplified)
+                        state.inputFile = "/tmp/input.txt";
+                        state.statusMessage = "Input file selected: " + state.inputFile;
+                        drawStatus(gui, state);
+                    }
+
+                    // Output file button
+                    else if (x >= 150 && x <= 300 && y >= 60 && y <= 90) {
+                        // Open file dialog (simplified)
+                        state.outputFile = "/tmp/output.txt";
+                        state.statusMessage = "Output file selected: " + state.outputFile;
+                        drawStatus(gui, state);
+                    }
+
+                    // MIDI output file button
+                    else if (x >= 150 && x <= 300 && y >= 100 && y <= 130) {
+                        // Open file dialog (simplified)
+                        state.midiOutputFile = "/tmp/output.mid";
+                        state.statusMessage = "MIDI output file selected: " + state.midiOutputFile;
+                        drawStatus(gui, state);
+                    }
+
+                    // Slider
+                    else if (x >= 150 && x <= 350 && y >= 140 && y <= 160) {
+                        state.transformationPercentage = (x - 150) / 2;
+                        if (state.transformationPercentage < 0) state.transformationPercentage = 0;
+                        if (state.transformationPercentage > 100) state.transformationPercentage = 100;
+                        drawSlider(gui, state);
+                    }
+
+                    // Variant selection
+                    else if (x >= 150 && x <= 350 && y >= 200 && y <= 230) {
+                        // Toggle through variants (simplified)
+                        state.selectedVariants.clear();
+                        state.selectedVariants.push_back("RANDOM");
+                    }
+
+                    // Process file button
+                    else if (x >= 20 && x <= 170 && y >= 300 && y <= 330) {
+                        if (state.inputFile.empty() || state.outputFile.empty()) {
+                            state.statusMessage = "Error: Please select input and output files.";
+                        } else {
+                            startJob(worker, state, false);
+                            state.statusMessage = "Processing " + state.inputFile + "...";
+                        }
+                        drawProgress(gui, worker);
+                        drawStatus(gui, state);
+                    }
+
+                    // Generate MIDI button
+                    else if (x >= 180 && x <= 330 && y >= 300 && y <= 330) {
+                        if (state.outputFile.empty() || state.midiOutputFile.empty()) {
+                            state.statusMessage = "Error: Please process a file and select MIDI output file.";
+                        } else {
+                            startJob(worker, state, true);
+                            state.statusMessage = "Generating " + state.midiOutputFile + "...";
+                        }
+                        drawProgress(gui, worker);
+                        drawStatus(gui, state);
+                    }
+                    break;
                 }
-                
-                // Generate MIDI button
-                else if (x >= 180 && x <= 330 && y >= 300 && y <= 330) {
-                    if (state.outputFile.empty() || state.midiOutputFile.empty()) {
-                        state.statusMessage = "Error: Please process a file and select MIDI output file.";
-                    } else {
-                        convertToMidi(state.outputFile, state.midiOutputFile, state);
+
+                case KeyPress: {
+                    // Handle key press (ESC to quit)
+                    if (XLookupKeysym(&event.xkey, 0) == XK_Escape) {
+                        running = false;
                     }
-                    XClearArea(display, window, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, True);
+                    break;
                 }
-                break;
             }
-                
-            case KeyPress: {
-                // Handle key press (ESC to quit)
-                if (XLookupKeysym(&event.xkey, 0) == XK_Escape) {
-                    running = false;
-                }
-                break;
+        }
+        if (!running) {
+            break;
+        }
+        XFlush(display);
+
+        if (poll(fds, 2, -1) < 0) {
+            continue;  // Interrupted by a signal
+        }
+
+        if (fds[1].revents & POLLIN) {
+            // Drain the pipe; a 'd' means the worker has finished
+            char buffer[64];
+            bool finished = false;
+            ssize_t n;
+            while ((n = read(worker.wakeFds[0], buffer, sizeof(buffer))) > 0) {
+                finished = finished || std::memchr(buffer, 'd', n) != nullptr;
+            }
+            if (finished) {
+                finishJob(worker, state);
+                drawStatus(gui, state);
             }
+            drawProgress(gui, worker);
         }
     }
-    
+
+    // Stop a running job before tearing down
+    worker.cancel.cancel();
+    if (worker.thread.joinable()) {
+        worker.thread.join();
+    }
+    delete worker.job;
+    close(worker.wakeFds[0]);
+    close(worker.wakeFds[1]);
+
     // Clean up
-    XFreeGC(display, gc);
-    XDestroyWindow(display, window);
+    XFreeGC(display, gui.textGC);
+    XFreeGC(display, gui.buttonGC);
+    XFreeGC(display, gui.handleGC);
+    XFreeGC(display, gui.backgroundGC);
+    XDestroyWindow(display, gui.window);
     XCloseDisplay(display);
-    
+
     return 0;
 }
 #endif
@@ -679,16 +988,6 @@ int main(int argc, char* argv[]) {
         state.selectedVariants.push_back("RANDOM");
     }
     
-    // Process the file
-    processFile(state.inputFile, state.outputFile, state);
-    std::cout << state.statusMessage << std::endl;
-    
-    // Generate MIDI if output file is specified
-    if (!state.midiOutputFile.empty()) {
-        convertToMidi(state.outputFile, state.midiOutputFile, state);
-        std::cout << state.statusMessage << std::endl;
-    }
-    
-    return 0;
+    return runCommandLine(state, false);
 }
 #endif
\ No newline at end of file